@@ -0,0 +1,53 @@
+#include "environment.hpp"
+#include <benchmark/benchmark.h>
+#include <buggy/vulkan.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Creates a device-local buffer of state.range(0) bytes and uploads to it through the staging ring, waiting for the
+// copy to finish. bytes_per_second is the end-to-end upload bandwidth, including buffer creation.
+static void buffer_upload(benchmark::State& state)
+{
+	auto& env = benchmark_environment::get();
+	auto uploads = *vulkan::upload_batcher::create(env.device, env.memory);
+	auto const data = std::vector<std::byte>(static_cast<std::size_t>(state.range(0)), std::byte{0xB6});
+
+	for (auto _ : state) {
+		auto uploaded = vulkan::buffer<std::byte>::create(
+		  env.device,
+		  env.memory,
+		  uploads,
+		  std::span(data),
+		  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+		auto const flushed = uploads.flush().and_then([&uploads](vulkan::upload_token const token) {
+			return uploads.wait(token);
+		});
+		if (not uploaded or not flushed) {
+			state.SkipWithError("the upload failed");
+			break;
+		}
+
+		benchmark::DoNotOptimize(uploaded);
+	}
+
+	state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations()) * state.range(0));
+}
+
+// Buffer creation alone: vkCreateBuffer plus a sub-allocation from memory_allocator.
+static void buffer_creation(benchmark::State& state)
+{
+	auto& env = benchmark_environment::get();
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(vulkan::buffer<std::byte>::create(
+		  env.device,
+		  env.memory,
+		  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		  static_cast<VkDeviceSize>(state.range(0))));
+	}
+}
+
+BENCHMARK(buffer_upload)->Arg(64 * 1024)->Arg(1024 * 1024)->Arg(16 * 1024 * 1024)->Unit(benchmark::kMicrosecond);
+BENCHMARK(buffer_creation)->Arg(64 * 1024)->Arg(16 * 1024 * 1024)->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,92 @@
+#include "environment.hpp"
+#include <benchmark/benchmark.h>
+#include <array>
+#include <buggy/vulkan.hpp>
+#include <cstdint>
+#include <span>
+
+// Records state.range(0) draws into a render pass on one thread, without submitting them, so that the per-draw
+// recording cost can be separated from the fixed cost of beginning and ending a command buffer.
+static void command_recording(benchmark::State& state)
+{
+	auto& env = benchmark_environment::get();
+	auto const draw_count = static_cast<std::uint32_t>(state.range(0));
+	auto const pool = *vulkan::command_pool::create(env.device, vulkan::queue_kind::graphics);
+	auto commands = *vulkan::command_buffer::create(env.device, pool, 1);
+
+	auto const record_draws = [draw_count](VkCommandBuffer const command) noexcept {
+		for (auto i = std::uint32_t{0}; i < draw_count; ++i) {
+			vkCmdDraw(command, 3, 1, 0, i);
+		}
+		return vulkan::error_or<void>();
+	};
+
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(
+		  commands.record(0, env.render_pass, env.framebuffer, env.extent, env.pipeline, record_draws));
+	}
+
+	state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations()) * draw_count);
+	state.counters["draws_per_second"] =
+	  benchmark::Counter(static_cast<double>(state.iterations()) * draw_count, benchmark::Counter::kIsRate);
+}
+
+BENCHMARK(command_recording)->Arg(1)->Arg(100)->Arg(10'000)->Unit(benchmark::kMicrosecond);
+
+// The same draws as command_recording, but recorded with dynamic rendering straight to the target's view, so no
+// render pass or framebuffer is involved.
+static void dynamic_rendering_recording(benchmark::State& state)
+{
+	auto& env = benchmark_environment::get();
+	if (not env.device.physical_device().dynamic_rendering) {
+		state.SkipWithError("dynamic rendering is unsupported");
+		return;
+	}
+
+	auto const pipeline = [&env] {
+		constexpr auto dynamic_states = std::array{VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+		auto const vertex_shader =
+		  *vulkan::vertex_shader::create(std::span(benchmark_environment::empty_vertex), env.device);
+		auto const fragment_shader =
+		  *vulkan::fragment_shader::create(std::span(benchmark_environment::empty_fragment), env.device);
+		return *vulkan::graphics_pipeline::create(
+		  env.device,
+		  env.cache,
+		  env.layout,
+		  env.target.format(),
+		  dynamic_states,
+		  env.extent,
+		  {&vertex_shader, 1},
+		  {},
+		  {},
+		  {&fragment_shader, 1});
+	}();
+
+	auto const draw_count = static_cast<std::uint32_t>(state.range(0));
+	auto const pool = *vulkan::command_pool::create(env.device, vulkan::queue_kind::graphics);
+	auto commands = *vulkan::command_buffer::create(env.device, pool, 1);
+
+	auto const record_draws = [draw_count](VkCommandBuffer const command) noexcept {
+		for (auto i = std::uint32_t{0}; i < draw_count; ++i) {
+			vkCmdDraw(command, 3, 1, 0, i);
+		}
+		return vulkan::error_or<void>();
+	};
+
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(commands.record(
+		  0,
+		  env.target.get(),
+		  env.target.view(),
+		  env.extent,
+		  vulkan::offscreen_target::final_layout,
+		  pipeline,
+		  record_draws));
+	}
+
+	state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations()) * draw_count);
+	state.counters["draws_per_second"] =
+	  benchmark::Counter(static_cast<double>(state.iterations()) * draw_count, benchmark::Counter::kIsRate);
+}
+
+BENCHMARK(dynamic_rendering_recording)->Arg(1)->Arg(100)->Arg(10'000)->Unit(benchmark::kMicrosecond);
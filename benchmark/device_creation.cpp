@@ -0,0 +1,32 @@
+#include "environment.hpp"
+#include <benchmark/benchmark.h>
+#include <buggy/vulkan.hpp>
+
+// Startup cost: creating an instance loads the ICDs, and creating a device initialises the driver's queues.
+static void instance_creation(benchmark::State& state)
+{
+	auto const app_info = VkApplicationInfo{
+	  .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
+	  .pNext = nullptr,
+	  .pApplicationName = "buggy_benchmark",
+	  .applicationVersion = VK_MAKE_VERSION(1, 0, 0),
+	  .pEngineName = "buggy",
+	  .engineVersion = VK_MAKE_VERSION(1, 0, 0),
+	  .apiVersion = VK_API_VERSION_1_2,
+	};
+
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(vulkan::instance::create(app_info, {}, {}, vulkan::instance::presentation::headless));
+	}
+}
+
+static void device_creation(benchmark::State& state)
+{
+	auto& env = benchmark_environment::get();
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(vulkan::device::create(env.instance, [](auto const&) noexcept { return true; }));
+	}
+}
+
+BENCHMARK(instance_creation)->Unit(benchmark::kMillisecond);
+BENCHMARK(device_creation)->Unit(benchmark::kMillisecond);
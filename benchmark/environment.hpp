@@ -0,0 +1,118 @@
+#ifndef BUGGY_BENCHMARK_ENVIRONMENT_HPP
+#define BUGGY_BENCHMARK_ENVIRONMENT_HPP
+
+#include <array>
+#include <buggy/vulkan.hpp>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <span>
+#include <string_view>
+
+namespace benchmark_environment {
+	// Empty entry points. The cost of the benchmarked operations is dominated by the driver rather than by the
+	// shaders themselves, so these are enough to build real pipelines without shipping .spv files.
+	inline constexpr auto empty_kernel = std::array<std::uint32_t, 35>{
+	  0x07230203, 0x00010000, 0x00000000, 5, 0, // header
+	  0x00020011, 1,                            // OpCapability Shader
+	  0x0003000E, 0, 1,                         // OpMemoryModel Logical GLSL450
+	  0x0005000F, 5, 3, 0x6E69616D, 0,          // OpEntryPoint GLCompute %3 "main"
+	  0x00060010, 3, 17, 1, 1, 1,               // OpExecutionMode %3 LocalSize 1 1 1
+	  0x00020013, 1,                            // %1 = OpTypeVoid
+	  0x00030021, 2, 1,                         // %2 = OpTypeFunction %1
+	  0x00050036, 1, 3, 0, 2,                   // %3 = OpFunction %1 None %2
+	  0x000200F8, 4,                            // %4 = OpLabel
+	  0x000100FD,                               // OpReturn
+	  0x00010038,                               // OpFunctionEnd
+	};
+
+	inline constexpr auto empty_vertex = std::array<std::uint32_t, 29>{
+	  0x07230203, 0x00010000, 0x00000000, 5, 0, // header
+	  0x00020011, 1,                            // OpCapability Shader
+	  0x0003000E, 0, 1,                         // OpMemoryModel Logical GLSL450
+	  0x0005000F, 0, 3, 0x6E69616D, 0,          // OpEntryPoint Vertex %3 "main"
+	  0x00020013, 1,                            // %1 = OpTypeVoid
+	  0x00030021, 2, 1,                         // %2 = OpTypeFunction %1
+	  0x00050036, 1, 3, 0, 2,                   // %3 = OpFunction %1 None %2
+	  0x000200F8, 4,                            // %4 = OpLabel
+	  0x000100FD,                               // OpReturn
+	  0x00010038,                               // OpFunctionEnd
+	};
+
+	inline constexpr auto empty_fragment = std::array<std::uint32_t, 32>{
+	  0x07230203, 0x00010000, 0x00000000, 5, 0, // header
+	  0x00020011, 1,                            // OpCapability Shader
+	  0x0003000E, 0, 1,                         // OpMemoryModel Logical GLSL450
+	  0x0005000F, 4, 3, 0x6E69616D, 0,          // OpEntryPoint Fragment %3 "main"
+	  0x00030010, 3, 7,                         // OpExecutionMode %3 OriginUpperLeft
+	  0x00020013, 1,                            // %1 = OpTypeVoid
+	  0x00030021, 2, 1,                         // %2 = OpTypeFunction %1
+	  0x00050036, 1, 3, 0, 2,                   // %3 = OpFunction %1 None %2
+	  0x000200F8, 4,                            // %4 = OpLabel
+	  0x000100FD,                               // OpReturn
+	  0x00010038,                               // OpFunctionEnd
+	};
+
+	inline std::filesystem::path write_spirv(std::string_view const name, std::span<std::uint32_t const> const code)
+	{
+		auto path = std::filesystem::temp_directory_path() / name;
+		auto file = std::ofstream(path, std::ios_base::binary | std::ios_base::trunc);
+		auto const bytes = std::as_bytes(code);
+		file.write(reinterpret_cast<char const*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+		return path;
+	}
+
+	// Everything a benchmark needs to create pipelines and record into a real render pass. It's headless, so it runs
+	// on CI machines with only a software implementation such as lavapipe, and is created on first use so that
+	// benchmarks which are filtered out don't pay for device creation.
+	struct environment {
+		static constexpr auto extent = VkExtent2D{.width = 256, .height = 256};
+
+		vulkan::instance instance = [] {
+			auto const app_info = VkApplicationInfo{
+			  .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
+			  .pNext = nullptr,
+			  .pApplicationName = "buggy_benchmark",
+			  .applicationVersion = VK_MAKE_VERSION(1, 0, 0),
+			  .pEngineName = "buggy",
+			  .engineVersion = VK_MAKE_VERSION(1, 0, 0),
+			  .apiVersion = VK_API_VERSION_1_3,
+			};
+			return *vulkan::instance::create(app_info, {}, {}, vulkan::instance::presentation::headless);
+		}();
+		vulkan::device device = *vulkan::device::create(instance, [](auto const&) noexcept { return true; });
+		vulkan::memory_allocator memory = *vulkan::memory_allocator::create(device);
+		vulkan::offscreen_target target =
+		  *vulkan::offscreen_target::create(device, memory, VK_FORMAT_R8G8B8A8_UNORM, extent);
+		vulkan::render_pass render_pass =
+		  *vulkan::render_pass::create(device, target.format(), vulkan::offscreen_target::final_layout);
+		vulkan::framebuffer framebuffer = *vulkan::framebuffer::create(device, target.view(), render_pass, extent);
+		vulkan::pipeline_layout layout = *vulkan::pipeline_layout::create(device);
+		vulkan::pipeline_cache cache = *vulkan::pipeline_cache::create(device);
+		vulkan::compute_shader kernel = *vulkan::compute_shader::create(std::span(empty_kernel), device);
+		vulkan::graphics_pipeline pipeline = [this] {
+			constexpr auto dynamic_states = std::array{VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+			auto const vertex_shader = *vulkan::vertex_shader::create(std::span(empty_vertex), device);
+			auto const fragment_shader = *vulkan::fragment_shader::create(std::span(empty_fragment), device);
+			return *vulkan::graphics_pipeline::create(
+			  device,
+			  cache,
+			  layout,
+			  render_pass,
+			  dynamic_states,
+			  extent,
+			  {&vertex_shader, 1},
+			  {},
+			  {},
+			  {&fragment_shader, 1});
+		}();
+	};
+
+	inline environment& get()
+	{
+		static auto result = environment();
+		return result;
+	}
+} // namespace benchmark_environment
+
+#endif // BUGGY_BENCHMARK_ENVIRONMENT_HPP
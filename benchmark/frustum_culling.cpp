@@ -0,0 +1,91 @@
+#include "environment.hpp"
+#include <benchmark/benchmark.h>
+#include <buggy/vulkan.hpp>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+template<class T>
+static vulkan::buffer<T> host_storage(benchmark_environment::environment& env, std::vector<T> const& data)
+{
+	auto result = *vulkan::buffer<T>::create(
+	  env.device,
+	  env.memory,
+	  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+	  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+	  sizeof(T) * data.size());
+	std::memcpy(result.memory().mapped(), data.data(), sizeof(T) * data.size());
+	return result;
+}
+
+// Culls state.range(0) objects scattered around a camera that sees roughly an eighth of them, and waits for the
+// compacted draws. This is the work that replaces CPU culling and recording a draw per object.
+static void gpu_frustum_culling(benchmark::State& state)
+{
+	auto& env = benchmark_environment::get();
+	if (not env.device.physical_device().draw_indirect_count) {
+		state.SkipWithError("drawIndirectCount is unsupported");
+		return;
+	}
+
+	auto const object_count = static_cast<std::uint32_t>(state.range(0));
+	auto engine = std::mt19937(0xC0111);
+	auto position = std::uniform_real_distribution<float>(-100.0f, 100.0f);
+	auto bounds = std::vector<vulkan::bounding_sphere>(object_count);
+	for (auto& sphere : bounds) {
+		auto const x = position(engine);
+		auto const y = position(engine);
+		auto const z = position(engine);
+		sphere = vulkan::bounding_sphere{.x = x, .y = y, .z = z, .radius = 1.0f};
+	}
+
+	constexpr auto cube = VkDrawIndexedIndirectCommand{
+	  .indexCount = 36,
+	  .instanceCount = 1,
+	  .firstIndex = 0,
+	  .vertexOffset = 0,
+	  .firstInstance = 0,
+	};
+	auto const draws = std::vector<VkDrawIndexedIndirectCommand>(object_count, cube);
+
+	auto const bounds_buffer = host_storage(env, bounds);
+	auto const draws_buffer = host_storage(env, draws);
+	auto const culler =
+	  *vulkan::frustum_culler::create(env.device, env.memory, env.cache, bounds_buffer, draws_buffer, object_count);
+
+	// An orthographic projection of the box [0, 100] x [0, 100] x [-100, 0], looking down -z.
+	constexpr auto view_projection = std::array{
+	  0.02f, 0.0f, 0.0f, 0.0f, 0.0f, 0.02f, 0.0f, 0.0f, 0.0f, 0.0f, -0.01f, 0.0f, -1.0f, -1.0f, 0.0f, 1.0f,
+	};
+	auto const view = vulkan::frustum::from_view_projection(view_projection);
+
+	auto const pool = *vulkan::command_pool::create(env.device, vulkan::queue_kind::graphics);
+	auto commands = *vulkan::command_buffer::create(env.device, pool, 1);
+	auto done = *vulkan::fence::create(env.device);
+	constexpr auto begin_info = VkCommandBufferBeginInfo{
+	  .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+	  .pNext = nullptr,
+	  .flags = {},
+	  .pInheritanceInfo = nullptr,
+	};
+	(void)vkBeginCommandBuffer(commands.get(0), &begin_info);
+	culler.record(commands.get(0), view);
+	(void)vkEndCommandBuffer(commands.get(0));
+
+	VkCommandBuffer submission[] = {commands.get(0)};
+	VkFence fences[] = {done.get()};
+	for (auto _ : state) {
+		auto const culled = env.device.reset(fences)
+		                      .and_then([&] { return env.device.submit(submission, {}, {}, {}, done); })
+		                      .and_then([&] { return env.device.wait_all(fences); });
+		if (not culled) {
+			state.SkipWithError("the culling pass failed");
+			break;
+		}
+	}
+
+	state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * object_count));
+}
+
+BENCHMARK(gpu_frustum_culling)->Arg(10'000)->Arg(100'000)->Unit(benchmark::kMicrosecond)->UseRealTime();
@@ -0,0 +1,103 @@
+#include "environment.hpp"
+#include <benchmark/benchmark.h>
+#include <buggy/vulkan.hpp>
+#include <cstdint>
+#include <random>
+#include <utility>
+#include <vector>
+
+// Streams mesh-sized allocations in and out of a single 256 MiB block, keeping roughly state.range(0)
+// allocations alive at any one time. This is the sub-allocation cost that replaces a vkAllocateMemory
+// call per buffer. The mean allocation is about 512 KiB, so the live set stays well inside the block.
+static void mixed_create_destroy(benchmark::State& state)
+{
+	constexpr auto capacity = VkDeviceSize{256} * 1024 * 1024;
+	auto const live_target = static_cast<std::size_t>(state.range(0));
+
+	auto regions = vulkan::tlsf_allocator(capacity);
+	auto live = std::vector<std::uint32_t>();
+	live.reserve(live_target * 2);
+
+	auto engine = std::mt19937_64(0xB0661);
+	auto sizes = std::uniform_int_distribution<VkDeviceSize>(256, 1024 * 1024);
+	auto alignments = std::uniform_int_distribution<std::uint32_t>(4, 8);
+	auto allocations = std::int64_t{0};
+	auto failures = std::int64_t{0};
+
+	for (auto _ : state) {
+		if (live.size() < live_target or engine() % 2 == 0) {
+			auto const region = regions.allocate(sizes(engine), VkDeviceSize{1} << alignments(engine));
+			if (region) {
+				live.push_back(region->id);
+				++allocations;
+			}
+			else {
+				++failures;
+			}
+		}
+		else {
+			auto const victim = engine() % live.size();
+			regions.free(live[victim]);
+			live[victim] = live.back();
+			live.pop_back();
+		}
+	}
+
+	auto const free_bytes = regions.capacity() - regions.used();
+	state.counters["allocations_per_second"] = benchmark::Counter(static_cast<double>(allocations), benchmark::Counter::kIsRate);
+	state.counters["failed_allocations"] = static_cast<double>(failures);
+	state.counters["utilisation"] = static_cast<double>(regions.used()) / static_cast<double>(capacity);
+	state.counters["fragmentation"] =
+	  free_bytes == 0 ? 0.0 : 1.0 - static_cast<double>(regions.largest_free_region()) / static_cast<double>(free_bytes);
+}
+
+BENCHMARK(mixed_create_destroy)->Arg(64)->Arg(128)->Arg(256);
+
+// The same stream of allocations through memory_allocator on a real device, so the numbers include pool lookup and
+// the vkAllocateMemory calls made when a new block is needed.
+static void device_create_destroy(benchmark::State& state)
+{
+	auto& env = benchmark_environment::get();
+	auto memory = *vulkan::memory_allocator::create(env.device);
+	auto const live_target = static_cast<std::size_t>(state.range(0));
+
+	auto live = std::vector<vulkan::allocation>();
+	live.reserve(live_target * 2);
+
+	auto engine = std::mt19937_64(0xB0661);
+	auto sizes = std::uniform_int_distribution<VkDeviceSize>(256, 1024 * 1024);
+	auto alignments = std::uniform_int_distribution<std::uint32_t>(4, 8);
+	auto allocations = std::int64_t{0};
+	auto failures = std::int64_t{0};
+
+	for (auto _ : state) {
+		if (live.size() < live_target or engine() % 2 == 0) {
+			auto const requirements = VkMemoryRequirements{
+			  .size = sizes(engine),
+			  .alignment = VkDeviceSize{1} << alignments(engine),
+			  .memoryTypeBits = ~std::uint32_t{0},
+			};
+			auto result = memory.allocate(requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+			if (result) {
+				live.push_back(std::move(*result));
+				++allocations;
+			}
+			else {
+				++failures;
+			}
+		}
+		else {
+			auto const victim = engine() % live.size();
+			live[victim] = std::move(live.back());
+			live.pop_back();
+		}
+	}
+
+	auto const stats = memory.stats();
+	state.counters["allocations_per_second"] = benchmark::Counter(static_cast<double>(allocations), benchmark::Counter::kIsRate);
+	state.counters["failed_allocations"] = static_cast<double>(failures);
+	state.counters["device_allocations"] = static_cast<double>(stats.device_allocations);
+	state.counters["fragmentation"] = stats.fragmentation;
+}
+
+BENCHMARK(device_create_destroy)->Arg(64)->Arg(128)->Arg(256);
@@ -0,0 +1,128 @@
+#include "environment.hpp"
+#include <benchmark/benchmark.h>
+#include <buggy/vulkan.hpp>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Records the draws into commands' first buffer, and submits it with the readback in its second buffer.
+template<class F>
+[[nodiscard]] static vulkan::error_or<void> render_frame(
+  benchmark_environment::environment& env,
+  vulkan::command_buffer& commands,
+  vulkan::fence& done,
+  F const& record_draws) noexcept
+{
+	VkFence fences[] = {done.get()};
+	if (auto const result = env.device.reset(fences); not result) {
+		return result;
+	}
+
+	auto const recorded = commands.record(0, env.render_pass, env.framebuffer, env.extent, env.pipeline, record_draws);
+	if (not recorded) {
+		return recorded;
+	}
+
+	VkCommandBuffer submission[] = {commands.get(0), commands.get(1)};
+	if (auto const result = env.device.submit(submission, {}, {}, {}, done); not result) {
+		return result;
+	}
+
+	return env.device.wait_all(fences);
+}
+
+// Renders and reads back whole frames, so this covers recording, submission, GPU execution and the copy to the
+// host. It's headless, so it can track end-to-end throughput in CI.
+static void offscreen_frame(benchmark::State& state)
+{
+	auto& env = benchmark_environment::get();
+	auto const draw_count = static_cast<std::uint32_t>(state.range(0));
+	auto const pool = *vulkan::command_pool::create(env.device, vulkan::queue_kind::graphics);
+	auto commands = *vulkan::command_buffer::create(env.device, pool, 2);
+	auto done = *vulkan::fence::create(env.device);
+
+	constexpr auto begin_info = VkCommandBufferBeginInfo{
+	  .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+	  .pNext = nullptr,
+	  .flags = {},
+	  .pInheritanceInfo = nullptr,
+	};
+	(void)vkBeginCommandBuffer(commands.get(1), &begin_info);
+	env.target.record_readback(commands.get(1));
+	(void)vkEndCommandBuffer(commands.get(1));
+
+	auto const record_draws = [draw_count](VkCommandBuffer const command) noexcept {
+		for (auto i = std::uint32_t{0}; i < draw_count; ++i) {
+			vkCmdDraw(command, 3, 1, 0, i);
+		}
+		return vulkan::error_or<void>();
+	};
+
+	for (auto _ : state) {
+		if (not render_frame(env, commands, done, record_draws)) {
+			state.SkipWithError("the frame failed to render");
+			break;
+		}
+
+		auto pixel = env.target.pixels().front();
+		benchmark::DoNotOptimize(pixel);
+	}
+
+	state.counters["frames_per_second"] =
+	  benchmark::Counter(static_cast<double>(state.iterations()), benchmark::Counter::kIsRate);
+	state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() * env.target.pixels().size()));
+}
+
+// The same frames as offscreen_frame, but every draw comes from a single vkCmdDrawIndirect.
+static void offscreen_frame_indirect(benchmark::State& state)
+{
+	auto& env = benchmark_environment::get();
+	auto const draw_count = static_cast<std::uint32_t>(state.range(0));
+	auto const pool = *vulkan::command_pool::create(env.device, vulkan::queue_kind::graphics);
+	auto commands = *vulkan::command_buffer::create(env.device, pool, 2);
+	auto done = *vulkan::fence::create(env.device);
+
+	auto draws = std::vector<VkDrawIndirectCommand>(draw_count);
+	for (auto i = std::uint32_t{0}; i < draw_count; ++i) {
+		draws[i] = VkDrawIndirectCommand{.vertexCount = 3, .instanceCount = 1, .firstVertex = 0, .firstInstance = i};
+	}
+
+	auto const arguments = *vulkan::buffer<VkDrawIndirectCommand>::create(
+	  env.device,
+	  env.memory,
+	  VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+	  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+	  sizeof(VkDrawIndirectCommand) * draws.size());
+	std::memcpy(arguments.memory().mapped(), draws.data(), sizeof(VkDrawIndirectCommand) * draws.size());
+
+	constexpr auto begin_info = VkCommandBufferBeginInfo{
+	  .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+	  .pNext = nullptr,
+	  .flags = {},
+	  .pInheritanceInfo = nullptr,
+	};
+	(void)vkBeginCommandBuffer(commands.get(1), &begin_info);
+	env.target.record_readback(commands.get(1));
+	(void)vkEndCommandBuffer(commands.get(1));
+
+	auto const record_draws = [draw_count, &arguments](VkCommandBuffer const command) noexcept {
+		vulkan::draw_indirect(command, arguments.get(), 0, draw_count);
+		return vulkan::error_or<void>();
+	};
+
+	for (auto _ : state) {
+		if (not render_frame(env, commands, done, record_draws)) {
+			state.SkipWithError("the frame failed to render");
+			break;
+		}
+
+		auto pixel = env.target.pixels().front();
+		benchmark::DoNotOptimize(pixel);
+	}
+
+	state.counters["frames_per_second"] =
+	  benchmark::Counter(static_cast<double>(state.iterations()), benchmark::Counter::kIsRate);
+}
+
+BENCHMARK(offscreen_frame)->Arg(1)->Arg(1'000)->Arg(10'000)->Unit(benchmark::kMicrosecond)->UseRealTime();
+BENCHMARK(offscreen_frame_indirect)->Arg(1)->Arg(1'000)->Arg(10'000)->Unit(benchmark::kMicrosecond)->UseRealTime();
@@ -0,0 +1,40 @@
+#include "environment.hpp"
+#include <benchmark/benchmark.h>
+#include <buggy/vulkan.hpp>
+#include <cstdint>
+
+// Records the same draw list into a render pass using an increasing number of threads. Nothing is submitted: the
+// benchmark measures CPU recording cost only, so the numbers isolate how well recording scales with threads.
+static void parallel_recording(benchmark::State& state)
+{
+	constexpr auto draw_count = std::uint32_t{20'000};
+	auto& env = benchmark_environment::get();
+	auto const threads = static_cast<std::uint32_t>(state.range(0));
+	auto recorder = *vulkan::parallel_recorder::create(env.device, 1, threads);
+	auto const pool = *vulkan::command_pool::create(env.device, vulkan::queue_kind::graphics);
+	auto primary = *vulkan::command_buffer::create(env.device, pool, 1);
+
+	auto const record_range = [](VkCommandBuffer const command, std::uint32_t const first, std::uint32_t const count) {
+		for (auto i = first; i < first + count; ++i) {
+			vkCmdDraw(command, 3, 1, 0, i);
+		}
+		return vulkan::error_or<void>();
+	};
+
+	for (auto _ : state) {
+		auto const secondaries = *recorder.record(
+		  0,
+		  env.render_pass,
+		  env.framebuffer,
+		  env.pipeline,
+		  env.extent,
+		  draw_count,
+		  record_range);
+		benchmark::DoNotOptimize(primary.record(0, env.render_pass, env.framebuffer, env.extent, secondaries));
+	}
+
+	state.counters["draws_per_second"] =
+	  benchmark::Counter(static_cast<double>(state.iterations()) * draw_count, benchmark::Counter::kIsRate);
+}
+
+BENCHMARK(parallel_recording)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->Unit(benchmark::kMicrosecond)->UseRealTime();
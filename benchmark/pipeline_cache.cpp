@@ -0,0 +1,59 @@
+#include "environment.hpp"
+#include <benchmark/benchmark.h>
+#include <buggy/vulkan.hpp>
+
+static void cold_pipeline_cache(benchmark::State& state)
+{
+	auto& env = benchmark_environment::get();
+	for (auto _ : state) {
+		auto const cache = *vulkan::pipeline_cache::create(env.device);
+		benchmark::DoNotOptimize(vulkan::compute_pipeline::create(env.device, cache, env.layout, env.kernel));
+	}
+}
+
+static void warm_pipeline_cache(benchmark::State& state)
+{
+	auto& env = benchmark_environment::get();
+	auto const cache = *vulkan::pipeline_cache::create(env.device);
+	if (not vulkan::compute_pipeline::create(env.device, cache, env.layout, env.kernel)) {
+		state.SkipWithError("the pipeline that warms the cache failed to compile");
+		return;
+	}
+
+	auto const blob = *cache.data();
+
+	for (auto _ : state) {
+		auto const warm_cache = *vulkan::pipeline_cache::create(env.device, blob);
+		benchmark::DoNotOptimize(vulkan::compute_pipeline::create(env.device, warm_cache, env.layout, env.kernel));
+	}
+
+	state.counters["cache_bytes"] = static_cast<double>(blob.size());
+}
+
+static void pipeline_variant_lookup(benchmark::State& state)
+{
+	auto& env = benchmark_environment::get();
+	auto const vertex_shader = *vulkan::vertex_shader::create(std::span(benchmark_environment::empty_vertex), env.device);
+	auto const fragment_shader =
+	  *vulkan::fragment_shader::create(std::span(benchmark_environment::empty_fragment), env.device);
+	auto const pipeline_state = vulkan::graphics_pipeline_state{
+	  .layout = env.layout.get(),
+	  .render_pass = env.render_pass.get(),
+	  .viewport_extent = env.extent,
+	  .stages = {vertex_shader.stage(), fragment_shader.stage()},
+	};
+
+	auto variants = *vulkan::pipeline_variants::create(env.device, env.cache);
+	if (not variants.get(pipeline_state)) {
+		state.SkipWithError("the pipeline variant failed to compile");
+		return;
+	}
+
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(variants.get(pipeline_state));
+	}
+}
+
+BENCHMARK(cold_pipeline_cache)->Unit(benchmark::kMicrosecond);
+BENCHMARK(warm_pipeline_cache)->Unit(benchmark::kMicrosecond);
+BENCHMARK(pipeline_variant_lookup);
@@ -0,0 +1,114 @@
+#include "environment.hpp"
+#include <array>
+#include <benchmark/benchmark.h>
+#include <buggy/render_graph.hpp>
+#include <buggy/vulkan.hpp>
+#include <cstdint>
+
+// A deferred frame: a G-buffer pass and a lighting pass that only exchange data through attachments, so they merge
+// into one render pass. A compute pass blurs the lit image into memory that the G-buffer no longer needs, and both
+// are sampled by a tonemapping pass. The debug pass writes nothing that reaches the target, so it's culled. The passes
+// themselves record nothing, so only the graph's own work is measured.
+static vulkan::render_graph deferred_frame(benchmark_environment::environment& env)
+{
+	auto graph = *vulkan::render_graph::create(env.device, env.memory);
+	auto const extent = env.extent;
+	auto const albedo = graph.create_image({.name = "albedo", .format = VK_FORMAT_R8G8B8A8_UNORM, .extent = extent});
+	auto const normal = graph.create_image({.name = "normal", .format = VK_FORMAT_R16G16B16A16_SFLOAT, .extent = extent});
+	auto const depth = graph.create_image({.name = "depth", .format = VK_FORMAT_D32_SFLOAT, .extent = extent});
+	auto const lit = graph.create_image({.name = "lit", .format = VK_FORMAT_R16G16B16A16_SFLOAT, .extent = extent});
+	auto const bloom = graph.create_image({.name = "bloom", .format = VK_FORMAT_R16G16B16A16_SFLOAT, .extent = extent});
+	auto const debug = graph.create_image({.name = "debug", .format = VK_FORMAT_R8G8B8A8_UNORM, .extent = extent});
+	auto const target = graph.import_image(
+	  {.name = "target", .format = env.target.format(), .extent = extent},
+	  env.target.get(),
+	  env.target.view().get(),
+	  VK_IMAGE_LAYOUT_UNDEFINED,
+	  vulkan::offscreen_target::final_layout);
+
+	constexpr auto black = VkClearValue{.color = {.float32 = {0.0f, 0.0f, 0.0f, 1.0f}}};
+	constexpr auto far_plane = VkClearValue{.depthStencil = {.depth = 1.0f, .stencil = 0}};
+
+	auto const gbuffer_uses = std::array{
+	  vulkan::image_use{.image = albedo, .access = vulkan::image_access::colour_attachment, .clear = black},
+	  vulkan::image_use{.image = normal, .access = vulkan::image_access::colour_attachment, .clear = black},
+	  vulkan::image_use{.image = depth, .access = vulkan::image_access::depth_attachment, .clear = far_plane},
+	};
+	(void)graph.add_pass("gbuffer", gbuffer_uses);
+
+	auto const lighting_uses = std::array{
+	  vulkan::image_use{.image = albedo, .access = vulkan::image_access::input_attachment},
+	  vulkan::image_use{.image = normal, .access = vulkan::image_access::input_attachment},
+	  vulkan::image_use{.image = depth, .access = vulkan::image_access::depth_read},
+	  vulkan::image_use{.image = lit, .access = vulkan::image_access::colour_attachment, .clear = black},
+	};
+	(void)graph.add_pass("lighting", lighting_uses);
+
+	auto const debug_uses = std::array{
+	  vulkan::image_use{.image = normal, .access = vulkan::image_access::sampled_fragment},
+	  vulkan::image_use{.image = debug, .access = vulkan::image_access::colour_attachment, .clear = black},
+	};
+	(void)graph.add_pass("debug", debug_uses);
+
+	auto const bloom_uses = std::array{
+	  vulkan::image_use{.image = lit, .access = vulkan::image_access::sampled_compute},
+	  vulkan::image_use{.image = bloom, .access = vulkan::image_access::storage_write},
+	};
+	(void)graph.add_pass("bloom", bloom_uses);
+
+	auto const tonemap_uses = std::array{
+	  vulkan::image_use{.image = lit, .access = vulkan::image_access::sampled_fragment},
+	  vulkan::image_use{.image = bloom, .access = vulkan::image_access::sampled_fragment},
+	  vulkan::image_use{.image = target, .access = vulkan::image_access::colour_attachment, .clear = black},
+	};
+	(void)graph.add_pass("tonemap", tonemap_uses);
+	return graph;
+}
+
+// Building and compiling the graph, which includes creating its transient images and render passes.
+static void render_graph_compile(benchmark::State& state)
+{
+	auto& env = benchmark_environment::get();
+	auto statistics = vulkan::render_graph::statistics{};
+	for (auto _ : state) {
+		auto graph = deferred_frame(env);
+		benchmark::DoNotOptimize(graph.compile());
+		statistics = graph.stats();
+	}
+
+	state.counters["render_passes"] = statistics.render_passes;
+	state.counters["culled_passes"] = statistics.culled_passes;
+	state.counters["barriers"] = statistics.barriers;
+	state.counters["lazily_allocated_images"] = statistics.lazily_allocated_images;
+	state.counters["transient_memory"] = static_cast<double>(statistics.transient_memory);
+	state.counters["unaliased_memory"] = static_cast<double>(statistics.unaliased_memory);
+}
+
+BENCHMARK(render_graph_compile)->Unit(benchmark::kMicrosecond);
+
+// Recording a compiled graph, which is the per-frame cost once its framebuffers have been cached.
+static void render_graph_execute(benchmark::State& state)
+{
+	auto& env = benchmark_environment::get();
+	auto graph = deferred_frame(env);
+	if (not graph.compile()) {
+		state.SkipWithError("the render graph failed to compile");
+		return;
+	}
+
+	auto const pool = *vulkan::command_pool::create(env.device, vulkan::queue_kind::graphics);
+	auto const commands = *vulkan::command_buffer::create(env.device, pool, 1);
+	constexpr auto begin_info = VkCommandBufferBeginInfo{
+	  .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+	  .pNext = nullptr,
+	  .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+	  .pInheritanceInfo = nullptr,
+	};
+	for (auto _ : state) {
+		(void)vkBeginCommandBuffer(commands.get(0), &begin_info);
+		benchmark::DoNotOptimize(graph.execute(commands.get(0)));
+		(void)vkEndCommandBuffer(commands.get(0));
+	}
+}
+
+BENCHMARK(render_graph_execute)->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,41 @@
+#include "environment.hpp"
+#include <benchmark/benchmark.h>
+#include <buggy/job_system.hpp>
+#include <buggy/vulkan.hpp>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+static void spirv_file_open(benchmark::State& state)
+{
+	auto const path = benchmark_environment::write_spirv("buggy_empty_vertex.spv", benchmark_environment::empty_vertex);
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(vulkan::spirv_file::open(path));
+	}
+}
+
+// Loads a library of modules with an increasing number of threads.
+static void parallel_shader_loading(benchmark::State& state)
+{
+	constexpr auto library_size = 256;
+	auto& env = benchmark_environment::get();
+	auto paths = std::vector<std::filesystem::path>();
+	paths.reserve(library_size);
+	for (auto i = 0; i < library_size; ++i) {
+		paths.push_back(benchmark_environment::write_spirv(
+		  "buggy_library_" + std::to_string(i) + ".spv",
+		  benchmark_environment::empty_vertex));
+	}
+
+	auto workers = jobs::thread_pool(static_cast<std::uint32_t>(state.range(0)));
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(vulkan::vertex_shader::create(paths, env.device, workers));
+	}
+
+	state.counters["modules_per_second"] =
+	  benchmark::Counter(static_cast<double>(state.iterations()) * library_size, benchmark::Counter::kIsRate);
+}
+
+BENCHMARK(spirv_file_open)->Unit(benchmark::kMicrosecond);
+BENCHMARK(parallel_shader_loading)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->Unit(benchmark::kMillisecond)->UseRealTime();
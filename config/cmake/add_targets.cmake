@@ -135,4 +135,6 @@ function(cxx_benchmark)
 	   benchmark::benchmark
 	   benchmark::benchmark_main
 	)
+
+	set_property(GLOBAL APPEND PROPERTY ${PROJECT_NAME}_BENCHMARK_TARGETS "${add_target_args_TARGET}")
 endfunction()
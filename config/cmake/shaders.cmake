@@ -0,0 +1,100 @@
+# Copyright (c) Christopher Di Bella.
+# SPDX-License-Identifier: Apache-2.0
+#
+find_program(GLSLANG_VALIDATOR NAMES glslangValidator glslang)
+if(NOT GLSLANG_VALIDATOR)
+	message(FATAL_ERROR "glslangValidator is required to compile shaders, but it couldn't be found.")
+endif()
+
+# Compiles GLSL shaders to SPIR-V and embeds them in a static library, so that loading a shader never touches the
+# filesystem. The library exports `${TARGET}.hpp`, which declares `vulkan::shader_bundle NAMESPACE::bundle()`.
+# Each shader is named after its file (e.g. `shader.vert`), and the shader stage is deduced from its extension.
+function(shader_bundle)
+	set(optional_args "")
+	set(single_args TARGET NAMESPACE)
+	set(multi_args SHADERS)
+	cmake_parse_arguments(shader_bundle_args "${optional_args}" "${single_args}" "${multi_args}" ${ARGN})
+
+	if("${shader_bundle_args_TARGET}" STREQUAL "")
+		message(FATAL_ERROR "TARGET is not set. Cannot build a shader bundle without naming it!")
+	endif()
+
+	if("${shader_bundle_args_NAMESPACE}" STREQUAL "")
+		set(shader_bundle_args_NAMESPACE "${shader_bundle_args_TARGET}")
+	endif()
+
+	set(output_dir "${CMAKE_CURRENT_BINARY_DIR}/${shader_bundle_args_TARGET}")
+	set(includes "")
+	set(entries "")
+	set(spirv_headers "")
+	list(SORT shader_bundle_args_SHADERS)
+	foreach(shader IN LISTS shader_bundle_args_SHADERS)
+		get_filename_component(shader_path "${shader}" ABSOLUTE)
+		get_filename_component(shader_name "${shader}" NAME)
+		string(MAKE_C_IDENTIFIER "${shader_name}" identifier)
+		set(spirv_header "${output_dir}/${shader_name}.h")
+
+		add_custom_command(
+		  OUTPUT "${spirv_header}"
+		  COMMAND "${GLSLANG_VALIDATOR}" -V --target-env vulkan1.2 --vn "${identifier}" -o "${spirv_header}" "${shader_path}"
+		  DEPENDS "${shader_path}"
+		  COMMENT "Compiling ${shader_name} to SPIR-V"
+		  VERBATIM
+		)
+
+		list(APPEND spirv_headers "${spirv_header}")
+		string(APPEND includes "#include \"${shader_name}.h\"\n")
+		string(APPEND entries "\t\t  vulkan::shader_bundle_entry{.name = \"${shader_name}\", .code = ${identifier}},\n")
+	endforeach()
+
+	string(MAKE_C_IDENTIFIER "${shader_bundle_args_TARGET}" guard)
+	string(TOUPPER "${guard}" guard)
+	# The sources are written via configure_file so that they're only touched (and rebuilt) when they change.
+	file(
+	  WRITE "${output_dir}/${shader_bundle_args_TARGET}.hpp.in"
+	  "#ifndef ${guard}_HPP\n"
+	  "#define ${guard}_HPP\n"
+	  "\n"
+	  "#include <buggy/vulkan.hpp>\n"
+	  "\n"
+	  "namespace ${shader_bundle_args_NAMESPACE} {\n"
+	  "\t[[nodiscard]] vulkan::shader_bundle bundle() noexcept;\n"
+	  "} // namespace ${shader_bundle_args_NAMESPACE}\n"
+	  "\n"
+	  "#endif // ${guard}_HPP\n"
+	)
+	file(
+	  WRITE "${output_dir}/${shader_bundle_args_TARGET}.cpp.in"
+	  "#include \"${shader_bundle_args_TARGET}.hpp\"\n"
+	  "#include <array>\n"
+	  "#include <cstdint>\n"
+	  "\n"
+	  "namespace ${shader_bundle_args_NAMESPACE} {\n"
+	  "${includes}"
+	  "\n"
+	  "\tvulkan::shader_bundle bundle() noexcept\n"
+	  "\t{\n"
+	  "\t\tstatic constexpr auto entries = std::array{\n"
+	  "${entries}"
+	  "\t\t};\n"
+	  "\t\treturn entries;\n"
+	  "\t}\n"
+	  "} // namespace ${shader_bundle_args_NAMESPACE}\n"
+	)
+
+	foreach(extension IN ITEMS hpp cpp)
+		configure_file(
+		  "${output_dir}/${shader_bundle_args_TARGET}.${extension}.in"
+		  "${output_dir}/${shader_bundle_args_TARGET}.${extension}"
+		  COPYONLY
+		)
+	endforeach()
+
+	cxx_library(
+	  TARGET "${shader_bundle_args_TARGET}"
+	  FILENAMES "${output_dir}/${shader_bundle_args_TARGET}.cpp" ${spirv_headers}
+	  INCLUDE_AND_EXPORT "${output_dir}"
+	  LINK_AND_EXPORT Vulkan::Vulkan
+	)
+	set_target_properties("${shader_bundle_args_TARGET}" PROPERTIES CXX_CLANG_TIDY "")
+endfunction()
@@ -0,0 +1,119 @@
+#ifndef BUGGY_CPU_PROFILER_HPP
+#define BUGGY_CPU_PROFILER_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace profiling {
+	// Configure with BUGGY_ENABLE_CPU_PROFILING=On to record samples. Otherwise scoped_timer compiles away, and the
+	// ring stays empty.
+#ifdef BUGGY_CPU_PROFILING
+	inline constexpr bool enabled = true;
+#else
+	inline constexpr bool enabled = false;
+#endif
+
+	using clock = std::chrono::steady_clock;
+
+	// phase must refer to storage that outlives the sample, such as a string literal.
+	struct sample {
+		std::string_view phase;
+		clock::time_point start;
+		std::chrono::nanoseconds duration;
+		std::uint32_t thread;
+	};
+
+	// A fixed-size ring of samples that any number of threads can push to without locking. Once full, the oldest
+	// samples are overwritten. Each slot carries a sequence number, which writers claim the slot with, so snapshot
+	// skips slots that are being written, or that have been overwritten since.
+	class sample_ring {
+	public:
+		static constexpr auto capacity = std::size_t{1} << 14;
+
+		void push(sample const& s) noexcept;
+
+		// The samples that are in the ring when it's called, oldest first.
+		[[nodiscard]] std::vector<sample> snapshot() const;
+	private:
+		struct slot {
+			std::atomic<std::uint64_t> sequence{0};
+			std::atomic<char const*> phase{nullptr};
+			std::atomic<std::size_t> phase_size{0};
+			std::atomic<clock::rep> start{0};
+			std::atomic<std::chrono::nanoseconds::rep> duration{0};
+			std::atomic<std::uint32_t> thread{0};
+		};
+
+		std::array<slot, capacity> slots_;
+		std::atomic<std::uint64_t> next_{0};
+	};
+
+	// The ring that scoped_timer records to, which the library's own frame phases are also recorded to.
+	[[nodiscard]] sample_ring& samples() noexcept;
+
+	// A small, stable number for the calling thread.
+	[[nodiscard]] std::uint32_t thread_index() noexcept;
+
+	// Records a sample of phase that was measured elsewhere, e.g. by frame_scheduler's frame_timings.
+	inline void record(std::string_view const phase, clock::time_point const start, clock::time_point const end) noexcept
+	{
+		if constexpr (enabled) {
+			samples().push(sample{
+			  .phase = phase,
+			  .start = start,
+			  .duration = end - start,
+			  .thread = thread_index(),
+			});
+		}
+	}
+
+	// Records how long the enclosing scope takes as a sample of phase.
+	class scoped_timer {
+	public:
+		explicit scoped_timer(std::string_view const phase) noexcept
+		{
+			if constexpr (enabled) {
+				phase_ = phase;
+				start_ = clock::now();
+			}
+		}
+
+		scoped_timer(scoped_timer const&) = delete;
+		scoped_timer& operator=(scoped_timer const&) = delete;
+
+		~scoped_timer()
+		{
+			if constexpr (enabled) {
+				record(phase_, start_, clock::now());
+			}
+		}
+	private:
+		std::string_view phase_;
+		clock::time_point start_;
+	};
+
+	struct phase_summary {
+		std::string_view phase;
+		std::size_t count;
+		std::chrono::nanoseconds mean;
+		std::chrono::nanoseconds p50;
+		std::chrono::nanoseconds p90;
+		std::chrono::nanoseconds p99;
+		std::chrono::nanoseconds max;
+	};
+
+	// One summary per phase, in the order that each phase first appears.
+	[[nodiscard]] std::vector<phase_summary> summarise(std::span<sample const> samples);
+
+	// Chrome's trace event format, which chrome://tracing and Perfetto can open.
+	[[nodiscard]] std::string chrome_trace(std::span<sample const> samples);
+} // namespace profiling
+
+#endif // BUGGY_CPU_PROFILER_HPP
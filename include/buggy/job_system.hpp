@@ -0,0 +1,47 @@
+#ifndef BUGGY_JOB_SYSTEM_HPP
+#define BUGGY_JOB_SYSTEM_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace jobs {
+	[[nodiscard]] std::uint32_t hardware_threads() noexcept;
+
+	// A fixed set of worker threads that run fork-join batches: run hands out the indices [0, count) to the
+	// workers and only returns once every index has been processed. run must not be called concurrently.
+	class thread_pool {
+	public:
+		explicit thread_pool(std::uint32_t threads = hardware_threads());
+
+		thread_pool(thread_pool&&) = delete;
+		thread_pool& operator=(thread_pool&&) = delete;
+		thread_pool(thread_pool const&) = delete;
+		thread_pool& operator=(thread_pool const&) = delete;
+		~thread_pool();
+
+		[[nodiscard]] std::uint32_t size() const noexcept
+		{
+			return static_cast<std::uint32_t>(workers_.size());
+		}
+
+		void run(std::uint32_t count, std::function<void(std::uint32_t)> const& job) noexcept;
+	private:
+		std::mutex mutex_;
+		std::condition_variable work_available_;
+		std::condition_variable work_done_;
+		std::function<void(std::uint32_t)> const* job_ = nullptr;
+		std::uint32_t next_ = 0;
+		std::uint32_t count_ = 0;
+		std::uint32_t remaining_ = 0;
+		bool stopping_ = false;
+		std::vector<std::jthread> workers_;
+
+		void work() noexcept;
+	};
+} // namespace jobs
+
+#endif // BUGGY_JOB_SYSTEM_HPP
@@ -0,0 +1,229 @@
+#ifndef BUGGY_RENDER_GRAPH_HPP
+#define BUGGY_RENDER_GRAPH_HPP
+
+#include "vulkan.hpp"
+#include <concepts>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+namespace vulkan {
+	struct graph_image {
+		std::uint32_t index;
+	};
+
+	struct graph_pass {
+		std::uint32_t index;
+	};
+
+	// How a pass uses an image. The attachment accesses (colour_attachment through input_attachment) are only valid in
+	// passes that draw, and every attachment that a pass uses must have the same extent.
+	enum class image_access : std::uint8_t {
+		colour_attachment,
+		depth_attachment,
+		depth_read,
+		input_attachment,
+		sampled_fragment,
+		sampled_compute,
+		storage_read,
+		storage_write,
+		transfer_read,
+		transfer_write,
+	};
+
+	struct image_use {
+		graph_image image;
+		image_access access;
+
+		// Only meaningful for colour_attachment and depth_attachment. The image is cleared when it's first written,
+		// rather than loaded.
+		std::optional<VkClearValue> clear = std::nullopt;
+	};
+
+	// The render pass and subpass that a drawing pass was compiled into, for creating its pipelines.
+	struct pass_target {
+		VkRenderPass render_pass;
+		std::uint32_t subpass;
+		VkExtent2D extent;
+	};
+
+	// Builds a frame from passes that declare which images they read and write, and derives everything that would
+	// otherwise be hand-written:
+	//   * Passes that don't contribute to an imported image are culled.
+	//   * Consecutive drawing passes that share an extent, and only exchange data through attachments, are merged
+	//     into subpasses of one render pass, so tiling GPUs can keep the intermediate results on chip.
+	//   * Layout transitions and pipeline barriers are placed between passes, and subpass dependencies within
+	//     render passes.
+	//   * Transient images with disjoint lifetimes share memory. Attachments that never leave their render pass are
+	//     created as transient attachments, backed by lazily allocated memory where the device has it.
+	//
+	// Passes are executed in the order that they're added. After compile(), images can't be created and passes can't
+	// be added, but imported images can be rebound, e.g. to the swapchain image acquired for the frame. A framebuffer is
+	// cached for each set of views that a render pass is executed with, so compile() should be called again when the
+	// views that were bound are destroyed, such as when the swapchain is recreated.
+	class render_graph {
+	public:
+		using execute_fn = void (*)(void* context, VkCommandBuffer command);
+
+		struct image_info {
+			std::string_view name;
+			VkFormat format;
+			VkExtent2D extent;
+		};
+
+		struct statistics {
+			std::uint32_t passes;
+			std::uint32_t culled_passes;
+			std::uint32_t render_passes;
+			std::uint32_t barriers;
+			std::uint32_t transient_images;
+			std::uint32_t lazily_allocated_images;
+
+			// The memory backing transient images that aren't lazily allocated, with and without aliasing.
+			VkDeviceSize transient_memory;
+			VkDeviceSize unaliased_memory;
+		};
+
+		[[nodiscard]] static error_or<render_graph>
+		create(device const& d, memory_allocator& memory, VkAllocationCallbacks const* alloc = nullptr) noexcept;
+
+		// An image that the graph owns. Its contents don't persist between executions.
+		[[nodiscard]] graph_image create_image(image_info const& info) noexcept;
+
+		// An image that's owned elsewhere. It's expected to be in initial_layout when the graph starts executing, and
+		// is left in final_layout. Only passes that contribute to imported images are kept.
+		[[nodiscard]] graph_image import_image(
+		  image_info const& info,
+		  VkImage image,
+		  VkImageView view,
+		  VkImageLayout initial_layout,
+		  VkImageLayout final_layout) noexcept;
+
+		// execute is called through a pointer to it, so it must outlive the graph.
+		template<class F>
+		requires std::invocable<F&, VkCommandBuffer>
+		[[nodiscard]] graph_pass
+		add_pass(std::string_view const name, std::span<image_use const> const uses, F& execute) noexcept
+		{
+			auto const erased = [](void* const context, VkCommandBuffer const command) noexcept {
+				(*static_cast<F*>(context))(command);
+			};
+			return add_pass(name, uses, erased, &execute);
+		}
+
+		// A pass with no execute only exists for its barriers, and to clear its attachments.
+		[[nodiscard]] graph_pass add_pass(
+		  std::string_view name,
+		  std::span<image_use const> uses,
+		  execute_fn execute = nullptr,
+		  void* context = nullptr) noexcept;
+
+		// Compiling again discards everything that the previous compile created, including the cached framebuffers, so
+		// the graph mustn't be in use by the device.
+		[[nodiscard]] error_or<void> compile() noexcept;
+
+		void bind(graph_image image, VkImage handle, VkImageView view) noexcept;
+
+		// Records every pass that wasn't culled. Must be recorded outside of a render pass.
+		[[nodiscard]] error_or<void> execute(VkCommandBuffer command) noexcept;
+
+		// Only valid after compile(). render_pass is VK_NULL_HANDLE for passes that don't draw.
+		[[nodiscard]] pass_target target(graph_pass pass) const noexcept;
+		[[nodiscard]] bool culled(graph_pass pass) const noexcept;
+		[[nodiscard]] statistics stats() const noexcept;
+	private:
+		static constexpr auto unused = ~std::uint32_t{0};
+
+		struct image_resource {
+			std::string name;
+			VkFormat format;
+			VkExtent2D extent;
+			VkImage image = VK_NULL_HANDLE;
+			VkImageView view = VK_NULL_HANDLE;
+
+			// Only used by imported images.
+			bool imported = false;
+			VkImageLayout initial_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+			VkImageLayout final_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+			// Only used by transient images.
+			VkImageUsageFlags usage = 0;
+			bool lazily_allocated = false;
+
+			// The steps that the image is used in, and the image that used its memory before it.
+			std::uint32_t first_step = unused;
+			std::uint32_t last_step = unused;
+			std::uint32_t alias_of = unused;
+		};
+
+		struct pass_node {
+			std::string name;
+			std::vector<image_use> uses;
+			execute_fn execute;
+			void* context;
+			bool draws;
+			bool culled = false;
+			std::uint32_t step = unused;
+			std::uint32_t subpass = 0;
+		};
+
+		// Either one pass that doesn't draw, or one render pass whose subpasses are the passes that were merged.
+		struct step {
+			std::vector<std::uint32_t> passes;
+			bool draws;
+			VkExtent2D extent;
+
+			// Recorded before the step. The image handles are filled in at execution, so that they can be rebound.
+			std::vector<VkImageMemoryBarrier> barriers;
+			std::vector<std::uint32_t> barrier_images;
+			VkPipelineStageFlags src_stages = 0;
+			VkPipelineStageFlags dst_stages = 0;
+
+			VkRenderPass render_pass = VK_NULL_HANDLE;
+			std::vector<std::uint32_t> attachments;
+			std::vector<VkClearValue> clear_values;
+
+			// One framebuffer for each set of views that the step has been executed with since it was compiled.
+			using framebuffer_handle = std::unique_ptr<VkFramebuffer_T, deleter<PFN_vkDestroyFramebuffer, VkDevice>>;
+			std::vector<std::pair<std::vector<VkImageView>, framebuffer_handle>> framebuffers;
+		};
+
+		device const* device_;
+		memory_allocator* memory_allocator_;
+		VkAllocationCallbacks const* allocator_;
+		std::vector<image_resource> images_;
+
+		// Declared so that everything is destroyed before the memory that it's bound to.
+		std::vector<allocation> memory_;
+		std::vector<std::unique_ptr<VkImage_T, deleter<PFN_vkDestroyImage, VkDevice>>> owned_images_;
+		std::vector<std::unique_ptr<VkImageView_T, deleter<PFN_vkDestroyImageView, VkDevice>>> owned_views_;
+		std::vector<std::unique_ptr<VkRenderPass_T, deleter<PFN_vkDestroyRenderPass, VkDevice>>> render_passes_;
+
+		std::vector<pass_node> passes_;
+		std::vector<step> steps_;
+		std::vector<VkImageMemoryBarrier> final_barriers_;
+		std::vector<std::uint32_t> final_barrier_images_;
+		VkPipelineStageFlags final_src_stages_ = 0;
+		VkPipelineStageFlags final_dst_stages_ = 0;
+		statistics statistics_{};
+		bool compiled_ = false;
+
+		render_graph(device const& d, memory_allocator& memory, VkAllocationCallbacks const* alloc) noexcept;
+
+		void reset() noexcept;
+		void cull() noexcept;
+		void merge() noexcept;
+		[[nodiscard]] error_or<void> create_images() noexcept;
+		[[nodiscard]] error_or<void> create_render_pass(std::uint32_t step_index) noexcept;
+		void schedule_barriers() noexcept;
+		[[nodiscard]] error_or<VkFramebuffer> framebuffer(step& s) noexcept;
+	};
+} // namespace vulkan
+
+#endif // BUGGY_RENDER_GRAPH_HPP
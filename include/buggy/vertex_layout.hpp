@@ -0,0 +1,477 @@
+#ifndef BUGGY_VERTEX_LAYOUT_HPP
+#define BUGGY_VERTEX_LAYOUT_HPP
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <glm/fwd.hpp>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vulkan/vulkan.h>
+
+namespace vulkan {
+	// Converts to IEEE 754 binary16, rounding to nearest even.
+	[[nodiscard]] constexpr std::uint16_t to_half(float const value) noexcept
+	{
+		auto const bits = std::bit_cast<std::uint32_t>(value);
+		auto const sign = (bits >> 16) & 0x8000;
+		auto const biased_exponent = static_cast<std::int32_t>((bits >> 23) & 0xff);
+		auto mantissa = bits & 0x7f'ffff;
+		if (biased_exponent == 0xff) {
+			return static_cast<std::uint16_t>(sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0));
+		}
+
+		auto const exponent = biased_exponent - 127 + 15;
+		if (exponent >= 0x1f) {
+			return static_cast<std::uint16_t>(sign | 0x7c00);
+		}
+
+		auto const round = [](std::uint32_t const truncated, std::uint32_t const remainder, std::uint32_t const halfway) {
+			return truncated + (remainder > halfway or (remainder == halfway and (truncated & 1) != 0) ? 1 : 0);
+		};
+
+		if (exponent <= 0) {
+			if (exponent < -10) {
+				return static_cast<std::uint16_t>(sign);
+			}
+
+			// Subnormal: the implicit leading one becomes explicit, and is shifted into the mantissa.
+			mantissa |= 0x80'0000;
+			auto const shift = static_cast<std::uint32_t>(14 - exponent);
+			auto const remainder = mantissa & ((std::uint32_t{1} << shift) - 1);
+			return static_cast<std::uint16_t>(sign | round(mantissa >> shift, remainder, std::uint32_t{1} << (shift - 1)));
+		}
+
+		// A mantissa that rounds up carries into the exponent, which correctly rounds the largest values to infinity.
+		auto const truncated = (static_cast<std::uint32_t>(exponent) << 10) | (mantissa >> 13);
+		return static_cast<std::uint16_t>(sign | round(truncated, mantissa & 0x1fff, 0x1000));
+	}
+
+	// Packed attribute types, which the vertex fetch expands to floats. They trade precision for bandwidth: a half_vec<3>
+	// normal is half the size of a glm::vec3, and a snorm_10_10_10_2 normal is a third.
+	template<std::size_t N>
+	requires (N >= 1 and N <= 4)
+	struct half_vec {
+		std::array<std::uint16_t, N> bits;
+
+		[[nodiscard]] static constexpr half_vec from(std::array<float, N> const& values) noexcept
+		{
+			auto result = half_vec();
+			std::ranges::transform(values, result.bits.begin(), to_half);
+			return result;
+		}
+	};
+
+	template<class T>
+	concept normalisable =
+	  std::same_as<T, std::int8_t> or std::same_as<T, std::uint8_t> or std::same_as<T, std::int16_t>
+	  or std::same_as<T, std::uint16_t>;
+
+	// Integers that are read as floats in [0, 1] when T is unsigned, or [-1, 1] when T is signed.
+	template<normalisable T, std::size_t N>
+	requires (N >= 1 and N <= 4)
+	struct normalised_vec {
+		std::array<T, N> values;
+
+		[[nodiscard]] static constexpr normalised_vec from(std::array<float, N> const& values) noexcept
+		{
+			auto result = normalised_vec();
+			std::ranges::transform(values, result.values.begin(), [](float const x) noexcept {
+				auto const max = static_cast<float>(std::numeric_limits<T>::max());
+				auto const scaled = std::clamp(x, std::is_signed_v<T> ? -1.0f : 0.0f, 1.0f) * max;
+				return static_cast<T>(scaled < 0.0f ? scaled - 0.5f : scaled + 0.5f);
+			});
+			return result;
+		}
+	};
+
+	// Three 10-bit components and a 2-bit component in one std::uint32_t, with x in the lowest bits. Unsigned
+	// components are read as [0, 1], and signed ones as [-1, 1].
+	template<bool is_signed>
+	struct packed_10_10_10_2 {
+		std::uint32_t bits;
+
+		[[nodiscard]] static constexpr packed_10_10_10_2
+		from(float const x, float const y, float const z, float const w) noexcept
+		{
+			auto const pack = [](float const value, std::uint32_t const width) noexcept {
+				auto const max = static_cast<float>((std::uint32_t{1} << (width - (is_signed ? 1 : 0))) - 1);
+				auto const scaled = std::clamp(value, is_signed ? -1.0f : 0.0f, 1.0f) * max;
+				auto const rounded = static_cast<std::int32_t>(scaled < 0.0f ? scaled - 0.5f : scaled + 0.5f);
+				return static_cast<std::uint32_t>(rounded) & ((std::uint32_t{1} << width) - 1);
+			};
+			return packed_10_10_10_2{.bits = pack(x, 10) | (pack(y, 10) << 10) | (pack(z, 10) << 20) | (pack(w, 2) << 30)};
+		}
+	};
+
+	using unorm_10_10_10_2 = packed_10_10_10_2<false>;
+
+	// Vulkan doesn't require vertex buffer support for this format, so check vkGetPhysicalDeviceFormatProperties first.
+	using snorm_10_10_10_2 = packed_10_10_10_2<true>;
+
+	namespace detail {
+		template<class T>
+		struct attribute_traits {
+			using column = T;
+			static constexpr auto columns = std::size_t{1};
+		};
+
+		template<glm::length_t C, glm::length_t R, class T, glm::qualifier Q>
+		struct attribute_traits<glm::mat<C, R, T, Q>> {
+			using column = glm::vec<R, T, Q>;
+			static constexpr auto columns = static_cast<std::size_t>(C);
+		};
+
+		template<class T>
+		consteval std::array<VkFormat, 4> scalar_formats() noexcept
+		{
+			if constexpr (std::same_as<T, std::int8_t>) {
+				return {VK_FORMAT_R8_SINT, VK_FORMAT_R8G8_SINT, VK_FORMAT_R8G8B8_SINT, VK_FORMAT_R8G8B8A8_SINT};
+			}
+			else if constexpr (std::same_as<T, std::uint8_t>) {
+				return {VK_FORMAT_R8_UINT, VK_FORMAT_R8G8_UINT, VK_FORMAT_R8G8B8_UINT, VK_FORMAT_R8G8B8A8_UINT};
+			}
+			else if constexpr (std::same_as<T, std::int16_t>) {
+				return {VK_FORMAT_R16_SINT, VK_FORMAT_R16G16_SINT, VK_FORMAT_R16G16B16_SINT, VK_FORMAT_R16G16B16A16_SINT};
+			}
+			else if constexpr (std::same_as<T, std::uint16_t>) {
+				return {VK_FORMAT_R16_UINT, VK_FORMAT_R16G16_UINT, VK_FORMAT_R16G16B16_UINT, VK_FORMAT_R16G16B16A16_UINT};
+			}
+			else if constexpr (std::same_as<T, std::int32_t>) {
+				return {VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT};
+			}
+			else if constexpr (std::same_as<T, std::uint32_t>) {
+				return {VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT};
+			}
+			else if constexpr (std::same_as<T, std::int64_t>) {
+				return {VK_FORMAT_R64_SINT, VK_FORMAT_R64G64_SINT, VK_FORMAT_R64G64B64_SINT, VK_FORMAT_R64G64B64A64_SINT};
+			}
+			else if constexpr (std::same_as<T, std::uint64_t>) {
+				return {VK_FORMAT_R64_UINT, VK_FORMAT_R64G64_UINT, VK_FORMAT_R64G64B64_UINT, VK_FORMAT_R64G64B64A64_UINT};
+			}
+			else if constexpr (std::same_as<T, float>) {
+				return {
+				  VK_FORMAT_R32_SFLOAT,
+				  VK_FORMAT_R32G32_SFLOAT,
+				  VK_FORMAT_R32G32B32_SFLOAT,
+				  VK_FORMAT_R32G32B32A32_SFLOAT,
+				};
+			}
+			else if constexpr (std::same_as<T, double>) {
+				return {
+				  VK_FORMAT_R64_SFLOAT,
+				  VK_FORMAT_R64G64_SFLOAT,
+				  VK_FORMAT_R64G64B64_SFLOAT,
+				  VK_FORMAT_R64G64B64A64_SFLOAT,
+				};
+			}
+			else {
+				return {VK_FORMAT_UNDEFINED, VK_FORMAT_UNDEFINED, VK_FORMAT_UNDEFINED, VK_FORMAT_UNDEFINED};
+			}
+		}
+
+		template<class T>
+		consteval std::array<VkFormat, 4> normalised_formats() noexcept
+		{
+			if constexpr (std::same_as<T, std::int8_t>) {
+				return {VK_FORMAT_R8_SNORM, VK_FORMAT_R8G8_SNORM, VK_FORMAT_R8G8B8_SNORM, VK_FORMAT_R8G8B8A8_SNORM};
+			}
+			else if constexpr (std::same_as<T, std::uint8_t>) {
+				return {VK_FORMAT_R8_UNORM, VK_FORMAT_R8G8_UNORM, VK_FORMAT_R8G8B8_UNORM, VK_FORMAT_R8G8B8A8_UNORM};
+			}
+			else if constexpr (std::same_as<T, std::int16_t>) {
+				return {VK_FORMAT_R16_SNORM, VK_FORMAT_R16G16_SNORM, VK_FORMAT_R16G16B16_SNORM, VK_FORMAT_R16G16B16A16_SNORM};
+			}
+			else {
+				return {VK_FORMAT_R16_UNORM, VK_FORMAT_R16G16_UNORM, VK_FORMAT_R16G16B16_UNORM, VK_FORMAT_R16G16B16A16_UNORM};
+			}
+		}
+
+		template<class T>
+		struct format_traits {
+			static constexpr auto format = scalar_formats<T>()[0];
+			static constexpr auto component_size = sizeof(T);
+			static constexpr auto components = std::size_t{1};
+		};
+
+		template<glm::length_t L, class T, glm::qualifier Q>
+		struct format_traits<glm::vec<L, T, Q>> {
+			static constexpr auto format = scalar_formats<T>()[L - 1];
+			static constexpr auto component_size = sizeof(T);
+			static constexpr auto components = static_cast<std::size_t>(L);
+		};
+
+		template<std::size_t N>
+		struct format_traits<half_vec<N>> {
+			static constexpr auto format = std::array{
+			  VK_FORMAT_R16_SFLOAT,
+			  VK_FORMAT_R16G16_SFLOAT,
+			  VK_FORMAT_R16G16B16_SFLOAT,
+			  VK_FORMAT_R16G16B16A16_SFLOAT,
+			}[N - 1];
+			static constexpr auto component_size = sizeof(std::uint16_t);
+			static constexpr auto components = N;
+		};
+
+		template<class T, std::size_t N>
+		struct format_traits<normalised_vec<T, N>> {
+			static constexpr auto format = normalised_formats<T>()[N - 1];
+			static constexpr auto component_size = sizeof(T);
+			static constexpr auto components = N;
+		};
+
+		template<bool is_signed>
+		struct format_traits<packed_10_10_10_2<is_signed>> {
+			static constexpr auto format =
+			  is_signed ? VK_FORMAT_A2B10G10R10_SNORM_PACK32 : VK_FORMAT_A2B10G10R10_UNORM_PACK32;
+			static constexpr auto component_size = sizeof(std::uint32_t);
+			static constexpr auto components = std::size_t{1};
+		};
+
+		// Converts to any type, so that the number of members of an aggregate can be found by counting how many of
+		// these it can be initialised from.
+		struct any_member {
+			template<class T>
+			operator T&() const noexcept; // NOLINT(google-explicit-constructor)
+		};
+
+		template<class T, std::size_t N>
+		concept initialisable_from_n = []<std::size_t... I>(std::index_sequence<I...>) {
+			return requires { T{(static_cast<void>(I), any_member{})...}; };
+		}(std::make_index_sequence<N>{});
+
+		template<class T, std::size_t N = 0>
+		consteval std::size_t member_count() noexcept
+		{
+			if constexpr (initialisable_from_n<T, N + 1>) {
+				return member_count<T, N + 1>();
+			}
+			else {
+				return N;
+			}
+		}
+
+		template<class T>
+		constexpr auto member_types(T const& value) noexcept
+		{
+			constexpr auto count = member_count<T>();
+			static_assert(count > 0, "a vertex needs at least one attribute");
+			static_assert(count <= 12, "vertices with more than 12 members aren't supported");
+			if constexpr (count == 1) {
+				auto const& [m0] = value;
+				return std::type_identity<std::tuple<std::remove_cvref_t<decltype(m0)>>>{};
+			}
+			else if constexpr (count == 2) {
+				auto const& [m0, m1] = value;
+				return std::type_identity<std::tuple<std::remove_cvref_t<decltype(m0)>, std::remove_cvref_t<decltype(m1)>>>{};
+			}
+			else if constexpr (count == 3) {
+				auto const& [m0, m1, m2] = value;
+				return std::type_identity<std::tuple<
+					std::remove_cvref_t<decltype(m0)>,
+					std::remove_cvref_t<decltype(m1)>,
+					std::remove_cvref_t<decltype(m2)>>>{};
+			}
+			else if constexpr (count == 4) {
+				auto const& [m0, m1, m2, m3] = value;
+				return std::type_identity<std::tuple<
+					std::remove_cvref_t<decltype(m0)>,
+					std::remove_cvref_t<decltype(m1)>,
+					std::remove_cvref_t<decltype(m2)>,
+					std::remove_cvref_t<decltype(m3)>>>{};
+			}
+			else if constexpr (count == 5) {
+				auto const& [m0, m1, m2, m3, m4] = value;
+				return std::type_identity<std::tuple<
+					std::remove_cvref_t<decltype(m0)>,
+					std::remove_cvref_t<decltype(m1)>,
+					std::remove_cvref_t<decltype(m2)>,
+					std::remove_cvref_t<decltype(m3)>,
+					std::remove_cvref_t<decltype(m4)>>>{};
+			}
+			else if constexpr (count == 6) {
+				auto const& [m0, m1, m2, m3, m4, m5] = value;
+				return std::type_identity<std::tuple<
+					std::remove_cvref_t<decltype(m0)>,
+					std::remove_cvref_t<decltype(m1)>,
+					std::remove_cvref_t<decltype(m2)>,
+					std::remove_cvref_t<decltype(m3)>,
+					std::remove_cvref_t<decltype(m4)>,
+					std::remove_cvref_t<decltype(m5)>>>{};
+			}
+			else if constexpr (count == 7) {
+				auto const& [m0, m1, m2, m3, m4, m5, m6] = value;
+				return std::type_identity<std::tuple<
+					std::remove_cvref_t<decltype(m0)>,
+					std::remove_cvref_t<decltype(m1)>,
+					std::remove_cvref_t<decltype(m2)>,
+					std::remove_cvref_t<decltype(m3)>,
+					std::remove_cvref_t<decltype(m4)>,
+					std::remove_cvref_t<decltype(m5)>,
+					std::remove_cvref_t<decltype(m6)>>>{};
+			}
+			else if constexpr (count == 8) {
+				auto const& [m0, m1, m2, m3, m4, m5, m6, m7] = value;
+				return std::type_identity<std::tuple<
+					std::remove_cvref_t<decltype(m0)>,
+					std::remove_cvref_t<decltype(m1)>,
+					std::remove_cvref_t<decltype(m2)>,
+					std::remove_cvref_t<decltype(m3)>,
+					std::remove_cvref_t<decltype(m4)>,
+					std::remove_cvref_t<decltype(m5)>,
+					std::remove_cvref_t<decltype(m6)>,
+					std::remove_cvref_t<decltype(m7)>>>{};
+			}
+			else if constexpr (count == 9) {
+				auto const& [m0, m1, m2, m3, m4, m5, m6, m7, m8] = value;
+				return std::type_identity<std::tuple<
+					std::remove_cvref_t<decltype(m0)>,
+					std::remove_cvref_t<decltype(m1)>,
+					std::remove_cvref_t<decltype(m2)>,
+					std::remove_cvref_t<decltype(m3)>,
+					std::remove_cvref_t<decltype(m4)>,
+					std::remove_cvref_t<decltype(m5)>,
+					std::remove_cvref_t<decltype(m6)>,
+					std::remove_cvref_t<decltype(m7)>,
+					std::remove_cvref_t<decltype(m8)>>>{};
+			}
+			else if constexpr (count == 10) {
+				auto const& [m0, m1, m2, m3, m4, m5, m6, m7, m8, m9] = value;
+				return std::type_identity<std::tuple<
+					std::remove_cvref_t<decltype(m0)>,
+					std::remove_cvref_t<decltype(m1)>,
+					std::remove_cvref_t<decltype(m2)>,
+					std::remove_cvref_t<decltype(m3)>,
+					std::remove_cvref_t<decltype(m4)>,
+					std::remove_cvref_t<decltype(m5)>,
+					std::remove_cvref_t<decltype(m6)>,
+					std::remove_cvref_t<decltype(m7)>,
+					std::remove_cvref_t<decltype(m8)>,
+					std::remove_cvref_t<decltype(m9)>>>{};
+			}
+			else if constexpr (count == 11) {
+				auto const& [m0, m1, m2, m3, m4, m5, m6, m7, m8, m9, m10] = value;
+				return std::type_identity<std::tuple<
+					std::remove_cvref_t<decltype(m0)>,
+					std::remove_cvref_t<decltype(m1)>,
+					std::remove_cvref_t<decltype(m2)>,
+					std::remove_cvref_t<decltype(m3)>,
+					std::remove_cvref_t<decltype(m4)>,
+					std::remove_cvref_t<decltype(m5)>,
+					std::remove_cvref_t<decltype(m6)>,
+					std::remove_cvref_t<decltype(m7)>,
+					std::remove_cvref_t<decltype(m8)>,
+					std::remove_cvref_t<decltype(m9)>,
+					std::remove_cvref_t<decltype(m10)>>>{};
+			}
+			else if constexpr (count == 12) {
+				auto const& [m0, m1, m2, m3, m4, m5, m6, m7, m8, m9, m10, m11] = value;
+				return std::type_identity<std::tuple<
+					std::remove_cvref_t<decltype(m0)>,
+					std::remove_cvref_t<decltype(m1)>,
+					std::remove_cvref_t<decltype(m2)>,
+					std::remove_cvref_t<decltype(m3)>,
+					std::remove_cvref_t<decltype(m4)>,
+					std::remove_cvref_t<decltype(m5)>,
+					std::remove_cvref_t<decltype(m6)>,
+					std::remove_cvref_t<decltype(m7)>,
+					std::remove_cvref_t<decltype(m8)>,
+					std::remove_cvref_t<decltype(m9)>,
+					std::remove_cvref_t<decltype(m10)>,
+					std::remove_cvref_t<decltype(m11)>>>{};
+			}
+		}
+	} // namespace detail
+
+	// A member of a vertex that can be described by a VkFormat.
+	template<class T>
+	concept vertex_attribute = detail::format_traits<typename detail::attribute_traits<T>::column>::format
+	                        != VK_FORMAT_UNDEFINED;
+
+	template<vertex_attribute T>
+	inline constexpr VkFormat vertex_format = detail::format_traits<T>::format;
+
+	// 64-bit vectors with three or four components take up two locations, as do each of a 64-bit matrix's columns.
+	template<vertex_attribute T>
+	inline constexpr std::uint32_t vertex_locations = [] {
+		using traits = detail::format_traits<typename detail::attribute_traits<T>::column>;
+		auto const per_column = traits::component_size == 8 and traits::components > 2 ? 2u : 1u;
+		return per_column * static_cast<std::uint32_t>(detail::attribute_traits<T>::columns);
+	}();
+
+	template<class Vertex>
+	using vertex_members = typename decltype(detail::member_types(std::declval<Vertex const&>()))::type;
+
+	// An aggregate whose members are all vertex attributes. Offsets are derived from each member's alignment, so padding
+	// between members, and at the end, is fine.
+	template<class Vertex>
+	concept vertex = std::is_aggregate_v<Vertex> and std::is_standard_layout_v<Vertex>
+	             and []<class... Members>(std::type_identity<std::tuple<Members...>>) {
+		               return (vertex_attribute<Members> and ...);
+	             }(std::type_identity<vertex_members<Vertex>>{});
+
+	template<vertex Vertex>
+	[[nodiscard]] constexpr VkVertexInputBindingDescription vertex_binding(
+	  std::uint32_t const binding = 0,
+	  VkVertexInputRate const rate = VK_VERTEX_INPUT_RATE_VERTEX) noexcept
+	{
+		return VkVertexInputBindingDescription{
+		  .binding = binding,
+		  .stride = static_cast<std::uint32_t>(sizeof(Vertex)),
+		  .inputRate = rate,
+		};
+	}
+
+	namespace detail {
+		template<class... Members>
+		constexpr auto attribute_layout(
+		  std::type_identity<std::tuple<Members...>>,
+		  std::uint32_t const binding,
+		  std::uint32_t location) noexcept
+		{
+			constexpr auto size = (attribute_traits<Members>::columns + ...);
+			auto attributes = std::array<VkVertexInputAttributeDescription, size>{};
+			auto offset = std::size_t{0};
+			auto next = attributes.begin();
+			auto const append = [&]<class Member>(std::type_identity<Member>) {
+				using column = typename attribute_traits<Member>::column;
+				offset = (offset + alignof(Member) - 1) / alignof(Member) * alignof(Member);
+				for (auto i = std::size_t{0}; i < attribute_traits<Member>::columns; ++i) {
+					*next++ = VkVertexInputAttributeDescription{
+					  .location = location,
+					  .binding = binding,
+					  .format = vertex_format<column>,
+					  .offset = static_cast<std::uint32_t>(offset + i * sizeof(column)),
+					};
+					location += vertex_locations<column>;
+				}
+				offset += sizeof(Member);
+			};
+			(append(std::type_identity<Members>{}), ...);
+			return std::pair(attributes, offset);
+		}
+	} // namespace detail
+
+	// Gives each member of Vertex consecutive locations, starting at first_location, in declaration order. Matrices
+	// are split into one attribute per column. Pass a later first_location for per-instance bindings, so that they
+	// follow the per-vertex attributes.
+	template<vertex Vertex>
+	[[nodiscard]] constexpr auto
+	vertex_attributes(std::uint32_t const binding = 0, std::uint32_t const first_location = 0) noexcept
+	{
+		constexpr auto members = std::type_identity<vertex_members<Vertex>>{};
+		constexpr auto end = detail::attribute_layout(members, 0, 0).second;
+		static_assert(
+		  (end + alignof(Vertex) - 1) / alignof(Vertex) * alignof(Vertex) == sizeof(Vertex),
+		  "Vertex's layout doesn't follow its members' natural alignment (is a member over-aligned?)");
+		return detail::attribute_layout(members, binding, first_location).first;
+	}
+} // namespace vulkan
+
+#endif // BUGGY_VERTEX_LAYOUT_HPP
@@ -1,13 +1,26 @@
 #ifndef BUGGY_VULKAN_ERROR_HPP
 #define BUGGY_VULKAN_ERROR_HPP
 
+#include "job_system.hpp"
 #include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <concepts>
+#include <cstddef>
 #include <cstdint>
+#include <deque>
 #include <expected>
+#include <filesystem>
+#include <limits>
 #include <memory>
 #include <numeric>
 #include <optional>
 #include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
 #include <vector>
 #include <vulkan/vulkan.h>
 
@@ -51,10 +64,17 @@ namespace vulkan {
 		not_permitted = VK_ERROR_NOT_PERMITTED_KHR,
 		lost_fullscreen_exclusivity = VK_ERROR_FULL_SCREEN_EXCLUSIVE_MODE_LOST_EXT,
 
+		// Vulkan statuses that succeed, but still need the caller to act
+		suboptimal = VK_SUBOPTIMAL_KHR,
+
 		// API errors
 		no_suitable_devices = 1,
 		file_not_found,
 		timeout,
+		io_failure,
+		invalid_spirv,
+		push_constants_too_large,
+		bindless_capacity_too_large,
 	};
 
 	template<class T>
@@ -104,20 +124,43 @@ namespace vulkan {
 		VkPhysicalDeviceFeatures features;
 		VkPhysicalDeviceMemoryProperties memory_properties;
 		std::vector<VkExtensionProperties> extensions;
+		bool timeline_semaphore;
+
+		// Enough of descriptor indexing to use bindless_textures: partially bound, update-after-bind arrays of sampled
+		// images that are indexed non-uniformly.
+		bool descriptor_indexing;
+
+		// The most combined image samplers that one update-after-bind set can hold, for every stage that it's visible
+		// to: the smallest of the update-after-bind sampled image, sampler and per-stage resource limits. Zero without
+		// descriptor_indexing.
+		std::uint32_t max_bindless_textures;
+
+		// Needed by draw_indirect_count and draw_indexed_indirect_count.
+		bool draw_indirect_count;
+
+		// Vulkan 1.3's dynamic rendering, which command_buffer::record can use in place of a render_pass and
+		// framebuffer.
+		bool dynamic_rendering;
 	};
 
 	class instance {
 	public:
+		// Windowed instances enable the extensions that the window system needs to present, so window::context must be
+		// created first. Headless instances can only render offscreen, and don't need a window system at all.
+		enum class presentation : std::int8_t { windowed, headless };
+
 		[[nodiscard]] static error_or<instance> create(
 		  VkApplicationInfo app_info,
 		  std::span<char const* const> layers,
-		  std::span<char const* const> extensions) noexcept;
+		  std::span<char const* const> extensions,
+		  presentation mode = presentation::windowed) noexcept;
 
 		[[nodiscard]] static error_or<instance> create(
 		  VkApplicationInfo app_info,
 		  VkAllocationCallbacks const* allocator,
 		  std::span<char const* const> layers,
-		  std::span<char const* const> extensions) noexcept;
+		  std::span<char const* const> extensions,
+		  presentation mode = presentation::windowed) noexcept;
 
 		[[nodiscard]] std::span<physical_device const> physical_devices() const noexcept;
 
@@ -129,8 +172,8 @@ namespace vulkan {
 		std::unique_ptr<VkInstance_T, deleter<PFN_vkDestroyInstance>> instance_;
 		std::vector<physical_device> physical_devices_;
 
-		instance(VkInstance instance, VkAllocationCallbacks const* allocator) noexcept;
-		static std::vector<physical_device> retrieve_devices(VkInstance instance) noexcept;
+		instance(VkInstance instance, std::uint32_t api_version, VkAllocationCallbacks const* allocator) noexcept;
+		static std::vector<physical_device> retrieve_devices(VkInstance instance, std::uint32_t api_version) noexcept;
 	};
 
 	class debug_utils {
@@ -187,6 +230,21 @@ namespace vulkan {
 	class semaphore;
 	class swapchain;
 
+	enum class queue_kind : std::uint8_t { graphics, compute, transfer };
+
+	// A point on a timeline semaphore. value is ignored for binary semaphores, so the two kinds can be mixed in a
+	// single submission.
+	struct semaphore_value {
+		VkSemaphore semaphore;
+		std::uint64_t value = 0;
+	};
+
+	struct semaphore_wait {
+		VkSemaphore semaphore;
+		std::uint64_t value = 0;
+		VkPipelineStageFlags stages = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+	};
+
 	class device {
 	public:
 		using selector_fn = bool (*)(physical_device const&) noexcept;
@@ -198,6 +256,14 @@ namespace vulkan {
 		  std::span<char const* const> extensions = {},
 		  VkAllocationCallbacks const* allocator = nullptr) noexcept;
 
+		// Creates a device without a surface, for offscreen rendering and compute. Any family with graphics
+		// support is used as the graphics queue, and nothing can be presented.
+		[[nodiscard]] static error_or<device> create(
+		  instance const& instance,
+		  selector_fn selector,
+		  std::span<char const* const> extensions = {},
+		  VkAllocationCallbacks const* allocator = nullptr) noexcept;
+
 		[[nodiscard]] VkDevice get() const noexcept
 		{
 			return device_.get();
@@ -208,6 +274,18 @@ namespace vulkan {
 			return *physical_device_;
 		}
 
+		// Compute and transfer fall back to the graphics family (or, for transfer, the compute family)
+		// when the physical device doesn't expose a dedicated one.
+		[[nodiscard]] std::uint32_t queue_family(queue_kind const kind) const noexcept
+		{
+			return queues_[static_cast<std::size_t>(kind)].family;
+		}
+
+		[[nodiscard]] VkQueue queue(queue_kind const kind) const noexcept
+		{
+			return queues_[static_cast<std::size_t>(kind)].queue;
+		}
+
 		[[nodiscard]] error_or<void> wait_one(
 		  std::span<VkFence const> fences,
 		  std::uint64_t timeout = std::numeric_limits<std::uint64_t>::max()) noexcept;
@@ -216,12 +294,28 @@ namespace vulkan {
 		  std::uint64_t timeout = std::numeric_limits<std::uint64_t>::max()) noexcept;
 		[[nodiscard]] error_or<void> reset(std::span<VkFence const> fences) noexcept;
 
+		// Host-side waits on timeline semaphores. These require physical_device().timeline_semaphore.
+		[[nodiscard]] error_or<void> wait_one(
+		  std::span<semaphore_value const> values,
+		  std::uint64_t timeout = std::numeric_limits<std::uint64_t>::max()) const noexcept;
+		[[nodiscard]] error_or<void> wait_all(
+		  std::span<semaphore_value const> values,
+		  std::uint64_t timeout = std::numeric_limits<std::uint64_t>::max()) const noexcept;
+
 		[[nodiscard]] error_or<void> submit(
 		  std::span<VkCommandBuffer> commands,
 		  std::span<VkSemaphore> wait,
 		  std::span<VkPipelineStageFlags const> wait_stages,
 		  std::span<VkSemaphore> signals,
-		  fence& f) noexcept;
+		  fence& f,
+		  queue_kind queue = queue_kind::graphics) noexcept;
+
+		// Submits without a fence: completion is observed through the timeline values in signals.
+		[[nodiscard]] error_or<void> submit(
+		  std::span<VkCommandBuffer const> commands,
+		  std::span<semaphore_wait const> waits,
+		  std::span<semaphore_value const> signals,
+		  queue_kind queue = queue_kind::graphics) noexcept;
 
 		[[nodiscard]] error_or<void> wait() const noexcept
 		{
@@ -238,13 +332,71 @@ namespace vulkan {
 		  std::span<VkSwapchainKHR const> swapchains,
 		  std::span<VkSemaphore const> signals) noexcept;
 	private:
+		struct queue_info {
+			VkQueue queue;
+			std::uint32_t family;
+		};
+
 		std::unique_ptr<VkDevice_T, deleter<PFN_vkDestroyDevice>> device_;
-		VkQueue queue_;
+		std::array<queue_info, 3> queues_;
 		struct physical_device const* physical_device_;
 
-		explicit device(VkDevice, VkQueue, VkAllocationCallbacks const*, struct physical_device const&) noexcept;
+		[[nodiscard]] static error_or<device> create(
+		  instance const& instance,
+		  VkSurfaceKHR surface,
+		  selector_fn selector,
+		  std::span<char const* const> extensions,
+		  VkAllocationCallbacks const* allocator) noexcept;
+
+		explicit device(
+		  VkDevice,
+		  std::array<queue_info, 3>,
+		  VkAllocationCallbacks const*,
+		  struct physical_device const&) noexcept;
 	};
 
+	void release_ownership(
+	  VkCommandBuffer command,
+	  device const& d,
+	  VkBuffer buffer,
+	  queue_kind from,
+	  queue_kind to,
+	  VkPipelineStageFlags src_stage,
+	  VkAccessFlags src_access) noexcept;
+
+	void acquire_ownership(
+	  VkCommandBuffer command,
+	  device const& d,
+	  VkBuffer buffer,
+	  queue_kind from,
+	  queue_kind to,
+	  VkPipelineStageFlags dst_stage,
+	  VkAccessFlags dst_access) noexcept;
+
+	void release_ownership(
+	  VkCommandBuffer command,
+	  device const& d,
+	  VkImage image,
+	  VkImageSubresourceRange const& range,
+	  VkImageLayout old_layout,
+	  VkImageLayout new_layout,
+	  queue_kind from,
+	  queue_kind to,
+	  VkPipelineStageFlags src_stage,
+	  VkAccessFlags src_access) noexcept;
+
+	void acquire_ownership(
+	  VkCommandBuffer command,
+	  device const& d,
+	  VkImage image,
+	  VkImageSubresourceRange const& range,
+	  VkImageLayout old_layout,
+	  VkImageLayout new_layout,
+	  queue_kind from,
+	  queue_kind to,
+	  VkPipelineStageFlags dst_stage,
+	  VkAccessFlags dst_access) noexcept;
+
 	class image_view {
 	public:
 		[[nodiscard]] static error_or<image_view> create(
@@ -262,11 +414,38 @@ namespace vulkan {
 
 	class semaphore;
 
+	enum class present_policy : std::uint8_t {
+		// Prefers MAILBOX so the newest frame is always shown without tearing.
+		low_latency,
+		// Prefers IMMEDIATE so presentation never blocks rendering. May tear.
+		max_throughput,
+		// Uses FIFO with the fewest images the surface allows.
+		power_save,
+	};
+
+	// present_mode and image_count override the policy's choices. An unsupported present_mode falls back to the
+	// policy, and image_count is clamped to what the surface supports.
+	struct present_options {
+		present_policy policy = present_policy::low_latency;
+		std::optional<VkPresentModeKHR> present_mode = std::nullopt;
+		std::optional<std::uint32_t> image_count = std::nullopt;
+	};
+
 	class swapchain {
 	public:
+		// Fails with error::out_of_date while the window has no area to present to (e.g. it's minimised).
+		[[nodiscard]] static error_or<swapchain> create(
+		  device const& d,
+		  window::window const& w,
+		  present_options const& options = {},
+		  VkAllocationCallbacks const* allocator = nullptr) noexcept;
+
+		// Creates a replacement for old with the same present_options, which lets the implementation reuse its
+		// resources. old is retired by this call and should be destroyed once its images are no longer in use.
 		[[nodiscard]] static error_or<swapchain> create(
 		  device const& d,
 		  window::window const& w,
+		  swapchain const& old,
 		  VkAllocationCallbacks const* allocator = nullptr) noexcept;
 
 		[[nodiscard]] VkSwapchainKHR get() const noexcept
@@ -276,9 +455,23 @@ namespace vulkan {
 
 		[[nodiscard]] VkFormat format() const noexcept;
 		[[nodiscard]] VkExtent2D extent() const noexcept;
+		[[nodiscard]] VkPresentModeKHR present_mode() const noexcept;
+		[[nodiscard]] present_options const& options() const noexcept;
 		[[nodiscard]] std::uint32_t size() const noexcept;
 		[[nodiscard]] std::span<image_view const> image_views() const;
 
+		[[nodiscard]] std::span<VkImage const> images() const noexcept
+		{
+			return images_;
+		}
+
+		// True once an acquire has reported VK_SUBOPTIMAL_KHR. The acquired image is still usable, but the
+		// swapchain should be recreated after it's been presented.
+		[[nodiscard]] bool suboptimal() const noexcept
+		{
+			return suboptimal_;
+		}
+
 		[[nodiscard]] error_or<std::uint32_t> acquire_next_image(
 		  semaphore& sema,
 		  std::uint64_t timeout = std::numeric_limits<std::uint64_t>::max()) noexcept;
@@ -287,10 +480,27 @@ namespace vulkan {
 		std::vector<VkImage> images_;
 		VkFormat format_;
 		VkExtent2D extent_;
+		VkPresentModeKHR present_mode_;
+		present_options options_;
 		std::vector<image_view> image_views_;
 		VkDevice device_;
+		bool suboptimal_ = false;
 
-		explicit swapchain(VkSwapchainKHR, device const&, VkAllocationCallbacks const*, VkFormat format, VkExtent2D extent) noexcept;
+		[[nodiscard]] static error_or<swapchain> create(
+		  device const& d,
+		  window::window const& w,
+		  VkSwapchainKHR old,
+		  present_options const& options,
+		  VkAllocationCallbacks const* allocator) noexcept;
+
+		explicit swapchain(
+		  VkSwapchainKHR,
+		  device const&,
+		  VkAllocationCallbacks const*,
+		  VkFormat format,
+		  VkExtent2D extent,
+		  VkPresentModeKHR present_mode,
+		  present_options const& options) noexcept;
 	};
 
 	[[nodiscard]] error_or<void> present(
@@ -299,7 +509,94 @@ namespace vulkan {
 	  std::span<VkSwapchainKHR const> swapchains,
 	  std::span<VkSemaphore const> signals) noexcept;
 
-	template<VkShaderStageFlagBits>
+	// Checks that code is large enough to hold a SPIR-V header and starts with the SPIR-V magic number in host
+	// byte order.
+	[[nodiscard]] error_or<void> validate_spirv(std::span<std::uint32_t const> code) noexcept;
+
+	// A read-only view of a SPIR-V binary on disk. The file is memory-mapped where the platform supports it, so
+	// the bytecode is never copied, and mappings are always suitably aligned for std::uint32_t.
+	class spirv_file {
+	public:
+		[[nodiscard]] static error_or<spirv_file> open(std::filesystem::path const& path) noexcept;
+
+		[[nodiscard]] std::span<std::uint32_t const> code() const noexcept
+		{
+			return {code_.get(), code_.get_deleter().words};
+		}
+	private:
+		struct release {
+			std::size_t words;
+
+			void operator()(std::uint32_t const* code) const noexcept;
+		};
+
+		std::unique_ptr<std::uint32_t const, release> code_;
+
+		explicit spirv_file(std::unique_ptr<std::uint32_t const, release> code) noexcept;
+	};
+
+	// SPIR-V that was compiled into the binary by the shader_bundle CMake function, so it can be loaded without
+	// touching the filesystem.
+	struct shader_bundle_entry {
+		std::string_view name;
+		std::span<std::uint32_t const> code;
+	};
+
+	using shader_bundle = std::span<shader_bundle_entry const>;
+
+	template<class T>
+	concept specialisation_constant =
+	  std::is_arithmetic_v<T> and not std::same_as<T, bool> and (sizeof(T) == 4 or sizeof(T) == 8);
+
+	// Values for a shader's `layout(constant_id = N)` declarations, read out of a struct. The Nth member pointer
+	// passed to the constructor supplies constant_id N, counting from zero.
+	class specialisation_constants {
+	public:
+		specialisation_constants() = default;
+
+		template<class T, specialisation_constant... Members>
+		explicit specialisation_constants(T const& values, Members T::*... members) noexcept
+		{
+			entries_.reserve(sizeof...(members));
+			data_.reserve((sizeof(Members) + ... + 0));
+			(add(values.*members), ...);
+		}
+
+		[[nodiscard]] bool empty() const noexcept
+		{
+			return entries_.empty();
+		}
+
+		// The result points into *this, so it's only valid while *this is alive and unmodified.
+		[[nodiscard]] VkSpecializationInfo info() const noexcept;
+
+		[[nodiscard]] std::size_t hash() const noexcept;
+
+		friend bool operator==(specialisation_constants const&, specialisation_constants const&) noexcept;
+	private:
+		std::vector<VkSpecializationMapEntry> entries_;
+		std::vector<std::byte> data_;
+
+		template<specialisation_constant T>
+		void add(T const value) noexcept
+		{
+			entries_.push_back(VkSpecializationMapEntry{
+			  .constantID = static_cast<std::uint32_t>(entries_.size()),
+			  .offset = static_cast<std::uint32_t>(data_.size()),
+			  .size = sizeof(T),
+			});
+
+			auto const bytes = std::bit_cast<std::array<std::byte, sizeof(T)>>(value);
+			data_.insert(data_.end(), bytes.begin(), bytes.end());
+		}
+	};
+
+	struct shader_stage {
+		VkShaderStageFlagBits stage;
+		VkShaderModule module;
+	};
+
+	template<VkShaderStageFlagBits kind>
 	class shader_module {
 	public:
 		[[nodiscard]] static error_or<shader_module> create(
@@ -307,8 +604,34 @@ namespace vulkan {
 		  device const& d,
 		  VkAllocationCallbacks const* allocator = nullptr) noexcept;
 
+		[[nodiscard]] static error_or<shader_module> create(
+		  std::span<std::uint32_t const> code,
+		  device const& d,
+		  VkAllocationCallbacks const* allocator = nullptr) noexcept;
+
+		// Fails with error::file_not_found if bundle doesn't contain name.
+		[[nodiscard]] static error_or<shader_module> create(
+		  shader_bundle bundle,
+		  std::string_view name,
+		  device const& d,
+		  VkAllocationCallbacks const* allocator = nullptr) noexcept;
+
+		// Loads every file in paths using workers. The result is in the same order as paths, and the first
+		// failure (in path order) is reported if any module can't be loaded.
+		[[nodiscard]] static error_or<std::vector<shader_module>> create(
+		  std::span<std::filesystem::path const> paths,
+		  device const& d,
+		  jobs::thread_pool& workers,
+		  VkAllocationCallbacks const* allocator = nullptr) noexcept;
+
 		[[nodiscard]] VkPipelineShaderStageCreateInfo pipeline_create_info(
-		  std::string_view entry_point_name = "main") const noexcept;
+		  std::string_view entry_point_name = "main",
+		  VkSpecializationInfo const* specialisation = nullptr) const noexcept;
+
+		[[nodiscard]] shader_stage stage() const noexcept
+		{
+			return shader_stage{.stage = kind, .module = module_.get()};
+		}
 	private:
 		using handler = std::unique_ptr<VkShaderModule_T, deleter<PFN_vkDestroyShaderModule, VkDevice>>;
 		handler module_;
@@ -341,6 +664,13 @@ namespace vulkan {
 		  swapchain const& s,
 		  VkAllocationCallbacks const* allocator = nullptr) noexcept;
 
+		// A single colour attachment of the given format, which is left in final_layout at the end of the pass.
+		[[nodiscard]] static error_or<render_pass> create(
+		  device const& d,
+		  VkFormat format,
+		  VkImageLayout final_layout,
+		  VkAllocationCallbacks const* allocator = nullptr) noexcept;
+
 		[[nodiscard]] VkRenderPass get() const noexcept
 		{
 			return render_pass_.get();
@@ -351,12 +681,211 @@ namespace vulkan {
 		render_pass(VkRenderPass, VkDevice, VkAllocationCallbacks const*) noexcept;
 	};
 
+	class descriptor_set_layout {
+	public:
+		[[nodiscard]] static error_or<descriptor_set_layout> create(
+		  device const& d,
+		  std::span<VkDescriptorSetLayoutBinding const> bindings,
+		  VkAllocationCallbacks const* allocator = nullptr) noexcept;
+
+		// binding_flags is either empty, or has one element per binding.
+		[[nodiscard]] static error_or<descriptor_set_layout> create(
+		  device const& d,
+		  std::span<VkDescriptorSetLayoutBinding const> bindings,
+		  std::span<VkDescriptorBindingFlags const> binding_flags,
+		  VkDescriptorSetLayoutCreateFlags flags,
+		  VkAllocationCallbacks const* allocator = nullptr) noexcept;
+
+		[[nodiscard]] VkDescriptorSetLayout get() const noexcept
+		{
+			return layout_.get();
+		}
+	private:
+		std::unique_ptr<VkDescriptorSetLayout_T, deleter<PFN_vkDestroyDescriptorSetLayout, VkDevice>> layout_;
+
+		descriptor_set_layout(VkDescriptorSetLayout, VkDevice, VkAllocationCallbacks const*) noexcept;
+	};
+
+	class descriptor_pool {
+	public:
+		[[nodiscard]] static error_or<descriptor_pool> create(
+		  device const& d,
+		  std::uint32_t max_sets,
+		  std::span<VkDescriptorPoolSize const> sizes,
+		  VkDescriptorPoolCreateFlags flags = {},
+		  VkAllocationCallbacks const* allocator = nullptr) noexcept;
+
+		[[nodiscard]] VkDescriptorPool get() const noexcept
+		{
+			return pool_.get();
+		}
+
+		// Fails with error::no_pool_memory or error::fragmented_pool when the pool can't fit the set.
+		[[nodiscard]] error_or<VkDescriptorSet> allocate(descriptor_set_layout const& layout) const noexcept;
+
+		// Returns every set allocated from the pool in one call. None of them may be in use by the device.
+		void reset() const noexcept;
+	private:
+		std::unique_ptr<VkDescriptorPool_T, deleter<PFN_vkDestroyDescriptorPool, VkDevice>> pool_;
+		VkDevice device_;
+
+		descriptor_pool(VkDescriptorPool, VkDevice, VkAllocationCallbacks const*) noexcept;
+	};
+
+	void write_descriptor(
+	  device const& d,
+	  VkDescriptorSet set,
+	  std::uint32_t binding,
+	  VkDescriptorType type,
+	  VkDescriptorBufferInfo const& buffer,
+	  std::uint32_t array_element = 0) noexcept;
+
+	void write_descriptor(
+	  device const& d,
+	  VkDescriptorSet set,
+	  std::uint32_t binding,
+	  VkDescriptorType type,
+	  VkDescriptorImageInfo const& image,
+	  std::uint32_t array_element = 0) noexcept;
+
+	// Descriptor sets that only live for a single frame. Each frame in flight has its own pools, which are reset in bulk
+	// when the frame begins, so sets are never freed individually. A frame that outgrows its pools gets another one,
+	// which it keeps for later frames. The device must outlive the allocator.
+	class frame_descriptor_allocator {
+	public:
+		[[nodiscard]] static error_or<frame_descriptor_allocator> create(
+		  device const& d,
+		  std::uint32_t frames_in_flight,
+		  std::uint32_t sets_per_pool,
+		  std::span<VkDescriptorPoolSize const> sizes_per_pool,
+		  VkAllocationCallbacks const* allocator = nullptr) noexcept;
+
+		// Must only be called once the device has finished with the sets that frame allocated last time.
+		void begin_frame(std::uint32_t frame) noexcept;
+
+		[[nodiscard]] error_or<VkDescriptorSet> allocate(descriptor_set_layout const& layout) noexcept;
+	private:
+		struct frame_pools {
+			std::vector<descriptor_pool> pools;
+			std::size_t current = 0;
+		};
+
+		device const* device_;
+		VkAllocationCallbacks const* allocator_;
+		std::uint32_t sets_per_pool_;
+		std::vector<VkDescriptorPoolSize> sizes_per_pool_;
+		std::vector<frame_pools> frames_;
+		std::uint32_t frame_ = 0;
+
+		frame_descriptor_allocator(
+		  device const& d,
+		  VkAllocationCallbacks const* allocator,
+		  std::uint32_t sets_per_pool,
+		  std::vector<VkDescriptorPoolSize> sizes_per_pool,
+		  std::vector<frame_pools> frames) noexcept;
+	};
+
+	// One descriptor set holding a large array of combined image samplers, so that draws select textures by index
+	// instead of binding a set each. The set is bound once per frame, and slots can be written while it's bound. Shaders
+	// declare `layout(set = N, binding = 0) uniform sampler2D textures[];` and index it with nonuniformEXT.
+	// Requires physical_device::descriptor_indexing.
+	class bindless_textures {
+	public:
+		static constexpr auto binding = std::uint32_t{0};
+
+		// Fails with error::bindless_capacity_too_large if capacity exceeds physical_device::max_bindless_textures, which
+		// covers the update-after-bind limits on both sampled images and samplers.
+		[[nodiscard]] static error_or<bindless_textures> create(
+		  device const& d,
+		  std::uint32_t capacity,
+		  VkShaderStageFlags stages = VK_SHADER_STAGE_ALL,
+		  VkAllocationCallbacks const* allocator = nullptr) noexcept;
+
+		// Returns the array index that shaders use to read the texture. Fails with error::too_many_objects when every
+		// slot is in use.
+		[[nodiscard]] error_or<std::uint32_t> add(
+		  VkImageView view,
+		  VkSampler sampler,
+		  VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) noexcept;
+
+		// The slot may be handed out again by add, so it must only be removed once no frame in flight reads it.
+		void remove(std::uint32_t index) noexcept;
+
+		[[nodiscard]] descriptor_set_layout const& layout() const noexcept
+		{
+			return layout_;
+		}
+
+		[[nodiscard]] VkDescriptorSet set() const noexcept
+		{
+			return set_;
+		}
+
+		[[nodiscard]] std::uint32_t capacity() const noexcept
+		{
+			return capacity_;
+		}
+	private:
+		descriptor_set_layout layout_;
+		descriptor_pool pool_;
+		VkDescriptorSet set_;
+		device const* device_;
+		std::uint32_t capacity_;
+		std::uint32_t next_ = 0;
+		std::vector<std::uint32_t> free_;
+
+		bindless_textures(
+		  descriptor_set_layout layout,
+		  descriptor_pool pool,
+		  VkDescriptorSet set,
+		  device const& d,
+		  std::uint32_t capacity) noexcept;
+	};
+
+	// Push constants are copied byte-for-byte into the shader's `layout(push_constant)` block, so T's members need to be
+	// at the same offsets as the block's. Sticking to naturally aligned types, such as glm::mat4 and glm::vec4, keeps
+	// the two in agreement.
+	template<class T>
+	concept push_constant_data =
+	  std::is_standard_layout_v<T> and std::is_trivially_copyable_v<T> and sizeof(T) % 4 == 0;
+
+	template<push_constant_data T>
+	[[nodiscard]] constexpr VkPushConstantRange push_constant_range(
+	  VkShaderStageFlags const stages,
+	  std::uint32_t const offset = 0) noexcept
+	{
+		return VkPushConstantRange{
+		  .stageFlags = stages,
+		  .offset = offset,
+		  .size = static_cast<std::uint32_t>(sizeof(T)),
+		};
+	}
+
 	class pipeline_layout {
 	public:
 		[[nodiscard]] static error_or<pipeline_layout> create(
 		  device const& d,
 		  VkAllocationCallbacks const* allocator = nullptr) noexcept;
 
+		// Fails with error::push_constants_too_large if any range ends past the device's maxPushConstantsSize.
+		[[nodiscard]] static error_or<pipeline_layout> create(
+		  device const& d,
+		  std::span<VkDescriptorSetLayout const> set_layouts,
+		  std::span<VkPushConstantRange const> push_constants,
+		  VkAllocationCallbacks const* allocator = nullptr) noexcept;
+
+		// A layout whose push constants are a single T, which is visible to stages.
+		template<push_constant_data T>
+		[[nodiscard]] static error_or<pipeline_layout> create(
+		  device const& d,
+		  std::span<VkDescriptorSetLayout const> const set_layouts,
+		  VkShaderStageFlags const stages,
+		  VkAllocationCallbacks const* const allocator = nullptr) noexcept
+		{
+			auto const range = push_constant_range<T>(stages);
+			return create(d, set_layouts, {&range, 1}, allocator);
+		}
+
 		[[nodiscard]] VkPipelineLayout get() const noexcept
 		{
 			return layout_.get();
@@ -367,6 +896,74 @@ namespace vulkan {
 		pipeline_layout(VkDevice, VkPipelineLayout, VkAllocationCallbacks const*) noexcept;
 	};
 
+	class pipeline_cache {
+	public:
+		[[nodiscard]] static error_or<pipeline_cache> create(
+		  device const& d,
+		  VkAllocationCallbacks const* allocator = nullptr) noexcept;
+
+		[[nodiscard]] static error_or<pipeline_cache> create(
+		  device const& d,
+		  std::span<std::byte const> initial_data,
+		  VkAllocationCallbacks const* allocator = nullptr) noexcept;
+
+		// Starts from an empty cache when the file is missing, or was written by a different driver or device.
+		[[nodiscard]] static error_or<pipeline_cache> create(
+		  device const& d,
+		  std::filesystem::path const& path,
+		  VkAllocationCallbacks const* allocator = nullptr) noexcept;
+
+		[[nodiscard]] VkPipelineCache get() const noexcept
+		{
+			return cache_.get();
+		}
+
+		[[nodiscard]] error_or<std::vector<std::byte>> data() const noexcept;
+		[[nodiscard]] error_or<void> save(std::filesystem::path const& path) const noexcept;
+	private:
+		std::unique_ptr<VkPipelineCache_T, deleter<PFN_vkDestroyPipelineCache, VkDevice>> cache_;
+		VkDevice device_;
+
+		pipeline_cache(VkPipelineCache, VkDevice, VkAllocationCallbacks const*) noexcept;
+	};
+
+	// Everything that determines a graphics pipeline. The handles are borrowed, and must outlive any pipeline that's
+	// created from the state. Since handles are hashed by value, hash() is only stable within a process.
+	struct graphics_pipeline_state {
+		VkPipelineLayout layout = VK_NULL_HANDLE;
+		VkRenderPass render_pass = VK_NULL_HANDLE;
+		std::uint32_t subpass = 0;
+
+		// Only used when render_pass is null, in which case the pipeline is created for dynamic rendering to a single
+		// colour attachment of this format.
+		VkFormat colour_format = VK_FORMAT_UNDEFINED;
+		VkExtent2D viewport_extent = {};
+		std::vector<shader_stage> stages;
+		specialisation_constants constants;
+		std::vector<VkVertexInputBindingDescription> bindings;
+		std::vector<VkVertexInputAttributeDescription> attributes;
+		VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+		VkPolygonMode polygon_mode = VK_POLYGON_MODE_FILL;
+		VkCullModeFlags cull_mode = VK_CULL_MODE_BACK_BIT;
+		VkFrontFace front_face = VK_FRONT_FACE_CLOCKWISE;
+		VkPipelineColorBlendAttachmentState colour_blend = {
+		  .blendEnable = VK_FALSE,
+		  .srcColorBlendFactor = VK_BLEND_FACTOR_ONE,
+		  .dstColorBlendFactor = VK_BLEND_FACTOR_ZERO,
+		  .colorBlendOp = VK_BLEND_OP_ADD,
+		  .srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
+		  .dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
+		  .alphaBlendOp = VK_BLEND_OP_ADD,
+		  .colorWriteMask =
+		    VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+		};
+		std::vector<VkDynamicState> dynamic_states;
+
+		[[nodiscard]] std::size_t hash() const noexcept;
+
+		friend bool operator==(graphics_pipeline_state const&, graphics_pipeline_state const&) noexcept;
+	};
+
 	enum class pipeline_kind : std::uint8_t { graphics, compute };
 
 	template<pipeline_kind kind>
@@ -374,10 +971,30 @@ namespace vulkan {
 	public:
 		[[nodiscard]] static error_or<pipeline> create(
 		  device const& d,
+		  pipeline_cache const& cache,
 		  pipeline_layout const& layout,
 		  render_pass const& renderpass,
 		  std::span<VkDynamicState const> dynamic_states,
-		  swapchain const& swap_chain,
+		  VkExtent2D viewport_extent,
+		  std::span<vertex_shader const> vertex_shaders,
+		  std::span<VkVertexInputBindingDescription const> binding_descriptions,
+		  std::span<VkVertexInputAttributeDescription const> attribute_descriptions,
+		  std::span<fragment_shader const> fragment_shaders,
+		  std::span<tesselation_control_shader const> tesselation_control_shaders = {},
+		  std::span<tesselation_evaluation_shader const> tesselation_evaluation_shaders = {},
+		  std::span<geometry_shader const> geometry_shaders = {},
+		  specialisation_constants const& constants = {},
+		  VkAllocationCallbacks const* allocator = nullptr) noexcept
+		requires (kind == pipeline_kind::graphics);
+
+		// A pipeline for dynamic rendering, which is compatible with any colour attachment of colour_format.
+		[[nodiscard]] static error_or<pipeline> create(
+		  device const& d,
+		  pipeline_cache const& cache,
+		  pipeline_layout const& layout,
+		  VkFormat colour_format,
+		  std::span<VkDynamicState const> dynamic_states,
+		  VkExtent2D viewport_extent,
 		  std::span<vertex_shader const> vertex_shaders,
 		  std::span<VkVertexInputBindingDescription const> binding_descriptions,
 		  std::span<VkVertexInputAttributeDescription const> attribute_descriptions,
@@ -385,10 +1002,24 @@ namespace vulkan {
 		  std::span<tesselation_control_shader const> tesselation_control_shaders = {},
 		  std::span<tesselation_evaluation_shader const> tesselation_evaluation_shaders = {},
 		  std::span<geometry_shader const> geometry_shaders = {},
+		  specialisation_constants const& constants = {},
+		  VkAllocationCallbacks const* allocator = nullptr) noexcept
+		requires (kind == pipeline_kind::graphics);
+
+		[[nodiscard]] static error_or<pipeline> create(
+		  device const& d,
+		  pipeline_cache const& cache,
+		  graphics_pipeline_state const& state,
 		  VkAllocationCallbacks const* allocator = nullptr) noexcept
 		requires (kind == pipeline_kind::graphics);
 
-		[[nodiscard]] static error_or<pipeline> create(std::span<compute_shader const> kernels) noexcept
+		[[nodiscard]] static error_or<pipeline> create(
+		  device const& d,
+		  pipeline_cache const& cache,
+		  pipeline_layout const& layout,
+		  compute_shader const& kernel,
+		  specialisation_constants const& constants = {},
+		  VkAllocationCallbacks const* allocator = nullptr) noexcept
 		requires (kind == pipeline_kind::compute);
 
 		[[nodiscard]] VkPipeline get() const noexcept;
@@ -404,6 +1035,38 @@ namespace vulkan {
 	extern template class pipeline<pipeline_kind::compute>;
 	using compute_pipeline = pipeline<pipeline_kind::compute>;
 
+	// A thread-safe set of graphics pipelines, keyed on their graphics_pipeline_state, so that each variant is only
+	// compiled once. Pipelines live as long as the set, which must not outlive the device or cache it was created with.
+	class pipeline_variants {
+	public:
+		[[nodiscard]] static error_or<pipeline_variants> create(
+		  device const& d,
+		  pipeline_cache const& cache,
+		  VkAllocationCallbacks const* allocator = nullptr) noexcept;
+
+		pipeline_variants(pipeline_variants&&) noexcept;
+		pipeline_variants& operator=(pipeline_variants&&) noexcept;
+		~pipeline_variants();
+
+		// Compiles the pipeline on the calling thread if it hasn't been compiled yet. Concurrent requests for the same
+		// variant wait for the first one to finish, rather than compiling it again.
+		[[nodiscard]] error_or<VkPipeline> get(graphics_pipeline_state const& state) noexcept;
+
+		// Never compiles on the calling thread: if the pipeline isn't ready, it's queued for compilation on a
+		// background thread, and fallback is returned until it is. Variants that fail to compile also return fallback.
+		[[nodiscard]] VkPipeline get_or(graphics_pipeline_state const& state, VkPipeline fallback) noexcept;
+
+		// Blocks until every queued pipeline has been compiled.
+		void wait() noexcept;
+
+		[[nodiscard]] std::size_t size() const noexcept;
+	private:
+		struct variant_table;
+		std::unique_ptr<variant_table> table_;
+
+		explicit pipeline_variants(std::unique_ptr<variant_table> table) noexcept;
+	};
+
 	class framebuffer {
 	public:
 		[[nodiscard]] static error_or<framebuffer> create(
@@ -413,6 +1076,13 @@ namespace vulkan {
 		  swapchain const& chain,
 		  VkAllocationCallbacks const* alloc = nullptr) noexcept;
 
+		[[nodiscard]] static error_or<framebuffer> create(
+		  device const& d,
+		  image_view const& view,
+		  render_pass const& pass,
+		  VkExtent2D extent,
+		  VkAllocationCallbacks const* alloc = nullptr) noexcept;
+
 		[[nodiscard]] VkFramebuffer get() const noexcept;
 	private:
 		std::unique_ptr<VkFramebuffer_T, deleter<PFN_vkDestroyFramebuffer, VkDevice>> framebuffer_;
@@ -420,12 +1090,137 @@ namespace vulkan {
 		framebuffer(VkFramebuffer, VkDevice, VkAllocationCallbacks const*) noexcept;
 	};
 
-	class command_pool {
+	// Measures where GPU time goes using named scopes, each of which writes a timestamp when it begins and ends. Scopes
+	// that aren't nested inside another scope can also collect pipeline statistics. Every frame in flight has its own
+	// queries, which are read back by the next begin_frame for that frame, so results lag frames_in_flight frames
+	// behind. Attaching a profiler to a command_buffer scopes its record regions and custom ops automatically.
+	class gpu_profiler {
 	public:
-		static error_or<command_pool> create(
-		  device const& d,
-		  window::window const& w,
-		  VkAllocationCallbacks const* alloc = nullptr) noexcept;
+		struct scope_result {
+			std::string name;
+			std::uint32_t depth;
+			double begin_ms; // Relative to the start of the frame's first scope.
+			double duration_ms;
+
+			// One value per bit in the profiler's statistics, lowest bit first. Empty for nested scopes.
+			std::vector<std::uint64_t> statistics;
+		};
+
+		struct frame_result {
+			std::uint64_t frame_number;
+			double gpu_begin_ms; // The GPU's clock, whose epoch is unspecified.
+			std::vector<scope_result> scopes;
+		};
+
+		// Fails with error::feature_unavailable when the graphics queue can't write timestamps, or when statistics is
+		// non-empty and pipelineStatisticsQuery isn't supported. Compute work is only timed when the compute queue can
+		// also write timestamps.
+		[[nodiscard]] static error_or<gpu_profiler> create(
+		  device const& d,
+		  std::uint32_t frames_in_flight,
+		  std::uint32_t max_scopes = 128,
+		  VkQueryPipelineStatisticFlags statistics = {},
+		  VkAllocationCallbacks const* alloc = nullptr) noexcept;
+
+		// Reads back the results from frame's previous use, and resets its queries. Must be recorded before any scope,
+		// outside of a render pass, after the frame's previous submission has finished executing.
+		[[nodiscard]] error_or<void> begin_frame(VkCommandBuffer command, std::uint32_t frame) noexcept;
+
+		// Scopes must be ended in the reverse order that they began. A scope that begins inside a render pass must also
+		// end inside it. Scopes past max_scopes are dropped. Pass collect_statistics = false for scopes that execute
+		// secondary command buffers, which don't inherit the statistics query.
+		[[nodiscard]] std::uint32_t
+		begin_scope(VkCommandBuffer command, std::string_view name, bool collect_statistics = true) noexcept;
+		void end_scope(VkCommandBuffer command, std::uint32_t id) noexcept;
+		static constexpr auto dropped_scope = std::numeric_limits<std::uint32_t>::max();
+
+		// Ends the scope when destroyed. Does nothing when profiler is null.
+		class scope {
+		public:
+			scope(
+			  gpu_profiler* const profiler,
+			  VkCommandBuffer const command,
+			  std::string_view const name,
+			  bool const collect_statistics = true) noexcept
+			: profiler_(profiler)
+			, command_(command)
+			, scope_(profiler == nullptr ? dropped_scope : profiler->begin_scope(command, name, collect_statistics))
+			{}
+
+			scope(scope const&) = delete;
+			scope& operator=(scope const&) = delete;
+
+			~scope()
+			{
+				if (profiler_ != nullptr) {
+					profiler_->end_scope(command_, scope_);
+				}
+			}
+		private:
+			gpu_profiler* profiler_;
+			VkCommandBuffer command_;
+			std::uint32_t scope_;
+		};
+
+		[[nodiscard]] bool times_compute() const noexcept
+		{
+			return times_compute_;
+		}
+
+		// The most recent history frames, oldest first.
+		[[nodiscard]] std::deque<frame_result> const& results() const noexcept
+		{
+			return results_;
+		}
+
+		static constexpr auto history = std::size_t{256};
+
+		// Chrome's trace event format, which chrome://tracing and Perfetto can open.
+		[[nodiscard]] std::string chrome_trace() const;
+		[[nodiscard]] error_or<void> save_chrome_trace(std::filesystem::path const& path) const noexcept;
+	private:
+		struct frame_queries {
+			std::vector<std::string> names;
+			std::vector<std::uint32_t> depths;
+			std::uint64_t frame_number = 0;
+		};
+
+		std::unique_ptr<VkQueryPool_T, deleter<PFN_vkDestroyQueryPool, VkDevice>> timestamps_;
+		std::unique_ptr<VkQueryPool_T, deleter<PFN_vkDestroyQueryPool, VkDevice>> statistics_;
+		VkDevice device_;
+		VkQueryPipelineStatisticFlags statistic_flags_;
+		double timestamp_period_;
+		std::uint64_t timestamp_mask_;
+		std::uint32_t max_scopes_;
+		std::vector<frame_queries> frames_;
+		std::vector<std::uint32_t> open_scopes_;
+		std::uint32_t frame_ = 0;
+		std::uint64_t frame_number_ = 0;
+		std::deque<frame_result> results_;
+		bool times_compute_;
+		bool statistics_active_ = false;
+
+		gpu_profiler(
+		  VkQueryPool timestamps,
+		  VkQueryPool statistics,
+		  VkDevice device,
+		  VkAllocationCallbacks const* alloc,
+		  VkQueryPipelineStatisticFlags statistic_flags,
+		  double timestamp_period,
+		  std::uint32_t timestamp_valid_bits,
+		  std::uint32_t max_scopes,
+		  std::uint32_t frames_in_flight,
+		  bool times_compute) noexcept;
+
+		[[nodiscard]] error_or<void> read_back(std::uint32_t frame) noexcept;
+	};
+
+	class command_pool {
+	public:
+		static error_or<command_pool> create(
+		  device const& d,
+		  queue_kind queue,
+		  VkAllocationCallbacks const* alloc = nullptr) noexcept;
 
 		[[nodiscard]] VkCommandPool get() const noexcept;
 	private:
@@ -439,7 +1234,8 @@ namespace vulkan {
 		[[nodiscard]] static error_or<command_buffer> create(
 		  device const& d,
 		  command_pool const& p,
-		  std::uint32_t max_commands) noexcept;
+		  std::uint32_t max_commands,
+		  VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY) noexcept;
 
 		[[nodiscard]] VkCommandBuffer get(std::uint32_t const frame) const noexcept
 		{
@@ -456,6 +1252,19 @@ namespace vulkan {
 		  graphics_pipeline const& pipeline,
 		  std::span<framebuffer const> const buffers,
 		  F custom_op) noexcept
+		{
+			return record(frame, pass, buffers[image_index], chain.extent(), pipeline, std::move(custom_op));
+		}
+
+		template<std::invocable<VkCommandBuffer> F>
+		requires std::same_as<std::invoke_result_t<F, VkCommandBuffer>, error_or<void>>
+		[[nodiscard]] error_or<void> record(
+		  std::uint32_t const frame,
+		  render_pass const& pass,
+		  framebuffer const& target,
+		  VkExtent2D const extent,
+		  graphics_pipeline const& pipeline,
+		  F custom_op) noexcept
 		{
 			constexpr auto begin_info = VkCommandBufferBeginInfo{
 			  .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
@@ -468,38 +1277,176 @@ namespace vulkan {
 				return std::unexpected(static_cast<error>(result));
 			}
 
+			if (auto const result = begin_profiling(frame); not result) {
+				return result;
+			}
+
 			auto const render_area = VkRect2D{
 			  .offset = {},
-			  .extent = chain.extent(),
+			  .extent = extent,
 			};
 			auto const clear_colour = VkClearValue{.color = {{0.0f, 0.0f, 0.0f, 1.0f}}};
 			auto const render_pass_info = VkRenderPassBeginInfo{
 			  .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
 			  .pNext = nullptr,
 			  .renderPass = pass.get(),
-			  .framebuffer = buffers[image_index].get(),
+			  .framebuffer = target.get(),
 			  .renderArea = render_area,
 			  .clearValueCount = 1,
 			  .pClearValues = &clear_colour,
 			};
 
-			vkCmdBeginRenderPass(buffer_[frame], &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
-			vkCmdBindPipeline(buffer_[frame], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.get());
+			{
+				auto const pass_scope = gpu_profiler::scope(profiler_, buffer_[frame], "render pass");
+				vkCmdBeginRenderPass(buffer_[frame], &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
+				vkCmdBindPipeline(buffer_[frame], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.get());
+
+				auto const viewport = VkViewport{
+				  .x = 0.0f,
+				  .y = 0.0f,
+				  .width = static_cast<float>(extent.width),
+				  .height = static_cast<float>(extent.height),
+				  .minDepth = 0.0f,
+				  .maxDepth = 1.0f,
+				};
+				vkCmdSetViewport(buffer_[frame], 0, 1, &viewport);
+				vkCmdSetScissor(buffer_[frame], 0, 1, &render_area);
+				{
+					auto const op_scope = gpu_profiler::scope(profiler_, buffer_[frame], "custom op");
+					if (auto const result = custom_op(buffer_[frame]); not result.has_value()) {
+						return result;
+					}
+				}
+				vkCmdEndRenderPass(buffer_[frame]);
+			}
+			if (auto const result = vkEndCommandBuffer(buffer_[frame]); result != VK_SUCCESS) {
+				return std::unexpected(static_cast<error>(result));
+			}
+
+			return {};
+		}
 
-			auto const viewport = VkViewport{
-			  .x = 0.0f,
-			  .y = 0.0f,
-			  .width = static_cast<float>(chain.extent().width),
-			  .height = static_cast<float>(chain.extent().height),
-			  .minDepth = 0.0f,
-			  .maxDepth = 1.0f,
+		// Dynamic rendering straight to the swapchain's image_index-th image, so neither a render_pass nor framebuffers
+		// are needed. The device must support dynamic_rendering, and pipeline must be created for the swapchain's format.
+		template<std::invocable<VkCommandBuffer> F>
+		requires std::same_as<std::invoke_result_t<F, VkCommandBuffer>, error_or<void>>
+		[[nodiscard]] error_or<void> record(
+		  std::uint32_t const frame,
+		  std::uint32_t const image_index,
+		  swapchain const& chain,
+		  graphics_pipeline const& pipeline,
+		  F custom_op) noexcept
+		{
+			return record(
+			  frame,
+			  chain.images()[image_index],
+			  chain.image_views()[image_index],
+			  chain.extent(),
+			  VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+			  pipeline,
+			  std::move(custom_op));
+		}
+
+		// Dynamic rendering to view, which is cleared and then left in final_layout. image is the image that view
+		// was created from, and is needed for the layout transitions that a render pass would otherwise perform.
+		template<std::invocable<VkCommandBuffer> F>
+		requires std::same_as<std::invoke_result_t<F, VkCommandBuffer>, error_or<void>>
+		[[nodiscard]] error_or<void> record(
+		  std::uint32_t const frame,
+		  VkImage const image,
+		  image_view const& view,
+		  VkExtent2D const extent,
+		  VkImageLayout const final_layout,
+		  graphics_pipeline const& pipeline,
+		  F custom_op) noexcept
+		{
+			constexpr auto begin_info = VkCommandBufferBeginInfo{
+			  .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+			  .pNext = nullptr,
+			  .flags = {},
+			  .pInheritanceInfo = nullptr,
 			};
-			vkCmdSetViewport(buffer_[frame], 0, 1, &viewport);
-			vkCmdSetScissor(buffer_[frame], 0, 1, &render_area);
-			if (auto const result = custom_op(buffer_[frame]); not result.has_value()) {
+
+			if (auto const result = vkBeginCommandBuffer(buffer_[frame], &begin_info); result != VK_SUCCESS) {
+				return std::unexpected(static_cast<error>(result));
+			}
+
+			if (auto const result = begin_profiling(frame); not result) {
 				return result;
 			}
-			vkCmdEndRenderPass(buffer_[frame]);
+
+			{
+				auto const pass_scope = gpu_profiler::scope(profiler_, buffer_[frame], "render pass");
+				begin_rendering(frame, image, view, extent);
+				vkCmdBindPipeline(buffer_[frame], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.get());
+				{
+					auto const op_scope = gpu_profiler::scope(profiler_, buffer_[frame], "custom op");
+					if (auto const result = custom_op(buffer_[frame]); not result.has_value()) {
+						return result;
+					}
+				}
+				end_rendering(frame, image, final_layout);
+			}
+			if (auto const result = vkEndCommandBuffer(buffer_[frame]); result != VK_SUCCESS) {
+				return std::unexpected(static_cast<error>(result));
+			}
+
+			return {};
+		}
+
+		// Records a render pass whose contents were recorded into secondary command buffers, e.g. by a
+		// parallel_recorder.
+		[[nodiscard]] error_or<void> record(
+		  std::uint32_t frame,
+		  std::uint32_t image_index,
+		  render_pass const& pass,
+		  swapchain const& chain,
+		  std::span<framebuffer const> buffers,
+		  std::span<VkCommandBuffer const> secondaries) noexcept;
+
+		[[nodiscard]] error_or<void> record(
+		  std::uint32_t frame,
+		  render_pass const& pass,
+		  framebuffer const& target,
+		  VkExtent2D extent,
+		  std::span<VkCommandBuffer const> secondaries) noexcept;
+
+		// Compute work is recorded outside of any render pass, so it can be submitted to a compute queue.
+		template<std::invocable<VkCommandBuffer> F>
+		requires std::same_as<std::invoke_result_t<F, VkCommandBuffer>, error_or<void>>
+		[[nodiscard]] error_or<void> record(
+		  std::uint32_t const frame,
+		  compute_pipeline const& pipeline,
+		  F custom_op) noexcept
+		{
+			constexpr auto begin_info = VkCommandBufferBeginInfo{
+			  .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+			  .pNext = nullptr,
+			  .flags = {},
+			  .pInheritanceInfo = nullptr,
+			};
+
+			if (auto const result = vkBeginCommandBuffer(buffer_[frame], &begin_info); result != VK_SUCCESS) {
+				return std::unexpected(static_cast<error>(result));
+			}
+
+			// Compute work is only timed when the compute queue can write timestamps. Statistics are left to graphics work,
+			// since a dedicated compute queue can't collect the graphics statistics.
+			auto* const profiler = profiler_ != nullptr and profiler_->times_compute() ? profiler_ : nullptr;
+			if (profiler != nullptr) {
+				if (auto const result = profiler->begin_frame(buffer_[frame], frame); not result) {
+					return result;
+				}
+			}
+
+			vkCmdBindPipeline(buffer_[frame], VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.get());
+			{
+				auto const op_scope = gpu_profiler::scope(profiler, buffer_[frame], "custom op", false);
+				if (auto const result = custom_op(buffer_[frame]); not result.has_value()) {
+					return result;
+				}
+			}
+
 			if (auto const result = vkEndCommandBuffer(buffer_[frame]); result != VK_SUCCESS) {
 				return std::unexpected(static_cast<error>(result));
 			}
@@ -508,12 +1455,195 @@ namespace vulkan {
 		}
 
 		[[nodiscard]] error_or<void> reset(std::uint32_t frame) noexcept;
+
+		// Every record call begins the profiler's frame and scopes its render pass and custom op. Pass null to stop
+		// profiling. profiler must outlive its use by this command buffer.
+		void profile(gpu_profiler* const profiler) noexcept
+		{
+			profiler_ = profiler;
+		}
 	private:
 		std::vector<VkCommandBuffer> buffer_;
+		gpu_profiler* profiler_ = nullptr;
 
 		explicit command_buffer(std::vector<VkCommandBuffer>) noexcept;
+
+		[[nodiscard]] error_or<void> begin_profiling(std::uint32_t const frame) noexcept
+		{
+			return profiler_ == nullptr ? error_or<void>() : profiler_->begin_frame(buffer_[frame], frame);
+		}
+
+		// Transitions image to a colour attachment, begins rendering to view with a cleared colour, and sets the
+		// viewport and scissor to extent.
+		void begin_rendering(std::uint32_t frame, VkImage image, image_view const& view, VkExtent2D extent) noexcept;
+		void end_rendering(std::uint32_t frame, VkImage image, VkImageLayout final_layout) noexcept;
+	};
+
+	// Splits a draw list across a pool of worker threads, each of which records its share into a secondary
+	// command buffer allocated from its own command_pool. The secondaries inherit the render pass and
+	// framebuffer, and are executed by the primary command_buffer::record overload that takes them.
+	class parallel_recorder {
+	public:
+		using range_fn = error_or<void> (*)(
+		  void* context,
+		  VkCommandBuffer command,
+		  std::uint32_t first,
+		  std::uint32_t count);
+
+		[[nodiscard]] static error_or<parallel_recorder> create(
+		  device const& d,
+		  std::uint32_t frames,
+		  std::uint32_t threads = jobs::hardware_threads(),
+		  VkAllocationCallbacks const* alloc = nullptr) noexcept;
+
+		[[nodiscard]] std::uint32_t threads() const noexcept
+		{
+			return static_cast<std::uint32_t>(pools_.size());
+		}
+
+		// record_range is called concurrently from every worker thread.
+		template<class F>
+		requires std::same_as<std::invoke_result_t<F&, VkCommandBuffer, std::uint32_t, std::uint32_t>, error_or<void>>
+		[[nodiscard]] error_or<std::span<VkCommandBuffer const>> record(
+		  std::uint32_t const frame,
+		  render_pass const& pass,
+		  framebuffer const& target,
+		  graphics_pipeline const& pipeline,
+		  VkExtent2D const extent,
+		  std::uint32_t const draw_count,
+		  F record_range) noexcept
+		{
+			auto const erased = [](void* const context,
+			                       VkCommandBuffer const command,
+			                       std::uint32_t const first,
+			                       std::uint32_t const count) noexcept -> error_or<void> {
+				return (*static_cast<F*>(context))(command, first, count);
+			};
+			return record(frame, pass, target, pipeline, extent, draw_count, erased, &record_range);
+		}
+
+		[[nodiscard]] error_or<std::span<VkCommandBuffer const>> record(
+		  std::uint32_t frame,
+		  render_pass const& pass,
+		  framebuffer const& target,
+		  graphics_pipeline const& pipeline,
+		  VkExtent2D extent,
+		  std::uint32_t draw_count,
+		  range_fn record_range,
+		  void* context) noexcept;
+	private:
+		std::vector<command_pool> pools_;
+		std::vector<command_buffer> buffers_;
+		std::vector<VkCommandBuffer> recorded_;
+		std::unique_ptr<jobs::thread_pool> workers_;
+
+		parallel_recorder(std::vector<command_pool>, std::vector<command_buffer>) noexcept;
 	};
 
+	void bind_descriptor_sets(
+	  VkCommandBuffer command,
+	  VkPipelineBindPoint bind_point,
+	  pipeline_layout const& layout,
+	  std::span<VkDescriptorSet const> sets,
+	  std::uint32_t first_set = 0) noexcept;
+
+	// offset and data's size must both be multiples of four.
+	void push_constants(
+	  VkCommandBuffer command,
+	  pipeline_layout const& layout,
+	  VkShaderStageFlags stages,
+	  std::uint32_t offset,
+	  std::span<std::byte const> data) noexcept;
+
+	template<push_constant_data T>
+	void push_constants(
+	  VkCommandBuffer const command,
+	  pipeline_layout const& layout,
+	  VkShaderStageFlags const stages,
+	  T const& value,
+	  std::uint32_t const offset = 0) noexcept
+	{
+		push_constants(command, layout, stages, offset, std::as_bytes(std::span(&value, 1)));
+	}
+
+	void dispatch(VkCommandBuffer command, std::uint32_t x, std::uint32_t y = 1, std::uint32_t z = 1) noexcept;
+	void dispatch_indirect(VkCommandBuffer command, VkBuffer arguments, VkDeviceSize offset = 0) noexcept;
+
+	// offsets is either empty, in which case every buffer is bound from its start, or has one element per buffer.
+	void bind_vertex_buffers(
+	  VkCommandBuffer command,
+	  std::span<VkBuffer const> buffers,
+	  std::span<VkDeviceSize const> offsets = {},
+	  std::uint32_t first_binding = 0) noexcept;
+
+	template<class T>
+	concept index = std::same_as<T, std::uint16_t> or std::same_as<T, std::uint32_t>;
+
+	template<index T>
+	inline constexpr auto index_type = std::same_as<T, std::uint16_t> ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+
+	void bind_index_buffer(VkCommandBuffer command, VkBuffer indices, VkIndexType type, VkDeviceSize offset = 0) noexcept;
+
+	void draw(
+	  VkCommandBuffer command,
+	  std::uint32_t vertex_count,
+	  std::uint32_t instance_count = 1,
+	  std::uint32_t first_vertex = 0,
+	  std::uint32_t first_instance = 0) noexcept;
+
+	void draw_indexed(
+	  VkCommandBuffer command,
+	  std::uint32_t index_count,
+	  std::uint32_t instance_count = 1,
+	  std::uint32_t first_index = 0,
+	  std::int32_t vertex_offset = 0,
+	  std::uint32_t first_instance = 0) noexcept;
+
+	// Reads draw_count VkDrawIndirectCommands from arguments, starting at offset.
+	void draw_indirect(
+	  VkCommandBuffer command,
+	  VkBuffer arguments,
+	  VkDeviceSize offset,
+	  std::uint32_t draw_count,
+	  std::uint32_t stride = sizeof(VkDrawIndirectCommand)) noexcept;
+
+	// Reads draw_count VkDrawIndexedIndirectCommands from arguments, starting at offset.
+	void draw_indexed_indirect(
+	  VkCommandBuffer command,
+	  VkBuffer arguments,
+	  VkDeviceSize offset,
+	  std::uint32_t draw_count,
+	  std::uint32_t stride = sizeof(VkDrawIndexedIndirectCommand)) noexcept;
+
+	// Like draw_indirect, but the number of draws is a std::uint32_t read from count at count_offset when the command
+	// executes, so it can be written by the GPU. At most max_draw_count draws are made. Requires
+	// physical_device::draw_indirect_count.
+	void draw_indirect_count(
+	  VkCommandBuffer command,
+	  VkBuffer arguments,
+	  VkDeviceSize offset,
+	  VkBuffer count,
+	  VkDeviceSize count_offset,
+	  std::uint32_t max_draw_count,
+	  std::uint32_t stride = sizeof(VkDrawIndirectCommand)) noexcept;
+
+	void draw_indexed_indirect_count(
+	  VkCommandBuffer command,
+	  VkBuffer arguments,
+	  VkDeviceSize offset,
+	  VkBuffer count,
+	  VkDeviceSize count_offset,
+	  std::uint32_t max_draw_count,
+	  std::uint32_t stride = sizeof(VkDrawIndexedIndirectCommand)) noexcept;
+
+	// The usage that buffer<T>::create gives to an uploaded buffer unless it's told otherwise. Integers are valid vertex
+	// attributes too, so index buffers need to ask for VK_BUFFER_USAGE_INDEX_BUFFER_BIT explicitly.
+	template<class T>
+	inline constexpr VkBufferUsageFlags default_buffer_usage =
+	  std::same_as<T, VkDrawIndirectCommand> or std::same_as<T, VkDrawIndexedIndirectCommand>
+	    ? VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT
+	    : VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+
 	class semaphore {
 	public:
 		[[nodiscard]] static error_or<semaphore> create(device const& d, VkAllocationCallbacks const* alloc = nullptr) noexcept;
@@ -528,6 +1658,37 @@ namespace vulkan {
 		semaphore(VkSemaphore, VkDevice, VkAllocationCallbacks const*) noexcept;
 	};
 
+	// A Vulkan 1.2 timeline semaphore, whose counter can be waited on and signalled from both the host and any
+	// queue. One timeline can replace a fence per submission.
+	class timeline_semaphore {
+	public:
+		[[nodiscard]] static error_or<timeline_semaphore> create(
+		  device const& d,
+		  std::uint64_t initial_value = 0,
+		  VkAllocationCallbacks const* alloc = nullptr) noexcept;
+
+		[[nodiscard]] VkSemaphore get() const noexcept
+		{
+			return semaphore_.get();
+		}
+
+		[[nodiscard]] semaphore_value at(std::uint64_t const value) const noexcept
+		{
+			return {.semaphore = semaphore_.get(), .value = value};
+		}
+
+		[[nodiscard]] error_or<std::uint64_t> value() const noexcept;
+		[[nodiscard]] error_or<void> signal(std::uint64_t value) noexcept;
+		[[nodiscard]] error_or<void> wait(
+		  std::uint64_t value,
+		  std::uint64_t timeout = std::numeric_limits<std::uint64_t>::max()) const noexcept;
+	private:
+		std::unique_ptr<VkSemaphore_T, deleter<PFN_vkDestroySemaphore, VkDevice>> semaphore_;
+		VkDevice device_;
+
+		timeline_semaphore(VkSemaphore, VkDevice, VkAllocationCallbacks const*) noexcept;
+	};
+
 	class fence {
 	public:
 		[[nodiscard]] static error_or<fence> create(device const& d, VkAllocationCallbacks const* alloc = nullptr) noexcept;
@@ -545,19 +1706,502 @@ namespace vulkan {
 		fence(VkFence, VkDevice, VkAllocationCallbacks const*) noexcept;
 	};
 
+	// CPU-side timings for one frame. acquire_wait is spent blocked on the frame's previous submission and on acquiring
+	// an image, acquire_to_present covers recording, submission and presentation, and frame_interval is the time between
+	// consecutive presents. The first frame has no frame_interval, so it's left out of frame_pacing's mean interval.
+	struct frame_timings {
+		std::chrono::nanoseconds acquire_wait{};
+		std::chrono::nanoseconds acquire_to_present{};
+		std::chrono::nanoseconds frame_interval{};
+	};
+
+	struct frame_pacing {
+		frame_timings mean;
+		frame_timings worst;
+		std::uint32_t samples = 0;
+	};
+
+	// Drives acquire → record → submit → present for a fixed number of frames in flight. Each frame owns a
+	// command buffer and its semaphores, and every submission signals the next value of one timeline semaphore; a
+	// frame's slot is only reused once the GPU has reached its last value, and a swapchain image is only re-recorded
+	// once the frame that last rendered to it has finished. The device must support timeline semaphores.
+	class frame_scheduler {
+	public:
+		using record_fn = error_or<void> (*)(
+		  void* context,
+		  command_buffer& commands,
+		  std::uint32_t frame,
+		  std::uint32_t image_index);
+
+		[[nodiscard]] static error_or<frame_scheduler> create(
+		  device& d,
+		  command_pool const& pool,
+		  std::uint32_t frames_in_flight = 2,
+		  VkAllocationCallbacks const* alloc = nullptr) noexcept;
+
+		[[nodiscard]] std::uint32_t frames_in_flight() const noexcept
+		{
+			return static_cast<std::uint32_t>(slots_.size());
+		}
+
+		[[nodiscard]] std::uint32_t frame() const noexcept
+		{
+			return frame_;
+		}
+
+		// Renders one frame to chain. record is called with the frame's command buffer, which has already been
+		// reset, and must record into slot `frame`. error::out_of_date and error::suboptimal are returned after the
+		// frame's bookkeeping is complete, so the caller can call recreate and carry on. Any other error that happens
+		// after the image is acquired leaves it acquired, so the caller must recreate the swapchain before drawing again.
+		template<class F>
+		requires std::same_as<
+		  std::invoke_result_t<F&, command_buffer&, std::uint32_t, std::uint32_t>,
+		  error_or<void>>
+		[[nodiscard]] error_or<void> draw(swapchain& chain, F record) noexcept
+		{
+			auto const erased = [](void* const context,
+			                       command_buffer& commands,
+			                       std::uint32_t const frame,
+			                       std::uint32_t const image_index) noexcept -> error_or<void> {
+				return (*static_cast<F*>(context))(commands, frame, image_index);
+			};
+			return draw(chain, erased, &record);
+		}
+
+		[[nodiscard]] error_or<void> draw(swapchain& chain, record_fn record, void* context) noexcept;
+
+		// Blocks until every frame in flight has finished executing.
+		[[nodiscard]] error_or<void> wait() noexcept;
+
+		// Timings for the most recently presented frame, and a summary over the last pacing_history frames.
+		[[nodiscard]] frame_timings const& last_timings() const noexcept;
+		[[nodiscard]] frame_pacing pacing() const noexcept;
+		static constexpr auto pacing_history = std::size_t{128};
+
+		// Replaces chain and the framebuffers that target it. Only the frames in flight are waited on, rather than
+		// idling the whole device. pass stays compatible because the surface format doesn't change.
+		[[nodiscard]] error_or<void> recreate(
+		  swapchain& chain,
+		  window::window const& w,
+		  render_pass const& pass,
+		  std::vector<framebuffer>& framebuffers,
+		  VkAllocationCallbacks const* alloc = nullptr) noexcept;
+
+		// Replaces chain when it's rendered to with dynamic rendering, which has no framebuffers to rebuild.
+		[[nodiscard]] error_or<void> recreate(
+		  swapchain& chain,
+		  window::window const& w,
+		  VkAllocationCallbacks const* alloc = nullptr) noexcept;
+	private:
+		struct frame_slot {
+			semaphore image_available;
+			semaphore render_finished;
+			std::uint64_t in_flight = 0; // The timeline value that the slot's last submission signals.
+		};
+
+		device* device_;
+		command_buffer commands_;
+		timeline_semaphore timeline_;
+		std::vector<frame_slot> slots_;
+		std::vector<std::uint64_t> image_values_;
+		std::uint64_t submitted_ = 0;
+		std::uint32_t frame_ = 0;
+		std::array<frame_timings, pacing_history> timings_{};
+		std::size_t presented_ = 0;
+		std::chrono::steady_clock::time_point last_present_{};
+
+		frame_scheduler(device&, command_buffer, timeline_semaphore, std::vector<frame_slot>) noexcept;
+
+		[[nodiscard]] error_or<void> abandon(frame_slot& slot, error reason) noexcept;
+	};
+
 	[[nodiscard]] std::optional<std::uint32_t> find_memory_type(
 	  std::uint32_t filter,
 	  VkMemoryPropertyFlags properties,
 	  VkPhysicalDeviceMemoryProperties memory_properties) noexcept;
 
+	class tlsf_allocator {
+	public:
+		struct region {
+			VkDeviceSize offset;
+			VkDeviceSize size;
+			std::uint32_t id;
+		};
+
+		explicit tlsf_allocator(VkDeviceSize capacity) noexcept;
+
+		[[nodiscard]] std::optional<region> allocate(VkDeviceSize size, VkDeviceSize alignment) noexcept;
+		void free(std::uint32_t id) noexcept;
+
+		[[nodiscard]] VkDeviceSize capacity() const noexcept
+		{
+			return capacity_;
+		}
+
+		[[nodiscard]] VkDeviceSize used() const noexcept
+		{
+			return used_;
+		}
+
+		[[nodiscard]] bool empty() const noexcept
+		{
+			return used_ == 0;
+		}
+
+		[[nodiscard]] VkDeviceSize largest_free_region() const noexcept;
+	private:
+		static constexpr auto second_level_log2 = 4u;
+		static constexpr auto second_level_count = 1u << second_level_log2;
+		static constexpr auto first_level_count = 64u;
+		static constexpr auto null_node = std::numeric_limits<std::uint32_t>::max();
+
+		struct node {
+			VkDeviceSize offset;
+			VkDeviceSize size;
+			std::uint32_t prev_physical;
+			std::uint32_t next_physical;
+			std::uint32_t prev_free;
+			std::uint32_t next_free;
+			bool is_free;
+		};
+
+		std::vector<node> nodes_;
+		std::vector<std::uint32_t> recycled_;
+		std::uint64_t first_level_ = 0;
+		std::array<std::uint32_t, first_level_count> second_level_ = {};
+		std::array<std::array<std::uint32_t, second_level_count>, first_level_count> free_lists_;
+		VkDeviceSize capacity_;
+		VkDeviceSize used_ = 0;
+
+		[[nodiscard]] static std::pair<std::uint32_t, std::uint32_t> mapping(VkDeviceSize size) noexcept;
+		[[nodiscard]] std::uint32_t find_free(VkDeviceSize size) const noexcept;
+		[[nodiscard]] std::uint32_t make_node(node n) noexcept;
+		[[nodiscard]] std::uint32_t split(std::uint32_t n, VkDeviceSize size) noexcept;
+		void absorb(std::uint32_t n, std::uint32_t next) noexcept;
+		void insert_free(std::uint32_t n) noexcept;
+		void remove_free(std::uint32_t n) noexcept;
+	};
+
+	enum class resource_tiling : std::uint8_t { linear, optimal };
+
+	class memory_block {
+	public:
+		[[nodiscard]] VkDeviceMemory get() const noexcept
+		{
+			return memory_.get();
+		}
+
+		[[nodiscard]] std::byte* mapped() const noexcept
+		{
+			return mapped_;
+		}
+
+		[[nodiscard]] tlsf_allocator const& regions() const noexcept
+		{
+			return regions_;
+		}
+
+		friend class memory_allocator;
+		friend class allocation;
+	private:
+		std::unique_ptr<VkDeviceMemory_T, deleter<PFN_vkFreeMemory, VkDevice>> memory_;
+		std::byte* mapped_;
+		tlsf_allocator regions_;
+
+		memory_block(VkDeviceMemory, VkDevice, VkAllocationCallbacks const*, std::byte* mapped, VkDeviceSize size) noexcept;
+	};
+
+	class allocation {
+	public:
+		[[nodiscard]] VkDeviceMemory memory() const noexcept
+		{
+			return block_->get();
+		}
+
+		[[nodiscard]] VkDeviceSize offset() const noexcept
+		{
+			return offset_;
+		}
+
+		[[nodiscard]] VkDeviceSize size() const noexcept
+		{
+			return size_;
+		}
+
+		// Returns nullptr when the allocation isn't host-visible. Mapped memory is always host-coherent.
+		[[nodiscard]] std::byte* mapped() const noexcept
+		{
+			return block_->mapped() != nullptr ? block_->mapped() + offset_ : nullptr;
+		}
+
+		friend class memory_allocator;
+	private:
+		struct release {
+			std::uint32_t region;
+
+			void operator()(memory_block* block) const noexcept;
+		};
+
+		std::unique_ptr<memory_block, release> block_;
+		VkDeviceSize offset_;
+		VkDeviceSize size_;
+
+		allocation(memory_block& block, tlsf_allocator::region region) noexcept;
+	};
+
+	// Sub-allocates buffers and images from a small number of large VkDeviceMemory blocks, keeping one
+	// pool per memory type and tiling so that bufferImageGranularity never needs to be considered.
+	// Like other Vulkan pools, a memory_allocator must be externally synchronised.
+	class memory_allocator {
+	public:
+		static constexpr auto default_block_size = VkDeviceSize{64} * 1024 * 1024;
+
+		struct statistics {
+			std::uint32_t device_allocations;
+			VkDeviceSize reserved;
+			VkDeviceSize used;
+			double fragmentation;
+		};
+
+		[[nodiscard]] static error_or<memory_allocator> create(
+		  device const& d,
+		  VkDeviceSize block_size = default_block_size,
+		  VkAllocationCallbacks const* allocator = nullptr) noexcept;
+
+		// Host-visible allocations are always host-coherent too, so their mapped() memory never needs flushing.
+		[[nodiscard]] error_or<allocation> allocate(
+		  VkMemoryRequirements const& requirements,
+		  VkMemoryPropertyFlags properties,
+		  resource_tiling tiling = resource_tiling::linear) noexcept;
+
+		[[nodiscard]] statistics stats() const noexcept;
+
+		void trim() noexcept;
+	private:
+		std::vector<std::vector<std::unique_ptr<memory_block>>> pools_;
+		VkDevice device_;
+		VkPhysicalDeviceMemoryProperties memory_properties_;
+		VkDeviceSize block_size_;
+		std::uint32_t max_allocations_;
+		std::uint32_t device_allocations_ = 0;
+		VkAllocationCallbacks const* allocator_;
+
+		memory_allocator(device const&, VkDeviceSize block_size, VkAllocationCallbacks const*) noexcept;
+
+		[[nodiscard]] VkDeviceSize preferred_block_size(std::uint32_t memory_type) const noexcept;
+		[[nodiscard]] error_or<std::unique_ptr<memory_block>> allocate_block(std::uint32_t memory_type, VkDeviceSize size) noexcept;
+	};
+
+	// A colour image that's rendered to in place of a swapchain image, plus a host-visible buffer that it can be
+	// read back into. Nothing here needs a window or a surface.
+	class offscreen_target {
+	public:
+		// Render passes that target an offscreen_target should leave it in this layout, ready to be read back.
+		static constexpr auto final_layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+		[[nodiscard]] static error_or<offscreen_target> create(
+		  device const& d,
+		  memory_allocator& memory,
+		  VkFormat format,
+		  VkExtent2D extent,
+		  VkAllocationCallbacks const* alloc = nullptr) noexcept;
+
+		[[nodiscard]] VkImage get() const noexcept
+		{
+			return image_.get();
+		}
+
+		[[nodiscard]] image_view const& view() const noexcept
+		{
+			return view_;
+		}
+
+		[[nodiscard]] VkFormat format() const noexcept
+		{
+			return format_;
+		}
+
+		[[nodiscard]] VkExtent2D extent() const noexcept
+		{
+			return extent_;
+		}
+
+		// Copies the image, which must be in final_layout, into the readback buffer and makes it visible to the host.
+		void record_readback(VkCommandBuffer command) const noexcept;
+
+		// Tightly packed rows of texels. The contents are only meaningful once the commands recorded by
+		// record_readback have finished executing.
+		[[nodiscard]] std::span<std::byte const> pixels() const noexcept;
+	private:
+		allocation image_memory_;
+		std::unique_ptr<VkImage_T, deleter<PFN_vkDestroyImage, VkDevice>> image_;
+		image_view view_;
+		allocation readback_memory_;
+		std::unique_ptr<VkBuffer_T, deleter<PFN_vkDestroyBuffer, VkDevice>> readback_;
+		VkFormat format_;
+		VkExtent2D extent_;
+		VkDeviceSize size_;
+
+		offscreen_target(
+		  allocation image_memory,
+		  std::unique_ptr<VkImage_T, deleter<PFN_vkDestroyImage, VkDevice>> image,
+		  image_view view,
+		  allocation readback_memory,
+		  std::unique_ptr<VkBuffer_T, deleter<PFN_vkDestroyBuffer, VkDevice>> readback,
+		  VkFormat format,
+		  VkExtent2D extent,
+		  VkDeviceSize size) noexcept;
+	};
+
+	class staging_ring {
+	public:
+		struct region {
+			VkDeviceSize offset;
+			std::byte* data;
+		};
+
+		[[nodiscard]] static error_or<staging_ring> create(
+		  device const& d,
+		  memory_allocator& memory,
+		  VkDeviceSize capacity,
+		  VkAllocationCallbacks const* alloc = nullptr) noexcept;
+
+		[[nodiscard]] VkBuffer get() const noexcept
+		{
+			return buffer_.get();
+		}
+
+		[[nodiscard]] VkDeviceSize capacity() const noexcept
+		{
+			return capacity_;
+		}
+
+		[[nodiscard]] std::uint64_t head() const noexcept
+		{
+			return head_;
+		}
+
+		[[nodiscard]] std::optional<region> reserve(VkDeviceSize size) noexcept;
+		void retire(std::uint64_t position) noexcept;
+	private:
+		std::unique_ptr<VkBuffer_T, deleter<PFN_vkDestroyBuffer, VkDevice>> buffer_;
+		allocation memory_;
+		VkDeviceSize capacity_;
+		VkDeviceSize alignment_;
+		std::uint64_t head_ = 0;
+		std::uint64_t tail_ = 0;
+
+		staging_ring(
+		  VkBuffer,
+		  VkDevice,
+		  VkAllocationCallbacks const*,
+		  allocation,
+		  VkDeviceSize capacity,
+		  VkDeviceSize alignment) noexcept;
+	};
+
+	struct upload_token {
+		std::uint64_t value;
+	};
+
+	// Packs buffer uploads into a persistently mapped staging_ring and submits them to the transfer queue as a single
+	// command buffer per flush. When the transfer queue has its own family, ownership of each destination is released
+	// to consumer's family, which acquires it in a second submission that waits on the copies. Up to max_batches
+	// flushes may be in flight before the oldest one is waited on. Each token is the value that the batcher's timeline
+	// semaphore reaches once the flush that returned it has finished, so the device must support timeline semaphores.
+	class upload_batcher {
+	public:
+		static constexpr auto default_staging_capacity = VkDeviceSize{32} * 1024 * 1024;
+
+		[[nodiscard]] static error_or<upload_batcher> create(
+		  device& d,
+		  memory_allocator& memory,
+		  queue_kind consumer = queue_kind::graphics,
+		  VkDeviceSize staging_capacity = default_staging_capacity,
+		  std::uint32_t max_batches = 3,
+		  VkAllocationCallbacks const* alloc = nullptr) noexcept;
+
+		[[nodiscard]] error_or<void> enqueue(
+		  VkBuffer destination,
+		  std::span<std::byte const> data,
+		  VkDeviceSize destination_offset = 0) noexcept;
+
+		[[nodiscard]] error_or<upload_token> flush() noexcept;
+		[[nodiscard]] error_or<void> wait(upload_token token) noexcept;
+
+		[[nodiscard]] bool is_complete(upload_token const token) const noexcept
+		{
+			return token.value <= completed_;
+		}
+
+		// Lets a submission wait for the uploads on the device, rather than waiting for them on the host.
+		[[nodiscard]] semaphore_wait completion(
+		  upload_token const token,
+		  VkPipelineStageFlags const stages = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT) const noexcept
+		{
+			return {.semaphore = timeline_.get(), .value = token.value, .stages = stages};
+		}
+	private:
+		struct pending_copy {
+			VkBuffer destination;
+			VkBufferCopy region;
+		};
+
+		struct batch {
+			semaphore transferred; // Signalled by the copies, and waited on by the acquire.
+			std::uint64_t id;
+			std::uint64_t ring_end;
+
+			// Set when the copies were submitted but the acquire wasn't, which leaves transferred signalled forever.
+			bool poisoned = false;
+		};
+
+		device* device_;
+		queue_kind consumer_;
+		timeline_semaphore timeline_;
+		staging_ring ring_;
+		command_pool transfer_pool_;
+		command_pool acquire_pool_;
+		command_buffer transfers_;
+		command_buffer acquires_;
+		std::vector<batch> batches_;
+		std::vector<pending_copy> pending_;
+		std::uint32_t current_ = 0;
+		std::uint64_t next_id_ = 1;
+		std::uint64_t completed_ = 0;
+
+		upload_batcher(
+		  device&,
+		  queue_kind consumer,
+		  timeline_semaphore,
+		  staging_ring,
+		  command_pool transfer_pool,
+		  command_pool acquire_pool,
+		  command_buffer transfers,
+		  command_buffer acquires,
+		  std::vector<batch>) noexcept;
+
+		[[nodiscard]] bool hands_off() const noexcept
+		{
+			return device_->queue_family(queue_kind::transfer) != device_->queue_family(consumer_);
+		}
+
+		[[nodiscard]] error_or<void> record_acquires(std::span<VkBuffer const> destinations) noexcept;
+		[[nodiscard]] error_or<void>
+		submit_handoff(batch& current, std::uint64_t id, std::span<VkCommandBuffer const> copies) noexcept;
+
+		[[nodiscard]] error_or<void> retire(batch& b) noexcept;
+		[[nodiscard]] error_or<bool> retire_oldest() noexcept;
+	};
+
 	template<class T>
 	requires std::is_standard_layout_v<T> and std::is_trivially_copyable_v<T>
 	class buffer {
 		using buffer_handler = std::unique_ptr<VkBuffer_T, deleter<PFN_vkDestroyBuffer, VkDevice>>;
-		using memory_handler = std::unique_ptr<VkDeviceMemory_T, deleter<PFN_vkFreeMemory, VkDevice>>;
 	public:
 		[[nodiscard]] static error_or<buffer> create(
 		  device const& d,
+		  memory_allocator& memory,
 		  VkBufferUsageFlags const usage,
 		  VkMemoryPropertyFlags properties,
 		  VkDeviceSize size,
@@ -583,67 +2227,37 @@ namespace vulkan {
 
 			auto memory_requirements = VkMemoryRequirements{};
 			vkGetBufferMemoryRequirements(d.get(), buffer_resource, &memory_requirements);
-			auto const memory_type =
-			  find_memory_type(memory_requirements.memoryTypeBits, properties, d.physical_device().memory_properties);
-			if (memory_type == std::nullopt) {
-				return std::unexpected(error::no_device_memory);
+			auto slice = memory.allocate(memory_requirements, properties, resource_tiling::linear);
+			if (not slice) {
+				return std::unexpected(slice.error());
 			}
 
-			auto const alloc_info = VkMemoryAllocateInfo{
-			  .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-			  .pNext = nullptr,
-			  .allocationSize = memory_requirements.size,
-			  .memoryTypeIndex = *memory_type,
-			};
-
-			auto memory_resource = VkDeviceMemory{};
-			if (auto const result = vkAllocateMemory(d.get(), &alloc_info, alloc, &memory_resource); result != VK_SUCCESS) {
+			if (auto const result = vkBindBufferMemory(d.get(), buffer_resource, slice->memory(), slice->offset());
+			    result != VK_SUCCESS)
+			{
 				return std::unexpected(static_cast<error>(result));
 			}
 
-			auto m = memory_handler(memory_resource, {vkFreeMemory, d.get(), alloc});
-			if (auto const result = vkBindBufferMemory(d.get(), buffer_resource, memory_resource, 0); result != VK_SUCCESS) {
-				return std::unexpected(static_cast<error>(result));
-			}
-
-			return buffer{std::move(b), std::move(m)};
+			return buffer{std::move(b), std::move(*slice)};
 		}
 
-		[[nodiscard]] error_or<buffer> create(
+		[[nodiscard]] static error_or<buffer> create(
 		  device const& d,
+		  memory_allocator& memory,
+		  upload_batcher& uploads,
 		  std::span<T const> data,
+		  VkBufferUsageFlags const usage = default_buffer_usage<T>,
 		  VkAllocationCallbacks const* alloc = nullptr) noexcept
 		{
 			auto const size = static_cast<VkDeviceSize>(sizeof(T) * data.size());
-			return create(d,
-			              VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			              VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT data,
-			              alloc)
-			  .and_then([this, &d, data, alloc](buffer b) -> error_or<buffer> {
-				  auto device_data = static_cast<void*>(nullptr);
-				  if (auto const result = vkMapMemory(d.get(), b, 0, size, 0, &device_data); result != VK_SUCCESS) {
-					  return std::unexpected(static_cast<error>(result));
+			auto const destination_usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage;
+			return create(d, memory, destination_usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, size, alloc)
+			  .and_then([&uploads, data](buffer b) noexcept -> error_or<buffer> {
+				  if (auto const result = uploads.enqueue(b.get(), std::as_bytes(data)); not result) {
+					  return std::unexpected(result.error());
 				  }
 
-				  std::memcpy(device_data, data.data(), size);
-				  vkUnmapMemory(d.get(), b.device_memory_);
 				  return b;
-			  })
-			  .and_then([this, &d, alloc](buffer source) noexcept -> error_or<std::pair<buffer, buffer>> {
-				  auto dest = create(
-				    d,
-				    VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-				    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-				    size,
-				    alloc);
-				  if (not dest) {
-					  return std::unexpected(dest.error());
-				  }
-
-				  return std::make_pair(std::move(source, std::move(*dest)));
-			  })
-			  .and_then([](std::pair<buffer, buffer> data) -> error_or<buffer> {
-
 			  });
 		}
 
@@ -651,15 +2265,94 @@ namespace vulkan {
 		{
 			return buffer_.get();
 		}
+
+		[[nodiscard]] allocation const& memory() const noexcept
+		{
+			return memory_;
+		}
 	private:
 		buffer_handler buffer_;
-		memory_handler device_memory_;
+		allocation memory_;
 
-		buffer(buffer_handler b, memory_handler m) noexcept
+		buffer(buffer_handler b, allocation m) noexcept
 		: buffer_(std::move(b))
-		, device_memory_(std::move(m))
+		, memory_(std::move(m))
 		{}
 	};
+
+	template<index T>
+	void bind_index_buffer(VkCommandBuffer const command, buffer<T> const& indices, VkDeviceSize const offset = 0) noexcept
+	{
+		bind_index_buffer(command, indices.get(), index_type<T>, offset);
+	}
+
+	struct bounding_sphere {
+		float x;
+		float y;
+		float z;
+		float radius;
+	};
+
+	// Each plane is (a, b, c, d), and a point p is on the inside when a*p.x + b*p.y + c*p.z + d >= 0.
+	struct frustum {
+		std::array<std::array<float, 4>, 6> planes;
+
+		// view_projection is column-major, as glm stores it, and maps depth to Vulkan's [0, 1] range.
+		[[nodiscard]] static frustum from_view_projection(std::span<float const, 16> view_projection) noexcept;
+	};
+
+	// Culls objects against a frustum on the GPU, so that a whole scene is drawn with one indirect draw instead of a
+	// draw per object. Object i is bounds[i], a world-space bounding sphere, and draws[i], the command that draws it;
+	// both buffers need VK_BUFFER_USAGE_STORAGE_BUFFER_BIT. record() compacts the commands of the visible objects,
+	// which draw() then issues. The results are overwritten each time record() executes, so each frame in flight
+	// needs its own culler. Requires physical_device::draw_indirect_count.
+	class frustum_culler {
+	public:
+		[[nodiscard]] static error_or<frustum_culler> create(
+		  device const& d,
+		  memory_allocator& memory,
+		  pipeline_cache const& cache,
+		  buffer<bounding_sphere> const& bounds,
+		  buffer<VkDrawIndexedIndirectCommand> const& draws,
+		  std::uint32_t object_count,
+		  VkAllocationCallbacks const* allocator = nullptr) noexcept;
+
+		// Must be recorded outside of a render pass. Indirect draws recorded after it, on the same queue, see the
+		// results.
+		void record(VkCommandBuffer command, frustum const& view) const noexcept;
+
+		// Must be recorded inside a render pass, with the objects' index buffer bound.
+		void draw(VkCommandBuffer command) const noexcept;
+
+		[[nodiscard]] buffer<VkDrawIndexedIndirectCommand> const& visible_draws() const noexcept
+		{
+			return visible_draws_;
+		}
+
+		[[nodiscard]] buffer<std::uint32_t> const& visible_count() const noexcept
+		{
+			return visible_count_;
+		}
+	private:
+		descriptor_set_layout set_layout_;
+		descriptor_pool pool_;
+		VkDescriptorSet set_;
+		pipeline_layout layout_;
+		compute_pipeline pipeline_;
+		buffer<VkDrawIndexedIndirectCommand> visible_draws_;
+		buffer<std::uint32_t> visible_count_;
+		std::uint32_t object_count_;
+
+		frustum_culler(
+		  descriptor_set_layout set_layout,
+		  descriptor_pool pool,
+		  VkDescriptorSet set,
+		  pipeline_layout layout,
+		  compute_pipeline pipeline,
+		  buffer<VkDrawIndexedIndirectCommand> visible_draws,
+		  buffer<std::uint32_t> visible_count,
+		  std::uint32_t object_count) noexcept;
+	};
 } // namespace vulkan
 
 #endif // BUGGY_VULKAN_ERROR_HPP
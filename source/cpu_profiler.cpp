@@ -0,0 +1,168 @@
+#include "json.hpp"
+#include <algorithm>
+#include <atomic>
+#include <buggy/cpu_profiler.hpp>
+#include <chrono>
+#include <cstdint>
+#include <format>
+#include <iterator>
+#include <numeric>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace profiling {
+	void sample_ring::push(sample const& s) noexcept
+	{
+		auto const index = next_.fetch_add(1, std::memory_order_relaxed);
+		auto& slot = slots_[index % capacity];
+
+		// An odd sequence number marks a slot that's being written. A writer that laps the ring can reach a slot while
+		// an older generation is still writing it, so the slot is claimed rather than overwritten: the older writer
+		// is waited out, and a sample that's already been superseded by a newer generation is dropped.
+		auto const writing = 2 * index + 1;
+		auto current = slot.sequence.load(std::memory_order_relaxed);
+		for (;;) {
+			if (current > writing) {
+				return;
+			}
+
+			if (current % 2 == 1) {
+				std::this_thread::yield();
+				current = slot.sequence.load(std::memory_order_relaxed);
+			}
+			else if (slot.sequence.compare_exchange_weak(
+			           current,
+			           writing,
+			           std::memory_order_acquire,
+			           std::memory_order_relaxed))
+			{
+				break;
+			}
+		}
+		std::atomic_thread_fence(std::memory_order_release);
+		slot.phase.store(s.phase.data(), std::memory_order_relaxed);
+		slot.phase_size.store(s.phase.size(), std::memory_order_relaxed);
+		slot.start.store(s.start.time_since_epoch().count(), std::memory_order_relaxed);
+		slot.duration.store(s.duration.count(), std::memory_order_relaxed);
+		slot.thread.store(s.thread, std::memory_order_relaxed);
+		slot.sequence.store(2 * index + 2, std::memory_order_release);
+	}
+
+	std::vector<sample> sample_ring::snapshot() const
+	{
+		auto const end = next_.load(std::memory_order_acquire);
+		auto const begin = end > capacity ? end - capacity : 0;
+		auto result = std::vector<sample>();
+		result.reserve(end - begin);
+		for (auto i = begin; i < end; ++i) {
+			auto const& slot = slots_[i % capacity];
+			auto const written = 2 * i + 2;
+			if (slot.sequence.load(std::memory_order_acquire) != written) {
+				continue;
+			}
+
+			auto const value = sample{
+			  .phase = {slot.phase.load(std::memory_order_relaxed), slot.phase_size.load(std::memory_order_relaxed)},
+			  .start = clock::time_point(clock::duration(slot.start.load(std::memory_order_relaxed))),
+			  .duration = std::chrono::nanoseconds(slot.duration.load(std::memory_order_relaxed)),
+			  .thread = slot.thread.load(std::memory_order_relaxed),
+			};
+
+			// The slot was overwritten while it was being read.
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (slot.sequence.load(std::memory_order_relaxed) != written) {
+				continue;
+			}
+
+			result.push_back(value);
+		}
+
+		return result;
+	}
+
+	sample_ring& samples() noexcept
+	{
+		static auto ring = sample_ring();
+		return ring;
+	}
+
+	std::uint32_t thread_index() noexcept
+	{
+		static auto next = std::atomic<std::uint32_t>(0);
+		thread_local auto const index = next.fetch_add(1, std::memory_order_relaxed);
+		return index;
+	}
+
+	std::vector<phase_summary> summarise(std::span<sample const> const samples)
+	{
+		auto phases = std::vector<std::pair<std::string_view, std::vector<std::chrono::nanoseconds>>>();
+		for (auto const& s : samples) {
+			auto const phase = std::ranges::find(phases, s.phase, &decltype(phases)::value_type::first);
+			if (phase == phases.end()) {
+				phases.emplace_back(s.phase, std::vector{s.duration});
+			}
+			else {
+				phase->second.push_back(s.duration);
+			}
+		}
+
+		auto result = std::vector<phase_summary>();
+		result.reserve(phases.size());
+		for (auto& [phase, durations] : phases) {
+			std::ranges::sort(durations);
+
+			// Nearest-rank percentiles.
+			auto const percentile = [&durations](std::size_t const p) noexcept {
+				auto const rank = (p * durations.size() + 99) / 100;
+				return durations[std::max(rank, std::size_t{1}) - 1];
+			};
+
+			auto const total = std::accumulate(durations.begin(), durations.end(), std::chrono::nanoseconds());
+			result.push_back(phase_summary{
+			  .phase = phase,
+			  .count = durations.size(),
+			  .mean = total / static_cast<std::chrono::nanoseconds::rep>(durations.size()),
+			  .p50 = percentile(50),
+			  .p90 = percentile(90),
+			  .p99 = percentile(99),
+			  .max = durations.back(),
+			});
+		}
+
+		return result;
+	}
+
+	std::string chrome_trace(std::span<sample const> const samples)
+	{
+		auto trace = std::string(R"({"displayTimeUnit":"ms","traceEvents":[)");
+		if (samples.empty()) {
+			return trace + "]}";
+		}
+
+		// Chrome traces are measured in microseconds, which are made relative to the earliest sample.
+		auto const origin = std::ranges::min(samples, {}, &sample::start).start;
+		auto const microseconds = [](clock::duration const d) noexcept {
+			return std::chrono::duration<double, std::micro>(d).count();
+		};
+
+		auto separator = std::string_view();
+		for (auto const& s : samples) {
+			std::format_to(
+			  std::back_inserter(trace),
+			  R"({}{{"name":"{}","cat":"cpu","ph":"X","pid":0,"tid":{},"ts":{:.3f},"dur":{:.3f}}})",
+			  separator,
+			  json::escape(s.phase),
+			  s.thread,
+			  microseconds(s.start - origin),
+			  microseconds(s.duration));
+			separator = ",";
+		}
+
+		trace += "]}";
+		return trace;
+	}
+} // namespace profiling
@@ -0,0 +1,69 @@
+#include <algorithm>
+#include <buggy/job_system.hpp>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace jobs {
+	std::uint32_t hardware_threads() noexcept
+	{
+		return std::max(std::thread::hardware_concurrency(), 1u);
+	}
+
+	thread_pool::thread_pool(std::uint32_t const threads)
+	{
+		workers_.reserve(threads);
+		for (auto i = std::uint32_t{0}; i < threads; ++i) {
+			workers_.emplace_back([this] { work(); });
+		}
+	}
+
+	thread_pool::~thread_pool()
+	{
+		{
+			auto const lock = std::lock_guard(mutex_);
+			stopping_ = true;
+		}
+		work_available_.notify_all();
+	}
+
+	void thread_pool::run(std::uint32_t const count, std::function<void(std::uint32_t)> const& job) noexcept
+	{
+		if (count == 0) {
+			return;
+		}
+
+		auto lock = std::unique_lock(mutex_);
+		job_ = &job;
+		next_ = 0;
+		count_ = count;
+		remaining_ = count;
+		work_available_.notify_all();
+		work_done_.wait(lock, [this] { return remaining_ == 0; });
+
+		job_ = nullptr;
+		count_ = 0;
+	}
+
+	void thread_pool::work() noexcept
+	{
+		auto lock = std::unique_lock(mutex_);
+		while (true) {
+			work_available_.wait(lock, [this] { return stopping_ or next_ < count_; });
+			if (stopping_) {
+				return;
+			}
+
+			auto const index = next_++;
+			auto const& job = *job_;
+			lock.unlock();
+			job(index);
+			lock.lock();
+
+			if (--remaining_ == 0) {
+				work_done_.notify_all();
+			}
+		}
+	}
+} // namespace jobs
@@ -0,0 +1,38 @@
+#ifndef BUGGY_SOURCE_JSON_HPP
+#define BUGGY_SOURCE_JSON_HPP
+
+#include <format>
+#include <iterator>
+#include <string>
+#include <string_view>
+
+// Shared by the CPU and GPU profilers' Chrome trace exports.
+namespace json {
+	// Escapes text so that it can be written between double quotes.
+	[[nodiscard]] inline std::string escape(std::string_view const text)
+	{
+		auto result = std::string();
+		result.reserve(text.size());
+		for (auto const c : text) {
+			switch (c) {
+			case '"':
+				result += R"(\")";
+				break;
+			case '\\':
+				result += R"(\\)";
+				break;
+			default:
+				if (static_cast<unsigned char>(c) < 0x20) {
+					std::format_to(std::back_inserter(result), "\\u{:04x}", static_cast<unsigned>(c));
+				}
+				else {
+					result += c;
+				}
+			}
+		}
+
+		return result;
+	}
+} // namespace json
+
+#endif // BUGGY_SOURCE_JSON_HPP
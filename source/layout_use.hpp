@@ -0,0 +1,43 @@
+#ifndef BUGGY_SOURCE_LAYOUT_USE_HPP
+#define BUGGY_SOURCE_LAYOUT_USE_HPP
+
+#include <vulkan/vulkan.h>
+
+// Shared by the render passes, dynamic rendering and the render graph, which all hand images off in a final layout.
+namespace vulkan {
+	struct layout_use {
+		VkPipelineStageFlags stages;
+		VkAccessFlags access;
+	};
+
+	// How an image is expected to be used once it's in layout. Presentation is ordered by the semaphore that the
+	// submission signals, so it needs no access; layouts that don't imply a use are assumed to be used by anything.
+	[[nodiscard]] inline layout_use next_use(VkImageLayout const layout) noexcept
+	{
+		switch (layout) {
+		case VK_IMAGE_LAYOUT_PRESENT_SRC_KHR:
+			return {.stages = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, .access = 0};
+		case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL:
+			return {.stages = VK_PIPELINE_STAGE_TRANSFER_BIT, .access = VK_ACCESS_TRANSFER_READ_BIT};
+		case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:
+			return {.stages = VK_PIPELINE_STAGE_TRANSFER_BIT, .access = VK_ACCESS_TRANSFER_WRITE_BIT};
+		case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:
+			return {
+			  .stages = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			  .access = VK_ACCESS_SHADER_READ_BIT,
+			};
+		case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL:
+			return {
+			  .stages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			  .access = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+			};
+		default:
+			return {
+			  .stages = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+			  .access = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT,
+			};
+		}
+	}
+} // namespace vulkan
+
+#endif // BUGGY_SOURCE_LAYOUT_USE_HPP
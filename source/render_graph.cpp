@@ -0,0 +1,1050 @@
+#include "layout_use.hpp"
+#include <algorithm>
+#include <buggy/render_graph.hpp>
+#include <buggy/vulkan.hpp>
+#include <cjdb/contracts.hpp>
+#include <cstdint>
+#include <expected>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <ranges>
+#include <span>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+namespace vulkan {
+	struct access_info {
+		VkImageLayout layout;
+		VkPipelineStageFlags stages;
+		VkAccessFlags access;
+		VkImageUsageFlags usage;
+		bool attachment;
+		bool writes;
+	};
+
+	[[nodiscard]] static constexpr access_info describe(image_access const access) noexcept
+	{
+		constexpr auto depth_tests = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		constexpr auto storage_stages = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		switch (access) {
+		case image_access::colour_attachment:
+			return {
+			  .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+			  .stages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			  .access = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+			  .usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+			  .attachment = true,
+			  .writes = true,
+			};
+		case image_access::depth_attachment:
+			return {
+			  .layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+			  .stages = depth_tests,
+			  .access = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+			  .usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+			  .attachment = true,
+			  .writes = true,
+			};
+		case image_access::depth_read:
+			return {
+			  .layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+			  .stages = depth_tests,
+			  .access = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT,
+			  .usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+			  .attachment = true,
+			  .writes = false,
+			};
+		case image_access::input_attachment:
+			return {
+			  .layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			  .stages = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			  .access = VK_ACCESS_INPUT_ATTACHMENT_READ_BIT,
+			  .usage = VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT,
+			  .attachment = true,
+			  .writes = false,
+			};
+		case image_access::sampled_fragment:
+			return {
+			  .layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			  .stages = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			  .access = VK_ACCESS_SHADER_READ_BIT,
+			  .usage = VK_IMAGE_USAGE_SAMPLED_BIT,
+			  .attachment = false,
+			  .writes = false,
+			};
+		case image_access::sampled_compute:
+			return {
+			  .layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			  .stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			  .access = VK_ACCESS_SHADER_READ_BIT,
+			  .usage = VK_IMAGE_USAGE_SAMPLED_BIT,
+			  .attachment = false,
+			  .writes = false,
+			};
+		case image_access::storage_read:
+			return {
+			  .layout = VK_IMAGE_LAYOUT_GENERAL,
+			  .stages = storage_stages,
+			  .access = VK_ACCESS_SHADER_READ_BIT,
+			  .usage = VK_IMAGE_USAGE_STORAGE_BIT,
+			  .attachment = false,
+			  .writes = false,
+			};
+		case image_access::storage_write:
+			return {
+			  .layout = VK_IMAGE_LAYOUT_GENERAL,
+			  .stages = storage_stages,
+			  .access = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+			  .usage = VK_IMAGE_USAGE_STORAGE_BIT,
+			  .attachment = false,
+			  .writes = true,
+			};
+		case image_access::transfer_read:
+			return {
+			  .layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			  .stages = VK_PIPELINE_STAGE_TRANSFER_BIT,
+			  .access = VK_ACCESS_TRANSFER_READ_BIT,
+			  .usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+			  .attachment = false,
+			  .writes = false,
+			};
+		case image_access::transfer_write:
+			return {
+			  .layout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			  .stages = VK_PIPELINE_STAGE_TRANSFER_BIT,
+			  .access = VK_ACCESS_TRANSFER_WRITE_BIT,
+			  .usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+			  .attachment = false,
+			  .writes = true,
+			};
+		}
+
+		std::unreachable();
+	}
+
+	constexpr auto write_access = VkAccessFlags{
+	  VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT
+	  | VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT};
+
+	// Cleared attachments don't depend on anything that was written before them.
+	[[nodiscard]] static bool overwrites(image_use const& use) noexcept
+	{
+		auto const info = describe(use.access);
+		return info.attachment and info.writes and use.clear.has_value();
+	}
+
+	[[nodiscard]] static bool has_stencil(VkFormat const format) noexcept
+	{
+		switch (format) {
+		case VK_FORMAT_S8_UINT:
+		case VK_FORMAT_D16_UNORM_S8_UINT:
+		case VK_FORMAT_D24_UNORM_S8_UINT:
+		case VK_FORMAT_D32_SFLOAT_S8_UINT:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	[[nodiscard]] static VkImageAspectFlags aspect(VkFormat const format) noexcept
+	{
+		switch (format) {
+		case VK_FORMAT_D16_UNORM:
+		case VK_FORMAT_X8_D24_UNORM_PACK32:
+		case VK_FORMAT_D32_SFLOAT:
+			return VK_IMAGE_ASPECT_DEPTH_BIT;
+		case VK_FORMAT_S8_UINT:
+			return VK_IMAGE_ASPECT_STENCIL_BIT;
+		case VK_FORMAT_D16_UNORM_S8_UINT:
+		case VK_FORMAT_D24_UNORM_S8_UINT:
+		case VK_FORMAT_D32_SFLOAT_S8_UINT:
+			return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+		default:
+			return VK_IMAGE_ASPECT_COLOR_BIT;
+		}
+	}
+
+	[[nodiscard]] static VkImageSubresourceRange whole_image(VkFormat const format) noexcept
+	{
+		return {
+		  .aspectMask = aspect(format),
+		  .baseMipLevel = 0,
+		  .levelCount = 1,
+		  .baseArrayLayer = 0,
+		  .layerCount = 1,
+		};
+	}
+
+	error_or<render_graph> render_graph::create(
+	  device const& d,
+	  memory_allocator& memory,
+	  VkAllocationCallbacks const* const alloc) noexcept
+	{
+		return render_graph(d, memory, alloc);
+	}
+
+	render_graph::render_graph(
+	  device const& d,
+	  memory_allocator& memory,
+	  VkAllocationCallbacks const* const alloc) noexcept
+	: device_(&d)
+	, memory_allocator_(&memory)
+	, allocator_(alloc)
+	{}
+
+	graph_image render_graph::create_image(image_info const& info) noexcept
+	{
+		CJDB_EXPECTS(not compiled_);
+		auto& image = images_.emplace_back();
+		image.name = info.name;
+		image.format = info.format;
+		image.extent = info.extent;
+		return graph_image{static_cast<std::uint32_t>(images_.size() - 1)};
+	}
+
+	graph_image render_graph::import_image(
+	  image_info const& info,
+	  VkImage const image,
+	  VkImageView const view,
+	  VkImageLayout const initial_layout,
+	  VkImageLayout const final_layout) noexcept
+	{
+		auto const result = create_image(info);
+		auto& imported = images_.back();
+		imported.image = image;
+		imported.view = view;
+		imported.imported = true;
+		imported.initial_layout = initial_layout;
+		imported.final_layout = final_layout;
+		return result;
+	}
+
+	graph_pass render_graph::add_pass(
+	  std::string_view const name,
+	  std::span<image_use const> const uses,
+	  execute_fn const execute,
+	  void* const context) noexcept
+	{
+		CJDB_EXPECTS(not compiled_);
+		auto const image_index = [](image_use const& use) noexcept { return use.image.index; };
+		auto const is_attachment = [](image_use const& use) noexcept { return describe(use.access).attachment; };
+		auto const is_depth = [](image_use const& use) noexcept {
+			return use.access == image_access::depth_attachment or use.access == image_access::depth_read;
+		};
+
+		auto attachment_extent = std::optional<VkExtent2D>();
+		for (auto const& use : uses) {
+			CJDB_EXPECTS(use.image.index < images_.size());
+			CJDB_EXPECTS(std::ranges::count(uses, use.image.index, image_index) == 1);
+			if (is_attachment(use)) {
+				auto const extent = images_[use.image.index].extent;
+				CJDB_EXPECTS(
+				  not attachment_extent
+				  or (attachment_extent->width == extent.width and attachment_extent->height == extent.height));
+				attachment_extent = extent;
+			}
+		}
+		CJDB_EXPECTS(std::ranges::count_if(uses, is_depth) <= 1);
+
+		auto& pass = passes_.emplace_back();
+		pass.name = name;
+		pass.uses.assign(uses.begin(), uses.end());
+		pass.execute = execute;
+		pass.context = context;
+		pass.draws = attachment_extent.has_value();
+		return graph_pass{static_cast<std::uint32_t>(passes_.size() - 1)};
+	}
+
+	error_or<void> render_graph::compile() noexcept
+	{
+		compiled_ = false;
+		reset();
+		cull();
+		merge();
+
+		if (auto const result = create_images(); not result) {
+			return result;
+		}
+
+		for (auto i = std::uint32_t{0}; i < steps_.size(); ++i) {
+			if (not steps_[i].draws) {
+				continue;
+			}
+
+			if (auto const result = create_render_pass(i); not result) {
+				return result;
+			}
+			++statistics_.render_passes;
+		}
+
+		schedule_barriers();
+		statistics_.passes = static_cast<std::uint32_t>(passes_.size());
+		compiled_ = true;
+		return {};
+	}
+
+	// Destroys the framebuffers before the views and render passes that they were created with, and the images before
+	// their memory.
+	void render_graph::reset() noexcept
+	{
+		steps_.clear();
+		render_passes_.clear();
+		owned_views_.clear();
+		owned_images_.clear();
+		memory_.clear();
+		final_barriers_.clear();
+		final_barrier_images_.clear();
+		final_src_stages_ = 0;
+		final_dst_stages_ = 0;
+		statistics_ = {};
+
+		for (auto& image : images_) {
+			if (not image.imported) {
+				image.image = VK_NULL_HANDLE;
+				image.view = VK_NULL_HANDLE;
+			}
+			image.usage = 0;
+			image.lazily_allocated = false;
+			image.first_step = unused;
+			image.last_step = unused;
+			image.alias_of = unused;
+		}
+
+		for (auto& pass : passes_) {
+			pass.culled = false;
+			pass.step = unused;
+			pass.subpass = 0;
+		}
+	}
+
+	// Walks the passes backwards, keeping only those that write something that an imported image depends on.
+	void render_graph::cull() noexcept
+	{
+		auto needed = std::vector<bool>(images_.size());
+		for (auto i = std::size_t{0}; i < images_.size(); ++i) {
+			needed[i] = images_[i].imported;
+		}
+
+		for (auto& pass : passes_ | std::views::reverse) {
+			pass.culled = std::ranges::none_of(pass.uses, [&needed](image_use const& use) {
+				return describe(use.access).writes and needed[use.image.index];
+			});
+			if (pass.culled) {
+				++statistics_.culled_passes;
+				continue;
+			}
+
+			for (auto const& use : pass.uses) {
+				needed[use.image.index] = not overwrites(use);
+			}
+		}
+	}
+
+	// A drawing pass becomes another subpass of the previous step when it has the same extent, and every image that
+	// the two share is either an attachment in both, or only read at the same layout in both. Anything else needs a
+	// barrier that can't be expressed inside a render pass. Attachments are only cleared when their render pass begins,
+	// so a pass that clears an attachment that the step already uses starts a new one.
+	void render_graph::merge() noexcept
+	{
+		auto const pass_extent = [this](pass_node const& pass) noexcept {
+			auto const attachment =
+			  std::ranges::find_if(pass.uses, [](image_use const& use) { return describe(use.access).attachment; });
+			return images_[attachment->image.index].extent;
+		};
+
+		auto const compatible = [](image_use const& a, image_use const& b) noexcept {
+			auto const x = describe(a.access);
+			auto const y = describe(b.access);
+			if (x.attachment or y.attachment) {
+				return x.attachment and y.attachment and not overwrites(b);
+			}
+
+			return not x.writes and not y.writes and x.layout == y.layout;
+		};
+
+		auto const can_merge = [&, this](step const& s, pass_node const& pass) noexcept {
+			if (not s.draws or not pass.draws) {
+				return false;
+			}
+
+			auto const extent = pass_extent(pass);
+			if (extent.width != s.extent.width or extent.height != s.extent.height) {
+				return false;
+			}
+
+			return std::ranges::all_of(s.passes, [&](std::uint32_t const merged) {
+				return std::ranges::all_of(passes_[merged].uses, [&](image_use const& a) {
+					return std::ranges::all_of(pass.uses, [&](image_use const& b) {
+						return a.image.index != b.image.index or compatible(a, b);
+					});
+				});
+			});
+		};
+
+		for (auto i = std::uint32_t{0}; i < passes_.size(); ++i) {
+			auto& pass = passes_[i];
+			if (pass.culled) {
+				continue;
+			}
+
+			if (steps_.empty() or not can_merge(steps_.back(), pass)) {
+				auto& s = steps_.emplace_back();
+				s.draws = pass.draws;
+				s.extent = pass.draws ? pass_extent(pass) : VkExtent2D{};
+			}
+
+			pass.step = static_cast<std::uint32_t>(steps_.size() - 1);
+			pass.subpass = static_cast<std::uint32_t>(steps_.back().passes.size());
+			steps_.back().passes.push_back(i);
+		}
+	}
+
+	[[nodiscard]] static error_or<std::unique_ptr<VkImageView_T, deleter<PFN_vkDestroyImageView, VkDevice>>> create_view(
+	  device const& d,
+	  VkImage const image,
+	  VkFormat const format,
+	  VkAllocationCallbacks const* const alloc) noexcept
+	{
+		auto const create_info = VkImageViewCreateInfo{
+		  .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+		  .pNext = nullptr,
+		  .flags = {},
+		  .image = image,
+		  .viewType = VK_IMAGE_VIEW_TYPE_2D,
+		  .format = format,
+		  .components =
+		    VkComponentMapping{
+		      .r = VK_COMPONENT_SWIZZLE_IDENTITY,
+		      .g = VK_COMPONENT_SWIZZLE_IDENTITY,
+		      .b = VK_COMPONENT_SWIZZLE_IDENTITY,
+		      .a = VK_COMPONENT_SWIZZLE_IDENTITY,
+		    },
+		  .subresourceRange = whole_image(format),
+		};
+
+		auto resource = VkImageView{};
+		if (auto const result = vkCreateImageView(d.get(), &create_info, alloc, &resource); result != VK_SUCCESS) {
+			return std::unexpected(static_cast<error>(result));
+		}
+
+		return std::unique_ptr<VkImageView_T, deleter<PFN_vkDestroyImageView, VkDevice>>(
+		  resource,
+		  {vkDestroyImageView, d.get(), alloc});
+	}
+
+	// Transient images that are only ever attachments of a single render pass never need to be written to memory, so
+	// they're lazily allocated when the device allows it. The rest are packed into as few memory slots as possible:
+	// largest first, each image goes into the first slot whose current users' lifetimes don't overlap its own.
+	error_or<void> render_graph::create_images() noexcept
+	{
+		for (auto i = std::uint32_t{0}; i < steps_.size(); ++i) {
+			for (auto const pass : steps_[i].passes) {
+				for (auto const& use : passes_[pass].uses) {
+					auto& image = images_[use.image.index];
+					image.first_step = std::min(image.first_step, i);
+					image.last_step = i;
+					image.usage |= describe(use.access).usage;
+				}
+			}
+		}
+
+		constexpr auto attachment_usage = VkImageUsageFlags{
+		  VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT
+		  | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT};
+		constexpr auto transient_usage = VkImageUsageFlags{VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT};
+		for (auto& image : images_) {
+			image.lazily_allocated = not image.imported and image.first_step != unused
+			                     and image.first_step == image.last_step and (image.usage & ~attachment_usage) == 0;
+		}
+
+		struct candidate {
+			std::uint32_t image;
+			VkMemoryRequirements requirements;
+		};
+		auto candidates = std::vector<candidate>();
+
+		auto const d = device_->get();
+		for (auto i = std::uint32_t{0}; i < images_.size(); ++i) {
+			auto& image = images_[i];
+			if (image.imported or image.first_step == unused) {
+				continue;
+			}
+
+			auto const create_info = VkImageCreateInfo{
+			  .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+			  .pNext = nullptr,
+			  .flags = {},
+			  .imageType = VK_IMAGE_TYPE_2D,
+			  .format = image.format,
+			  .extent = VkExtent3D{.width = image.extent.width, .height = image.extent.height, .depth = 1},
+			  .mipLevels = 1,
+			  .arrayLayers = 1,
+			  .samples = VK_SAMPLE_COUNT_1_BIT,
+			  .tiling = VK_IMAGE_TILING_OPTIMAL,
+			  .usage = image.usage | (image.lazily_allocated ? transient_usage : VkImageUsageFlags{0}),
+			  .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+			  .queueFamilyIndexCount = {},
+			  .pQueueFamilyIndices = {},
+			  .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+			};
+
+			auto raw_image = VkImage{};
+			if (auto const result = vkCreateImage(d, &create_info, allocator_, &raw_image); result != VK_SUCCESS) {
+				return std::unexpected(static_cast<error>(result));
+			}
+			owned_images_.emplace_back(raw_image, deleter<PFN_vkDestroyImage, VkDevice>{vkDestroyImage, d, allocator_});
+			image.image = raw_image;
+			++statistics_.transient_images;
+
+			auto requirements = VkMemoryRequirements{};
+			vkGetImageMemoryRequirements(d, raw_image, &requirements);
+			if (image.lazily_allocated) {
+				auto memory = memory_allocator_->allocate(
+				  requirements,
+				  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT,
+				  resource_tiling::optimal);
+				if (memory) {
+					if (auto const result = vkBindImageMemory(d, raw_image, memory->memory(), memory->offset());
+					    result != VK_SUCCESS)
+					{
+						return std::unexpected(static_cast<error>(result));
+					}
+
+					memory_.push_back(std::move(*memory));
+					++statistics_.lazily_allocated_images;
+					continue;
+				}
+
+				if (memory.error() != error::no_device_memory) {
+					return std::unexpected(memory.error());
+				}
+				image.lazily_allocated = false;
+			}
+
+			candidates.push_back(candidate{.image = i, .requirements = requirements});
+			statistics_.unaliased_memory += requirements.size;
+		}
+
+		struct memory_slot {
+			VkMemoryRequirements requirements;
+			std::vector<std::uint32_t> images;
+		};
+		auto slots = std::vector<memory_slot>();
+
+		std::ranges::stable_sort(candidates, std::ranges::greater{}, [](candidate const& c) {
+			return c.requirements.size;
+		});
+		for (auto const& [index, requirements] : candidates) {
+			auto const& image = images_[index];
+			auto const disjoint = [this, &image](std::uint32_t const other) {
+				return image.last_step < images_[other].first_step or images_[other].last_step < image.first_step;
+			};
+			auto slot = std::ranges::find_if(slots, [&](memory_slot const& s) {
+				return (s.requirements.memoryTypeBits & requirements.memoryTypeBits) != 0
+				   and std::ranges::all_of(s.images, disjoint);
+			});
+			if (slot == slots.end()) {
+				slots.push_back(memory_slot{.requirements = requirements, .images = {index}});
+				continue;
+			}
+
+			slot->requirements.size = std::max(slot->requirements.size, requirements.size);
+			slot->requirements.alignment = std::max(slot->requirements.alignment, requirements.alignment);
+			slot->requirements.memoryTypeBits &= requirements.memoryTypeBits;
+			slot->images.push_back(index);
+		}
+
+		for (auto const& slot : slots) {
+			auto memory =
+			  memory_allocator_->allocate(slot.requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, resource_tiling::optimal);
+			if (not memory) {
+				return std::unexpected(memory.error());
+			}
+
+			for (auto const index : slot.images) {
+				auto& image = images_[index];
+				if (auto const result = vkBindImageMemory(d, image.image, memory->memory(), memory->offset());
+				    result != VK_SUCCESS)
+				{
+					return std::unexpected(static_cast<error>(result));
+				}
+
+				// The barrier for the image's first use needs to wait on whichever image last used its memory.
+				for (auto const other : slot.images) {
+					auto const last_step = images_[other].last_step;
+					if (last_step < image.first_step
+					    and (image.alias_of == unused or images_[image.alias_of].last_step < last_step))
+					{
+						image.alias_of = other;
+					}
+				}
+			}
+
+			statistics_.transient_memory += slot.requirements.size;
+			memory_.push_back(std::move(*memory));
+		}
+
+		for (auto& image : images_) {
+			if (image.imported or image.first_step == unused) {
+				continue;
+			}
+
+			auto view = create_view(*device_, image.image, image.format, allocator_);
+			if (not view) {
+				return std::unexpected(view.error());
+			}
+
+			image.view = view->get();
+			owned_views_.push_back(std::move(*view));
+		}
+
+		return {};
+	}
+
+	// Each subpass uses its attachments at the layouts that their accesses need, so the render pass begins with every
+	// attachment in its first layout and ends with it in its last: the transitions into and out of the render pass are
+	// pipeline barriers, like every other step.
+	error_or<void> render_graph::create_render_pass(std::uint32_t const step_index) noexcept
+	{
+		auto& s = steps_[step_index];
+		auto const subpass_count = s.passes.size();
+
+		struct attachment_use {
+			std::uint32_t subpass;
+			image_use use;
+		};
+		auto uses = std::vector<std::vector<attachment_use>>();
+		for (auto subpass = std::uint32_t{0}; subpass < subpass_count; ++subpass) {
+			for (auto const& use : passes_[s.passes[subpass]].uses) {
+				if (not describe(use.access).attachment) {
+					continue;
+				}
+
+				auto const attachment =
+				  static_cast<std::size_t>(std::ranges::find(s.attachments, use.image.index) - s.attachments.begin());
+				if (attachment == s.attachments.size()) {
+					s.attachments.push_back(use.image.index);
+					uses.emplace_back();
+				}
+				uses[attachment].push_back({subpass, use});
+			}
+		}
+
+		auto attachments = std::vector<VkAttachmentDescription>();
+		attachments.reserve(s.attachments.size());
+		s.clear_values.reserve(s.attachments.size());
+		for (auto i = std::size_t{0}; i < s.attachments.size(); ++i) {
+			auto const& image = images_[s.attachments[i]];
+			auto const& first = uses[i].front().use;
+			auto const defined =
+			  image.first_step < step_index or (image.imported and image.initial_layout != VK_IMAGE_LAYOUT_UNDEFINED);
+			auto const load = overwrites(first) ? VK_ATTACHMENT_LOAD_OP_CLEAR
+			                : defined          ? VK_ATTACHMENT_LOAD_OP_LOAD
+			                                   : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+			auto const store = image.imported or image.last_step > step_index ? VK_ATTACHMENT_STORE_OP_STORE
+			                                                                  : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			auto const stencil = has_stencil(image.format);
+			attachments.push_back(VkAttachmentDescription{
+			  .flags = {},
+			  .format = image.format,
+			  .samples = VK_SAMPLE_COUNT_1_BIT,
+			  .loadOp = load,
+			  .storeOp = store,
+			  .stencilLoadOp = stencil ? load : VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+			  .stencilStoreOp = stencil ? store : VK_ATTACHMENT_STORE_OP_DONT_CARE,
+			  .initialLayout = describe(first.access).layout,
+			  .finalLayout = describe(uses[i].back().use.access).layout,
+			});
+			s.clear_values.push_back(first.clear.value_or(VkClearValue{}));
+		}
+
+		auto colour_references = std::vector<std::vector<VkAttachmentReference>>(subpass_count);
+		auto input_references = std::vector<std::vector<VkAttachmentReference>>(subpass_count);
+		auto depth_references = std::vector<std::optional<VkAttachmentReference>>(subpass_count);
+		auto preserved = std::vector<std::vector<std::uint32_t>>(subpass_count);
+		auto dependencies = std::vector<VkSubpassDependency>();
+		for (auto i = std::uint32_t{0}; i < s.attachments.size(); ++i) {
+			for (auto const& [subpass, use] : uses[i]) {
+				auto const reference = VkAttachmentReference{.attachment = i, .layout = describe(use.access).layout};
+				switch (use.access) {
+				case image_access::colour_attachment:
+					colour_references[subpass].push_back(reference);
+					break;
+				case image_access::input_attachment:
+					input_references[subpass].push_back(reference);
+					break;
+				default:
+					depth_references[subpass] = reference;
+				}
+			}
+
+			// Contents that a later subpass needs are preserved through the subpasses that don't use them.
+			for (auto subpass = uses[i].front().subpass + 1; subpass < uses[i].back().subpass; ++subpass) {
+				if (std::ranges::none_of(uses[i], [subpass](attachment_use const& u) { return u.subpass == subpass; })) {
+					preserved[subpass].push_back(i);
+				}
+			}
+
+			for (auto const& [from, to] : uses[i] | std::views::adjacent<2>) {
+				auto const src = describe(from.use.access);
+				auto const dst = describe(to.use.access);
+				auto dependency = std::ranges::find_if(dependencies, [&](VkSubpassDependency const& d) {
+					return d.srcSubpass == from.subpass and d.dstSubpass == to.subpass;
+				});
+				if (dependency == dependencies.end()) {
+					dependencies.push_back(VkSubpassDependency{
+					  .srcSubpass = from.subpass,
+					  .dstSubpass = to.subpass,
+					  .srcStageMask = 0,
+					  .dstStageMask = 0,
+					  .srcAccessMask = 0,
+					  .dstAccessMask = 0,
+					  .dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT,
+					});
+					dependency = std::prev(dependencies.end());
+				}
+				dependency->srcStageMask |= src.stages;
+				dependency->dstStageMask |= dst.stages;
+				dependency->srcAccessMask |= src.access & write_access;
+				dependency->dstAccessMask |= dst.access;
+			}
+		}
+
+		auto subpasses = std::vector<VkSubpassDescription>();
+		subpasses.reserve(subpass_count);
+		for (auto i = std::size_t{0}; i < subpass_count; ++i) {
+			subpasses.push_back(VkSubpassDescription{
+			  .flags = {},
+			  .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+			  .inputAttachmentCount = static_cast<std::uint32_t>(input_references[i].size()),
+			  .pInputAttachments = input_references[i].data(),
+			  .colorAttachmentCount = static_cast<std::uint32_t>(colour_references[i].size()),
+			  .pColorAttachments = colour_references[i].data(),
+			  .pResolveAttachments = nullptr,
+			  .pDepthStencilAttachment = depth_references[i] ? &*depth_references[i] : nullptr,
+			  .preserveAttachmentCount = static_cast<std::uint32_t>(preserved[i].size()),
+			  .pPreserveAttachments = preserved[i].data(),
+			});
+		}
+
+		auto const render_pass_info = VkRenderPassCreateInfo{
+		  .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+		  .pNext = nullptr,
+		  .flags = {},
+		  .attachmentCount = static_cast<std::uint32_t>(attachments.size()),
+		  .pAttachments = attachments.data(),
+		  .subpassCount = static_cast<std::uint32_t>(subpasses.size()),
+		  .pSubpasses = subpasses.data(),
+		  .dependencyCount = static_cast<std::uint32_t>(dependencies.size()),
+		  .pDependencies = dependencies.data(),
+		};
+
+		auto resource = VkRenderPass{};
+		if (auto const result = vkCreateRenderPass(device_->get(), &render_pass_info, allocator_, &resource);
+		    result != VK_SUCCESS)
+		{
+			return std::unexpected(static_cast<error>(result));
+		}
+
+		render_passes_.emplace_back(
+		  resource,
+		  deleter<PFN_vkDestroyRenderPass, VkDevice>{vkDestroyRenderPass, device_->get(), allocator_});
+		s.render_pass = resource;
+		return {};
+	}
+
+	// Replays the steps while tracking each image's layout, its last write, and the reads since then. A barrier is only
+	// placed before a step when an image changes layout, is written after being read or written, or is read by a
+	// stage or access that the last write hasn't been made visible to. Within a render pass, the subpass dependencies
+	// take over after each image's first use.
+	void render_graph::schedule_barriers() noexcept
+	{
+		struct image_state {
+			VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+			VkPipelineStageFlags write_stages = 0;
+			VkAccessFlags write_access = 0;
+			VkPipelineStageFlags read_stages = 0;
+			VkPipelineStageFlags visible_stages = 0;
+			VkAccessFlags visible_access = 0;
+		};
+
+		// Whatever happened to imported images before the graph is unknown, so it's waited on in full.
+		auto states = std::vector<image_state>(images_.size());
+		for (auto i = std::size_t{0}; i < images_.size(); ++i) {
+			if (images_[i].imported) {
+				states[i].layout = images_[i].initial_layout;
+				states[i].write_stages = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+				states[i].write_access = VK_ACCESS_MEMORY_WRITE_BIT;
+			}
+		}
+
+		auto const barrier = [this](image_state const& state, std::uint32_t const image, VkImageLayout const new_layout) {
+			return VkImageMemoryBarrier{
+			  .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+			  .pNext = nullptr,
+			  .srcAccessMask = state.write_access,
+			  .dstAccessMask = 0,
+			  .oldLayout = state.layout,
+			  .newLayout = new_layout,
+			  .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			  .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			  .image = VK_NULL_HANDLE,
+			  .subresourceRange = whole_image(images_[image].format),
+			};
+		};
+
+		for (auto step_index = std::uint32_t{0}; step_index < steps_.size(); ++step_index) {
+			auto& s = steps_[step_index];
+			auto seen = std::vector<std::uint32_t>();
+			for (auto const pass : s.passes) {
+				for (auto const& use : passes_[pass].uses) {
+					auto const index = use.image.index;
+					auto const info = describe(use.access);
+					auto& state = states[index];
+
+					if (not std::ranges::contains(seen, index)) {
+						seen.push_back(index);
+
+						auto const& image = images_[index];
+						if (not image.imported and image.first_step == step_index and image.alias_of != unused) {
+							auto const& previous = states[image.alias_of];
+							state.write_stages = previous.write_stages | previous.read_stages;
+							state.write_access = previous.write_access;
+						}
+
+						auto const transition = state.layout != info.layout;
+						auto const hazard = info.writes and (state.write_stages | state.read_stages) != 0;
+						auto const invisible = not info.writes and state.write_stages != 0
+						                   and ((info.stages & ~state.visible_stages) != 0
+						                        or (info.access & ~state.visible_access) != 0);
+						if (transition or hazard or invisible) {
+							auto b = barrier(state, index, info.layout);
+							b.dstAccessMask = info.access;
+							if (overwrites(use)) {
+								b.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+							}
+
+							s.barriers.push_back(b);
+							s.barrier_images.push_back(index);
+							s.src_stages |= (transition or hazard) ? state.write_stages | state.read_stages : state.write_stages;
+							s.dst_stages |= info.stages;
+
+							// A layout transition is a write that the barrier makes visible to this use.
+							if (transition and not info.writes) {
+								state.write_stages = info.stages;
+								state.write_access = 0;
+								state.read_stages = 0;
+								state.visible_stages = 0;
+								state.visible_access = 0;
+							}
+							state.visible_stages |= info.stages;
+							state.visible_access |= info.access;
+						}
+					}
+
+					state.layout = info.layout;
+					if (info.writes) {
+						state.write_stages = info.stages;
+						state.write_access = info.access & write_access;
+						state.read_stages = 0;
+						state.visible_stages = 0;
+						state.visible_access = 0;
+					}
+					else {
+						state.read_stages |= info.stages;
+					}
+				}
+			}
+
+			if (not s.barriers.empty()) {
+				s.src_stages = s.src_stages != 0 ? s.src_stages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+				statistics_.barriers += static_cast<std::uint32_t>(s.barriers.size());
+			}
+		}
+
+		for (auto i = std::uint32_t{0}; i < images_.size(); ++i) {
+			auto const& image = images_[i];
+			auto const& state = states[i];
+			if (not image.imported or image.final_layout == VK_IMAGE_LAYOUT_UNDEFINED or state.layout == image.final_layout)
+			{
+				continue;
+			}
+
+			// Whatever uses the image next has to wait on the transition.
+			auto const next = next_use(image.final_layout);
+			auto b = barrier(state, i, image.final_layout);
+			b.dstAccessMask = next.access;
+			final_barriers_.push_back(b);
+			final_barrier_images_.push_back(i);
+			final_src_stages_ |= state.write_stages | state.read_stages;
+			final_dst_stages_ |= next.stages;
+		}
+
+		final_src_stages_ = final_src_stages_ != 0 ? final_src_stages_ : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		final_dst_stages_ = final_dst_stages_ != 0 ? final_dst_stages_ : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+		statistics_.barriers += static_cast<std::uint32_t>(final_barriers_.size());
+	}
+
+	void render_graph::bind(graph_image const image, VkImage const handle, VkImageView const view) noexcept
+	{
+		CJDB_EXPECTS(image.index < images_.size());
+		CJDB_EXPECTS(images_[image.index].imported);
+		images_[image.index].image = handle;
+		images_[image.index].view = view;
+	}
+
+	error_or<VkFramebuffer> render_graph::framebuffer(step& s) noexcept
+	{
+		auto views = std::vector<VkImageView>();
+		views.reserve(s.attachments.size());
+		for (auto const attachment : s.attachments) {
+			views.push_back(images_[attachment].view);
+		}
+
+		auto const cached = std::ranges::find(s.framebuffers, views, &decltype(s.framebuffers)::value_type::first);
+		if (cached != s.framebuffers.end()) {
+			return cached->second.get();
+		}
+
+		auto const framebuffer_info = VkFramebufferCreateInfo{
+		  .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+		  .pNext = nullptr,
+		  .flags = {},
+		  .renderPass = s.render_pass,
+		  .attachmentCount = static_cast<std::uint32_t>(views.size()),
+		  .pAttachments = views.data(),
+		  .width = s.extent.width,
+		  .height = s.extent.height,
+		  .layers = 1,
+		};
+
+		auto resource = VkFramebuffer{};
+		if (auto const result = vkCreateFramebuffer(device_->get(), &framebuffer_info, allocator_, &resource);
+		    result != VK_SUCCESS)
+		{
+			return std::unexpected(static_cast<error>(result));
+		}
+
+		s.framebuffers.emplace_back(
+		  std::move(views),
+		  step::framebuffer_handle(
+		    resource,
+		    deleter<PFN_vkDestroyFramebuffer, VkDevice>{vkDestroyFramebuffer, device_->get(), allocator_}));
+		return resource;
+	}
+
+	static void record_barriers(
+	  VkCommandBuffer const command,
+	  VkPipelineStageFlags const src_stages,
+	  VkPipelineStageFlags const dst_stages,
+	  std::span<VkImageMemoryBarrier const> const barriers) noexcept
+	{
+		if (barriers.empty()) {
+			return;
+		}
+
+		vkCmdPipelineBarrier(
+		  command,
+		  src_stages,
+		  dst_stages,
+		  0,
+		  0,
+		  nullptr,
+		  0,
+		  nullptr,
+		  static_cast<std::uint32_t>(barriers.size()),
+		  barriers.data());
+	}
+
+	error_or<void> render_graph::execute(VkCommandBuffer const command) noexcept
+	{
+		CJDB_EXPECTS(compiled_);
+		for (auto& s : steps_) {
+			for (auto i = std::size_t{0}; i < s.barriers.size(); ++i) {
+				s.barriers[i].image = images_[s.barrier_images[i]].image;
+			}
+			record_barriers(command, s.src_stages, s.dst_stages, s.barriers);
+
+			if (not s.draws) {
+				if (auto const& pass = passes_[s.passes.front()]; pass.execute) {
+					pass.execute(pass.context, command);
+				}
+				continue;
+			}
+
+			auto const current = framebuffer(s);
+			if (not current) {
+				return std::unexpected(current.error());
+			}
+
+			auto const area = VkRect2D{.offset = {0, 0}, .extent = s.extent};
+			auto const begin_info = VkRenderPassBeginInfo{
+			  .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+			  .pNext = nullptr,
+			  .renderPass = s.render_pass,
+			  .framebuffer = *current,
+			  .renderArea = area,
+			  .clearValueCount = static_cast<std::uint32_t>(s.clear_values.size()),
+			  .pClearValues = s.clear_values.data(),
+			};
+			vkCmdBeginRenderPass(command, &begin_info, VK_SUBPASS_CONTENTS_INLINE);
+
+			auto const viewport = VkViewport{
+			  .x = 0.0f,
+			  .y = 0.0f,
+			  .width = static_cast<float>(s.extent.width),
+			  .height = static_cast<float>(s.extent.height),
+			  .minDepth = 0.0f,
+			  .maxDepth = 1.0f,
+			};
+			vkCmdSetViewport(command, 0, 1, &viewport);
+			vkCmdSetScissor(command, 0, 1, &area);
+
+			for (auto subpass = std::size_t{0}; subpass < s.passes.size(); ++subpass) {
+				if (subpass > 0) {
+					vkCmdNextSubpass(command, VK_SUBPASS_CONTENTS_INLINE);
+				}
+
+				if (auto const& pass = passes_[s.passes[subpass]]; pass.execute) {
+					pass.execute(pass.context, command);
+				}
+			}
+
+			vkCmdEndRenderPass(command);
+		}
+
+		for (auto i = std::size_t{0}; i < final_barriers_.size(); ++i) {
+			final_barriers_[i].image = images_[final_barrier_images_[i]].image;
+		}
+		record_barriers(command, final_src_stages_, final_dst_stages_, final_barriers_);
+		return {};
+	}
+
+	pass_target render_graph::target(graph_pass const pass) const noexcept
+	{
+		CJDB_EXPECTS(compiled_);
+		CJDB_EXPECTS(pass.index < passes_.size());
+		auto const& node = passes_[pass.index];
+		if (node.culled or not node.draws) {
+			return pass_target{.render_pass = VK_NULL_HANDLE, .subpass = 0, .extent = {}};
+		}
+
+		auto const& s = steps_[node.step];
+		return pass_target{.render_pass = s.render_pass, .subpass = node.subpass, .extent = s.extent};
+	}
+
+	bool render_graph::culled(graph_pass const pass) const noexcept
+	{
+		CJDB_EXPECTS(compiled_);
+		CJDB_EXPECTS(pass.index < passes_.size());
+		return passes_[pass.index].culled;
+	}
+
+	render_graph::statistics render_graph::stats() const noexcept
+	{
+		return statistics_;
+	}
+} // namespace vulkan
@@ -4,17 +4,23 @@
 #include <GLFW/glfw3.h>
 #include <algorithm>
 #include <array>
+#include <buggy/cpu_profiler.hpp>
+#include <buggy/vertex_layout.hpp>
 #include <buggy/vulkan.hpp>
 #include <buggy/window.hpp>
 #include <expected>
+#include <filesystem>
+#include <fstream>
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
+#include <hello_triangle_shaders.hpp>
 #include <iostream>
 #include <optional>
 #include <ranges>
 #include <span>
 #include <stdexcept>
+#include <string_view>
 #include <vector>
 
 struct panic {
@@ -55,12 +61,35 @@ struct panic {
 			throw std::runtime_error("file not found");
 		case vulkan::error::timeout:
 			throw std::runtime_error("timeout");
+		case vulkan::error::io_failure:
+			throw std::runtime_error("I/O failure");
+		case vulkan::error::invalid_spirv:
+			throw std::runtime_error("invalid SPIR-V");
+		case vulkan::error::push_constants_too_large:
+			throw std::runtime_error("push constants too large");
+		case vulkan::error::bindless_capacity_too_large:
+			throw std::runtime_error("bindless capacity too large");
+		case vulkan::error::invalid_external_handle:
+			throw std::runtime_error("invalid external handle");
+		case vulkan::error::fragmentation:
+			throw std::runtime_error("fragmentation");
+		case vulkan::error::invalid_opaque_capture_address:
+			throw std::runtime_error("invalid opaque capture address");
+		case vulkan::error::surface_lost:
+			throw std::runtime_error("surface lost");
+		case vulkan::error::native_window_in_use:
+			throw std::runtime_error("native window in use");
 		case vulkan::error::out_of_date:
 			throw std::runtime_error("out-of-date");
+		case vulkan::error::suboptimal:
+			throw std::runtime_error("suboptimal");
+		case vulkan::error::incompatible_display:
+			throw std::runtime_error("incompatible display");
+		case vulkan::error::validation_failed:
+			throw std::runtime_error("validation failed");
 		default:
-			break;
+			throw std::runtime_error("unrecognised error");
 		}
-		std::unreachable();
 	}
 
 	[[noreturn]] std::expected<void, window::error> operator()(window::error error)
@@ -74,249 +103,79 @@ struct panic {
 	}
 };
 
-enum class format : std::int8_t {
-	// std::int8_t
-	i8 = VK_FORMAT_R8_SINT,
-	i8_vec2 = VK_FORMAT_R8G8_SINT,
-	i8_vec3 = VK_FORMAT_R8G8B8_SINT,
-	i8_vec4 = VK_FORMAT_R8G8B8A8_SINT,
-
-	// std::uint8_t
-	u8 = VK_FORMAT_R8_UINT,
-	u8_vec2 = VK_FORMAT_R8G8_UINT,
-	u8_vec3 = VK_FORMAT_R8G8B8_UINT,
-	u8_vec4 = VK_FORMAT_R8G8B8A8_UINT,
-
-	// std::int16_t
-	i16 = VK_FORMAT_R16_SINT,
-	i16_vec2 = VK_FORMAT_R16G16_SINT,
-	i16_vec3 = VK_FORMAT_R16G16B16_SINT,
-	i16_vec4 = VK_FORMAT_R16G16B16A16_SINT,
-
-	// std::uint16_t
-	u16 = VK_FORMAT_R16_UINT,
-	u16_vec2 = VK_FORMAT_R16G16_UINT,
-	u16_vec3 = VK_FORMAT_R16G16B16_UINT,
-	u16_vec4 = VK_FORMAT_R16G16B16A16_UINT,
-
-	// std::int32_t
-	i32 = VK_FORMAT_R32_SINT,
-	i32_vec2 = VK_FORMAT_R32G32_SINT,
-	i32_vec3 = VK_FORMAT_R32G32B32_SINT,
-	i32_vec4 = VK_FORMAT_R32G32B32A32_SINT,
-
-	// std::uint32_t
-	u32 = VK_FORMAT_R32_UINT,
-	u32_vec2 = VK_FORMAT_R32G32_UINT,
-	u32_vec3 = VK_FORMAT_R32G32B32_UINT,
-	u32_vec4 = VK_FORMAT_R32G32B32A32_UINT,
-
-	// std::int64_t
-	i64 = VK_FORMAT_R64_SINT,
-	i64_vec2 = VK_FORMAT_R64G64_SINT,
-	i64_vec3 = VK_FORMAT_R64G64B64_SINT,
-	i64_vec4 = VK_FORMAT_R64G64B64A64_SINT,
-
-	// std::uint64_t
-	u64 = VK_FORMAT_R64_UINT,
-	u64_vec2 = VK_FORMAT_R64G64_UINT,
-	u64_vec3 = VK_FORMAT_R64G64B64_UINT,
-	u64_vec4 = VK_FORMAT_R64G64B64A64_UINT,
-
-	// std::float16_t
-	f16 = VK_FORMAT_R16_SFLOAT,
-	f16_vec2 = VK_FORMAT_R16G16_SFLOAT,
-	f16_vec3 = VK_FORMAT_R16G16B16_SFLOAT,
-	f16_vec4 = VK_FORMAT_R16G16B16A16_SFLOAT,
-
-	// std::float32_t
-	f32 = VK_FORMAT_R32_SFLOAT,
-	f32_vec2 = VK_FORMAT_R32G32_SFLOAT,
-	f32_vec3 = VK_FORMAT_R32G32B32_SFLOAT,
-	f32_vec4 = VK_FORMAT_R32G32B32A32_SFLOAT,
-
-	// std::float64_t
-	f64 = VK_FORMAT_R64_SFLOAT,
-	f64_vec2 = VK_FORMAT_R64G64_SFLOAT,
-	f64_vec3 = VK_FORMAT_R64G64B64_SFLOAT,
-	f64_vec4 = VK_FORMAT_R64G64B64A64_SFLOAT,
-
-	error,
-};
-
-template<class T>
-consteval format get_format()
-{
-	return // std::int8_t
-	  std::same_as<T, std::int8_t>     ? format::i8
-	  : std::same_as<T, std::uint8_t>  ? format::u8
-	  : std::same_as<T, std::int16_t>  ? format::i16
-	  : std::same_as<T, std::uint16_t> ? format::u16
-	  : std::same_as<T, std::int32_t>  ? format::i32
-	  : std::same_as<T, glm::ivec2>    ? format::i32_vec2
-	  : std::same_as<T, glm::ivec3>    ? format::i32_vec3
-	  : std::same_as<T, glm::ivec4>    ? format::i32_vec4
-	  : std::same_as<T, std::uint32_t> ? format::u32
-	  : std::same_as<T, glm::uvec2>    ? format::u32_vec2
-	  : std::same_as<T, glm::uvec3>    ? format::u32_vec3
-	  : std::same_as<T, glm::uvec4>    ? format::u32_vec4
-	  : std::same_as<T, std::int64_t>  ? format::i64
-	  : std::same_as<T, std::uint64_t> ? format::u64
-	  : std::same_as<T, float>         ? format::f32
-	  : std::same_as<T, glm::vec2>     ? format::f32_vec2
-	  : std::same_as<T, glm::vec3>     ? format::f32_vec3
-	  : std::same_as<T, glm::vec4>     ? format::f32_vec4
-	  : std::same_as<T, double>        ? format::f64
-	  : std::same_as<T, glm::dvec2>    ? format::f32_vec2
-	  : std::same_as<T, glm::dvec3>    ? format::f32_vec3
-	  : std::same_as<T, glm::dvec4>
-	    ? format::f64_vec4
-	    : format::error;
-}
-
-template<class T>
-constexpr VkVertexInputAttributeDescription make_attribute(
-  std::uint32_t const binding,
-  std::uint32_t const location,
-  std::size_t const offset) noexcept
-{
-	return VkVertexInputAttributeDescription{
-	  .location = location,
-	  .binding = binding,
-	  .format = static_cast<VkFormat>(get_format<T>()),
-	  .offset = static_cast<std::uint32_t>(offset),
-	};
-}
-
 struct vertex {
 	glm::vec2 pos;
 	glm::vec3 colour;
-
-	static VkVertexInputBindingDescription const binding_description;
-	static std::array<VkVertexInputAttributeDescription, 2> const attributes;
 };
 
-constexpr VkVertexInputBindingDescription vertex::binding_description = {
-  .binding = 0,
-  .stride = sizeof(vertex),
-  .inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
-};
-
-constexpr std::array<VkVertexInputAttributeDescription, 2> vertex::attributes{
-  make_attribute<glm::vec2>(0, 0, offsetof(vertex, pos)),
-  make_attribute<glm::vec3>(0, 1, offsetof(vertex, colour)),
-};
+constexpr auto vertex_binding = vulkan::vertex_binding<vertex>();
+constexpr auto vertex_attributes = vulkan::vertex_attributes<vertex>();
 
 class hello_triangle_application {
 public:
 	void run()
 	{
-		auto frame = std::uint32_t{0};
-		auto image_available = std::array{
-		  *vulkan::semaphore::create(device_).transform_error(panic{}),
-		  *vulkan::semaphore::create(device_).transform_error(panic{}),
-		};
-		auto render_finished = std::array{
-		  *vulkan::semaphore::create(device_).transform_error(panic{}),
-		  *vulkan::semaphore::create(device_).transform_error(panic{}),
-		};
-		auto frame_completed = std::array{
-		  *vulkan::fence::create(device_).transform_error(panic{}),
-		  *vulkan::fence::create(device_).transform_error(panic{}),
-		};
-		VkBuffer buffer[] = {buffer_.get()};
-
-		auto reset_fences = [this, &frame, &frame_completed](std::uint32_t const i) -> vulkan::error_or<std::uint32_t> {
-			VkFence fences[] = {frame_completed[frame].get()};
-			if (auto result = device_.reset(fences); not result) {
-				return std::unexpected(result.error());
-			}
-
-			return i;
-		};
-		auto reset_command_buffer = [&frame, this](std::uint32_t const i) -> vulkan::error_or<std::uint32_t> {
-			if (auto const result = command_buffer_.reset(frame); not result) {
-				return std::unexpected(result.error());
-			}
-
-			return i;
-		};
-		auto acquire_next_image = [this, &image_available, &frame] {
-			return swapchain_.acquire_next_image(image_available[frame]);
-		};
-		auto record_command = [this, &frame, buffer](std::uint32_t const i) -> vulkan::error_or<std::uint32_t> {
-			if (auto const result = command_buffer_.record(
-			      frame,
-			      i,
-			      render_pass_,
-			      swapchain_,
-			      pipeline_,
-			      framebuffer_,
-			      [buffer](VkCommandBuffer const command_buffer) noexcept -> vulkan::error_or<void> {
-				      VkDeviceSize offsets[] = {0};
-				      vkCmdBindVertexBuffers(command_buffer, 0, 1, buffer, offsets);
-				      vkCmdDraw(command_buffer, static_cast<std::uint32_t>(vertices.size()), 1, 0, 0);
-				      return {};
-			      });
-			    not result)
-			{
-				return std::unexpected(result.error());
-			}
-
-			return i;
-		};
-		auto submit_command = [&, this](std::uint32_t const i) -> vulkan::error_or<std::uint32_t> {
-			VkCommandBuffer commands[] = {command_buffer_.get(frame)};
-			VkSemaphore wait[] = {image_available[frame].get()};
-			VkPipelineStageFlags wait_stages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-			VkSemaphore signal[] = {render_finished[frame].get()};
-			if (auto const result = device_.submit(commands, wait, wait_stages, signal, frame_completed[frame]); not result) {
-				return std::unexpected(result.error());
-			}
-
-			return i;
-		};
-		auto present = [this, &render_finished, &frame](std::uint32_t const image_index) {
-			VkSwapchainKHR swapchains[] = {swapchain_.get()};
-			VkSemaphore signal[] = {render_finished[frame].get()};
-			return vulkan::present(device_, image_index, swapchains, signal);
+		auto const vertex_buffer = buffer_.get();
+		(void)uploads_.flush()
+		  .and_then([this](vulkan::upload_token const token) { return uploads_.wait(token); })
+		  .transform_error(panic{});
+
+		auto record_command = [this, vertex_buffer](
+		                        vulkan::command_buffer& commands,
+		                        std::uint32_t const frame,
+		                        std::uint32_t const image_index) noexcept -> vulkan::error_or<void> {
+			return commands.record(
+			  frame,
+			  image_index,
+			  render_pass_,
+			  swapchain_,
+			  pipeline_,
+			  framebuffer_,
+			  [this, vertex_buffer](VkCommandBuffer const command_buffer) noexcept -> vulkan::error_or<void> {
+				  vulkan::bind_vertex_buffers(command_buffer, {&vertex_buffer, 1});
+				  vulkan::bind_index_buffer(command_buffer, index_buffer_);
+				  vulkan::draw_indexed(command_buffer, static_cast<std::uint32_t>(indices.size()));
+				  return {};
+			  });
 		};
 		auto recreate_swapchain = [this](vulkan::error const e) noexcept -> vulkan::error_or<void> {
-			if (e == vulkan::error::out_of_date) {
+			if (e != vulkan::error::out_of_date and e != vulkan::error::suboptimal) {
 				return std::unexpected(e);
 			}
 
-			return device_.wait().and_then([this]() -> vulkan::error_or<void> {
-				auto result = vulkan::swapchain::create(device_, window_);
-				if (result.has_value()) {
-					swapchain_ = std::move(*result);
-					return {};
-				}
+			auto result = frames_.recreate(swapchain_, window_, render_pass_, framebuffer_);
+			if (not result and result.error() == vulkan::error::out_of_date) {
+				// The window is minimised, so there's nothing to present to until it's restored.
+				glfwWaitEvents();
+				return {};
+			}
 
-				return std::unexpected(result.error());
-			});
+			return result;
 		};
 
 		while (not window_.should_close()) {
-			VkFence current_frame[] = {frame_completed[frame].get()};
-			(void)device_.wait_all({current_frame, 1})
-			  .and_then(acquire_next_image)
-			  .and_then(reset_fences)
-			  .and_then(reset_command_buffer)
-			  .and_then(record_command)
-			  .and_then(submit_command)
-			  .and_then(present)
-			  .or_else(recreate_swapchain)
-			  .transform_error(panic{});
+			(void)frames_.draw(swapchain_, record_command).or_else(recreate_swapchain).transform_error(panic{});
 			glfwPollEvents();
-			frame = (frame + 1) % 2;
 		}
 
 		(void)device_.wait().transform_error(panic{});
+		(void)pipeline_cache_.save(pipeline_cache_path).transform_error(panic{});
+
+		if constexpr (profiling::enabled) {
+			auto const samples = profiling::samples().snapshot();
+			for (auto const& phase : profiling::summarise(samples)) {
+				std::cout << phase.phase << ": " << phase.count << " samples, mean " << phase.mean << ", p50 " << phase.p50
+				          << ", p90 " << phase.p90 << ", p99 " << phase.p99 << ", max " << phase.max << '\n';
+			}
+			std::ofstream(std::filesystem::path(cpu_trace_path)) << profiling::chrome_trace(samples);
+		}
 	}
 private:
 	static inline constexpr auto width = 800u;
 	static inline constexpr auto height = 600u;
+	static inline constexpr auto frames_in_flight = 2u;
+	static inline constexpr auto pipeline_cache_path = std::string_view("pipeline_cache.bin");
+	static inline constexpr auto cpu_trace_path = std::string_view("cpu_trace.json");
 	static inline constexpr auto layers = std::array{
 	  "VK_LAYER_KHRONOS_validation",
 	};
@@ -328,7 +187,7 @@ private:
 		  .applicationVersion = VK_MAKE_VERSION(1, 0, 0),
 		  .pEngineName = "No Engine",
 		  .engineVersion = VK_MAKE_VERSION(1, 0, 0),
-		  .apiVersion = VK_API_VERSION_1_0,
+		  .apiVersion = VK_API_VERSION_1_2,
 		};
 
 		char const* const debug = VK_EXT_DEBUG_UTILS_EXTENSION_NAME;
@@ -350,21 +209,25 @@ private:
 	vulkan::swapchain swapchain_ = *vulkan::swapchain::create(device_, window_).transform_error(panic{});
 	vulkan::render_pass render_pass_ = *vulkan::render_pass::create(device_, swapchain_).transform_error(panic{});
 	vulkan::pipeline_layout pipeline_layout_ = *vulkan::pipeline_layout::create(device_).transform_error(panic{});
+	vulkan::pipeline_cache pipeline_cache_ =
+	  *vulkan::pipeline_cache::create(device_, std::filesystem::path(pipeline_cache_path)).transform_error(panic{});
 	vulkan::graphics_pipeline pipeline_ = [this] {
 		auto dynamic_states = std::array{VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+		auto const shaders = hello_triangle_shaders::bundle();
 		auto const vertex_shader =
-		  *vulkan::vertex_shader::create("/home/cjdb/projects/buggy/vert.spv", device_).transform_error(panic{});
+		  *vulkan::vertex_shader::create(shaders, "shader.vert", device_).transform_error(panic{});
 		auto const fragment_shader =
-		  *vulkan::fragment_shader::create("/home/cjdb/projects/buggy/frag.spv", device_).transform_error(panic{});
+		  *vulkan::fragment_shader::create(shaders, "shader.frag", device_).transform_error(panic{});
 		return *vulkan::graphics_pipeline::create(
 		          device_,
+		          pipeline_cache_,
 		          pipeline_layout_,
 		          render_pass_,
 		          dynamic_states,
-		          swapchain_,
+		          swapchain_.extent(),
 		          {&vertex_shader, 1},
-		          {&vertex::binding_description, 1},
-		          vertex::attributes,
+		          {&vertex_binding, 1},
+		          vertex_attributes,
 		          {&fragment_shader, 1})
 		          .transform_error(panic{});
 	}();
@@ -379,15 +242,23 @@ private:
 		  });
 		return result;
 	}();
-	vulkan::command_pool command_pool_ = *vulkan::command_pool::create(device_, window_).transform_error(panic{});
+	vulkan::command_pool command_pool_ =
+	  *vulkan::command_pool::create(device_, vulkan::queue_kind::graphics).transform_error(panic{});
 	static inline std::vector<vertex> const vertices = {
 	  {{0.0f, -0.5f}, {1.0f, 0.25f, 0.25f}},
 	  { {0.5f, 0.5f}, {0.25f, 1.0f, 0.25f}},
 	  {{-0.5f, 0.5f}, {0.25f, 0.25f, 1.0f}}
   };
-	vulkan::buffer<vertex> buffer_ = *vulkan::buffer<vertex>::create(device_, vertices).transform_error(panic{});
-	vulkan::command_buffer command_buffer_ =
-	  *vulkan::command_buffer::create(device_, command_pool_, 2).transform_error(panic{});
+	static inline std::vector<std::uint16_t> const indices = {0, 1, 2};
+	vulkan::memory_allocator memory_ = *vulkan::memory_allocator::create(device_).transform_error(panic{});
+	vulkan::upload_batcher uploads_ = *vulkan::upload_batcher::create(device_, memory_).transform_error(panic{});
+	vulkan::buffer<vertex> buffer_ =
+	  *vulkan::buffer<vertex>::create(device_, memory_, uploads_, vertices).transform_error(panic{});
+	vulkan::buffer<std::uint16_t> index_buffer_ =
+	  *vulkan::buffer<std::uint16_t>::create(device_, memory_, uploads_, indices, VK_BUFFER_USAGE_INDEX_BUFFER_BIT)
+	    .transform_error(panic{});
+	vulkan::frame_scheduler frames_ =
+	  *vulkan::frame_scheduler::create(device_, command_pool_, frames_in_flight).transform_error(panic{});
 };
 
 int main()
@@ -1,14 +1,37 @@
+#include "json.hpp"
+#include "layout_use.hpp"
 #include <algorithm>
+#include <atomic>
+#include <bit>
+#include <buggy/cpu_profiler.hpp>
 #include <buggy/vulkan.hpp>
+#include <buggy_shaders.hpp>
 #include <buggy/window.hpp>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
 #include <cjdb/contracts.hpp>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
 #include <expected>
+#include <fcntl.h>
+#include <format>
 #include <fstream>
 #include <iterator>
+#include <mutex>
+#include <optional>
 #include <print>
 #include <ranges>
+#include <shared_mutex>
 #include <span>
 #include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <type_traits>
+#include <unistd.h>
+#include <unordered_map>
 #include <vector>
 #include <vulkan/vulkan.h>
 
@@ -104,22 +127,27 @@ namespace vulkan {
 	std::expected<instance, error> instance::create(
 	  VkApplicationInfo const app_info,
 	  std::span<char const* const> const layers,
-	  std::span<char const* const> extensions) noexcept
+	  std::span<char const* const> extensions,
+	  presentation const mode) noexcept
 	{
-		return create(app_info, nullptr, layers, extensions);
+		return create(app_info, nullptr, layers, extensions, mode);
 	}
 
 	std::expected<instance, error> instance::create(
 	  VkApplicationInfo const app_info,
 	  VkAllocationCallbacks const* allocator,
 	  std::span<char const* const> const layers,
-	  std::span<char const* const> extensions) noexcept
+	  std::span<char const* const> extensions,
+	  presentation const mode) noexcept
 	{
 		if (not check_layer_support(layers)) {
 			return std::unexpected(error::layer_unavailable);
 		}
 
-		auto all_extensions = std::vector<char const*>(std::from_range_t{}, required_extensions());
+		auto all_extensions = std::vector<char const*>();
+		if (mode == presentation::windowed) {
+			all_extensions.append_range(required_extensions());
+		}
 		all_extensions.append_range(extensions);
 
 		auto create_debug_info = VkDebugUtilsMessengerCreateInfoEXT{
@@ -148,12 +176,15 @@ namespace vulkan {
 			return std::unexpected(static_cast<error>(result));
 		}
 
-		return instance(raw_instance, allocator);
+		return instance(raw_instance, app_info.apiVersion, allocator);
 	}
 
-	instance::instance(VkInstance const instance, VkAllocationCallbacks const* allocator) noexcept
+	instance::instance(
+	  VkInstance const instance,
+	  std::uint32_t const api_version,
+	  VkAllocationCallbacks const* allocator) noexcept
 	: instance_(instance, {vkDestroyInstance, allocator})
-	, physical_devices_(retrieve_devices(instance_.get()))
+	, physical_devices_(retrieve_devices(instance_.get(), api_version))
 	{}
 
 	std::span<physical_device const> instance::physical_devices() const noexcept
@@ -166,7 +197,90 @@ namespace vulkan {
 		return x.extensionName;
 	}
 
-	std::vector<physical_device> instance::retrieve_devices(VkInstance const instance) noexcept
+	struct extended_features {
+		bool timeline_semaphore = false;
+		bool descriptor_indexing = false;
+		bool draw_indirect_count = false;
+		bool dynamic_rendering = false;
+		std::uint32_t max_bindless_textures = 0;
+	};
+
+	// VkPhysicalDeviceVulkan12Features has too many members to spell out, so only the ones behind extended_features
+	// are set.
+	[[nodiscard]] static VkPhysicalDeviceVulkan12Features vulkan12_features(extended_features const& enabled) noexcept
+	{
+		auto features = VkPhysicalDeviceVulkan12Features{};
+		features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+		features.drawIndirectCount = static_cast<VkBool32>(enabled.draw_indirect_count);
+		features.timelineSemaphore = static_cast<VkBool32>(enabled.timeline_semaphore);
+
+		auto const indexing = static_cast<VkBool32>(enabled.descriptor_indexing);
+		features.shaderSampledImageArrayNonUniformIndexing = indexing;
+		features.descriptorBindingSampledImageUpdateAfterBind = indexing;
+		features.descriptorBindingUpdateUnusedWhilePending = indexing;
+		features.descriptorBindingPartiallyBound = indexing;
+		features.runtimeDescriptorArray = indexing;
+		return features;
+	}
+
+	// Features beyond Vulkan 1.0 can only be queried when both the instance and the device are new enough.
+	[[nodiscard]] static extended_features query_extended_features(
+	  VkPhysicalDevice const device,
+	  std::uint32_t const api_version,
+	  VkPhysicalDeviceProperties const& properties) noexcept
+	{
+		if (std::min(api_version, properties.apiVersion) < VK_API_VERSION_1_2) {
+			return {};
+		}
+
+		auto dynamic_rendering = VkPhysicalDeviceDynamicRenderingFeatures{
+		  .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES,
+		  .pNext = nullptr,
+		  .dynamicRendering = VK_FALSE,
+		};
+		auto supported = vulkan12_features({});
+		supported.pNext = std::min(api_version, properties.apiVersion) >= VK_API_VERSION_1_3 ? &dynamic_rendering : nullptr;
+		auto features = VkPhysicalDeviceFeatures2{
+		  .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+		  .pNext = &supported,
+		  .features = {},
+		};
+		vkGetPhysicalDeviceFeatures2(device, &features);
+
+		auto limits = VkPhysicalDeviceVulkan12Properties{};
+		limits.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+		auto properties2 = VkPhysicalDeviceProperties2{
+		  .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+		  .pNext = &limits,
+		  .properties = {},
+		};
+		vkGetPhysicalDeviceProperties2(device, &properties2);
+
+		auto const descriptor_indexing = supported.shaderSampledImageArrayNonUniformIndexing == VK_TRUE
+		                             and supported.descriptorBindingSampledImageUpdateAfterBind == VK_TRUE
+		                             and supported.descriptorBindingUpdateUnusedWhilePending == VK_TRUE
+		                             and supported.descriptorBindingPartiallyBound == VK_TRUE
+		                             and supported.runtimeDescriptorArray == VK_TRUE;
+		// Combined image samplers count as both a sampled image and a sampler.
+		auto const max_bindless_textures = std::min({
+		  limits.maxPerStageDescriptorUpdateAfterBindSampledImages,
+		  limits.maxDescriptorSetUpdateAfterBindSampledImages,
+		  limits.maxPerStageDescriptorUpdateAfterBindSamplers,
+		  limits.maxDescriptorSetUpdateAfterBindSamplers,
+		  limits.maxPerStageUpdateAfterBindResources,
+		});
+		return extended_features{
+		  .timeline_semaphore = supported.timelineSemaphore == VK_TRUE,
+		  .descriptor_indexing = descriptor_indexing,
+		  .draw_indirect_count = supported.drawIndirectCount == VK_TRUE,
+		  .dynamic_rendering = dynamic_rendering.dynamicRendering == VK_TRUE,
+		  .max_bindless_textures = descriptor_indexing ? max_bindless_textures : 0,
+		};
+	}
+
+	std::vector<physical_device> instance::retrieve_devices(
+	  VkInstance const instance,
+	  std::uint32_t const api_version) noexcept
 	{
 		auto num_devices = std::uint32_t{};
 		vkEnumeratePhysicalDevices(instance, &num_devices, nullptr);
@@ -180,7 +294,7 @@ namespace vulkan {
 
 		auto result = std::vector<physical_device>();
 		result.reserve(num_devices);
-		std::ranges::transform(devices, std::back_inserter(result), [](VkPhysicalDevice const device) noexcept {
+		std::ranges::transform(devices, std::back_inserter(result), [api_version](VkPhysicalDevice const device) noexcept {
 			auto properties = VkPhysicalDeviceProperties{};
 			vkGetPhysicalDeviceProperties(device, &properties);
 
@@ -197,28 +311,56 @@ namespace vulkan {
 			vkEnumerateDeviceExtensionProperties(device, nullptr, &num_extensions, extensions.data());
 			std::ranges::sort(extensions, {}, extension_to_string);
 
+			auto const extended = query_extended_features(device, api_version, properties);
 			return physical_device{
 			  .device = device,
 			  .properties = properties,
 			  .features = features,
 			  .memory_properties = memory_properties,
 			  .extensions = std::move(extensions),
+			  .timeline_semaphore = extended.timeline_semaphore,
+			  .descriptor_indexing = extended.descriptor_indexing,
+			  .max_bindless_textures = extended.max_bindless_textures,
+			  .draw_indirect_count = extended.draw_indirect_count,
+			  .dynamic_rendering = extended.dynamic_rendering,
 			};
 		});
 
 		return result;
 	}
 
-	[[nodiscard]] static std::optional<std::uint32_t> find_present_queue(
-	  physical_device const& device,
-	  VkSurfaceKHR const surface) noexcept
+	[[nodiscard]] static std::vector<VkQueueFamilyProperties> queue_families(physical_device const& device) noexcept
 	{
 		auto num_families = std::uint32_t{0};
 		vkGetPhysicalDeviceQueueFamilyProperties(device.device, &num_families, nullptr);
 
 		auto families = std::vector<VkQueueFamilyProperties>(num_families);
 		vkGetPhysicalDeviceQueueFamilyProperties(device.device, &num_families, families.data());
+		return families;
+	}
+
+	[[nodiscard]] static std::optional<std::uint32_t> find_dedicated_queue(
+	  physical_device const& device,
+	  VkQueueFlags const required,
+	  VkQueueFlags const excluded) noexcept
+	{
+		auto const families = queue_families(device);
+		auto const family = std::ranges::find_if(families, [required, excluded](VkQueueFamilyProperties const& x) noexcept {
+			return (x.queueFlags & required) == required and (x.queueFlags & excluded) == 0;
+		});
+
+		if (family == families.end()) {
+			return std::nullopt;
+		}
 
+		return static_cast<std::uint32_t>(family - families.begin());
+	}
+
+	[[nodiscard]] static std::optional<std::uint32_t> find_present_queue(
+	  physical_device const& device,
+	  VkSurfaceKHR const surface) noexcept
+	{
+		auto const families = queue_families(device);
 		auto indexed_families = std::views::zip(families, std::views::iota(std::uint32_t{}));
 		auto const graphics = std::ranges::find_if(indexed_families, [&](auto const& x) noexcept {
 			auto&& [family, i] = x;
@@ -254,12 +396,45 @@ namespace vulkan {
 			return format != formats.end() ? *format : formats[0];
 		}
 
-		[[nodiscard]] VkPresentModeKHR choose_present_mode() const noexcept
+		[[nodiscard]] VkPresentModeKHR choose_present_mode(present_options const& options) const noexcept
 		{
-			auto const mode = std::ranges::find_if(present_modes, [](VkPresentModeKHR const mode) noexcept {
-				return mode == VK_PRESENT_MODE_MAILBOX_KHR;
-			});
-			return mode != present_modes.end() ? *mode : VK_PRESENT_MODE_FIFO_KHR;
+			auto const supported = [this](VkPresentModeKHR const mode) noexcept {
+				return std::ranges::contains(present_modes, mode);
+			};
+			if (options.present_mode and supported(*options.present_mode)) {
+				return *options.present_mode;
+			}
+
+			switch (options.policy) {
+			case present_policy::low_latency:
+				if (supported(VK_PRESENT_MODE_MAILBOX_KHR)) {
+					return VK_PRESENT_MODE_MAILBOX_KHR;
+				}
+				break;
+			case present_policy::max_throughput:
+				if (supported(VK_PRESENT_MODE_IMMEDIATE_KHR)) {
+					return VK_PRESENT_MODE_IMMEDIATE_KHR;
+				}
+				if (supported(VK_PRESENT_MODE_MAILBOX_KHR)) {
+					return VK_PRESENT_MODE_MAILBOX_KHR;
+				}
+				break;
+			case present_policy::power_save:
+				break;
+			}
+
+			// FIFO is the only mode that every implementation is required to support.
+			return VK_PRESENT_MODE_FIFO_KHR;
+		}
+
+		[[nodiscard]] std::uint32_t choose_image_count(present_options const& options) const noexcept
+		{
+			// A maxImageCount of zero means that there's no upper limit.
+			auto const max_images = capabilities.maxImageCount == 0 ? std::numeric_limits<std::uint32_t>::max()
+			                                                        : capabilities.maxImageCount;
+			auto const preferred = options.image_count.value_or(
+			  options.policy == present_policy::power_save ? capabilities.minImageCount : capabilities.minImageCount + 1);
+			return std::clamp(preferred, capabilities.minImageCount, max_images);
 		}
 
 		[[nodiscard]] VkExtent2D choose_extent(GLFWwindow* window) const noexcept
@@ -310,25 +485,51 @@ namespace vulkan {
 	  selector_fn const selector,
 	  std::span<char const* const> const extensions,
 	  VkAllocationCallbacks const* const allocator) noexcept
+	{
+		return create(instance, window.get_surface(), selector, extensions, allocator);
+	}
+
+	std::expected<device, error> device::create(
+	  instance const& instance,
+	  selector_fn const selector,
+	  std::span<char const* const> const extensions,
+	  VkAllocationCallbacks const* const allocator) noexcept
+	{
+		return create(instance, VK_NULL_HANDLE, selector, extensions, allocator);
+	}
+
+	std::expected<device, error> device::create(
+	  instance const& instance,
+	  VkSurfaceKHR const surface,
+	  selector_fn const selector,
+	  std::span<char const* const> const extensions,
+	  VkAllocationCallbacks const* const allocator) noexcept
 	{
 		auto physical_devices = instance.physical_devices();
 		auto family_index = std::uint32_t{0};
 		auto physical_device =
-		  std::ranges::find_if(physical_devices, [&selector, &family_index, &window, &extensions](auto const& device) noexcept {
+		  std::ranges::find_if(physical_devices, [&selector, &family_index, surface, &extensions](auto const& device) noexcept {
 			  if (not (selector(device) and supports_extensions(device, extensions))) {
 				  return false;
 			  }
 
-			  auto const swapchain_support = swapchain_support_details::query(device.device, window.get_surface());
+			  if (surface == VK_NULL_HANDLE) {
+				  auto const index = find_dedicated_queue(device, VK_QUEUE_GRAPHICS_BIT, 0);
+				  family_index = index.value_or(0);
+				  return index.has_value();
+			  }
+
+			  auto const swapchain_support = swapchain_support_details::query(device.device, surface);
 			  if (swapchain_support.formats.empty() or swapchain_support.present_modes.empty()) {
 				  return false;
 			  }
 
-			  auto const index = find_present_queue(device, window.get_surface());
-			  if (index) {
-				  family_index = *index;
+			  auto const index = find_present_queue(device, surface);
+			  if (not index) {
+				  return false;
 			  }
 
+			  family_index = *index;
 			  return true;
 		  });
 
@@ -336,22 +537,56 @@ namespace vulkan {
 			return std::unexpected(error::no_suitable_devices);
 		}
 
+		auto const compute_family =
+		  find_dedicated_queue(*physical_device, VK_QUEUE_COMPUTE_BIT, VK_QUEUE_GRAPHICS_BIT).value_or(family_index);
+		auto const transfer_family =
+		  find_dedicated_queue(*physical_device, VK_QUEUE_TRANSFER_BIT, VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)
+		    .value_or(compute_family);
+		auto unique_families = std::vector{family_index, compute_family, transfer_family};
+		std::ranges::sort(unique_families);
+		unique_families.erase(std::ranges::unique(unique_families).begin(), unique_families.end());
+
 		auto queue_priority = 1.0f;
-		auto queue_create_info = VkDeviceQueueCreateInfo{
-		  .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+		auto queue_create_infos = std::vector<VkDeviceQueueCreateInfo>();
+		queue_create_infos.reserve(unique_families.size());
+		std::ranges::transform(
+		  unique_families,
+		  std::back_inserter(queue_create_infos),
+		  [&queue_priority](std::uint32_t const family) noexcept {
+			  return VkDeviceQueueCreateInfo{
+			    .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+			    .pNext = nullptr,
+			    .flags = {},
+			    .queueFamilyIndex = family,
+			    .queueCount = 1,
+			    .pQueuePriorities = &queue_priority,
+			  };
+		  });
+
+		// Every extended feature the device supports is enabled. They're all false on devices older than Vulkan 1.2,
+		// which can't be given the structure, and dynamic rendering is only true from Vulkan 1.3.
+		auto const enabled = extended_features{
+		  .timeline_semaphore = physical_device->timeline_semaphore,
+		  .descriptor_indexing = physical_device->descriptor_indexing,
+		  .draw_indirect_count = physical_device->draw_indirect_count,
+		  .dynamic_rendering = physical_device->dynamic_rendering,
+		};
+		auto dynamic_rendering = VkPhysicalDeviceDynamicRenderingFeatures{
+		  .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES,
 		  .pNext = nullptr,
-		  .flags = {},
-		  .queueFamilyIndex = family_index,
-		  .queueCount = 1,
-		  .pQueuePriorities = &queue_priority,
+		  .dynamicRendering = VK_TRUE,
 		};
+		auto vulkan12 = vulkan12_features(enabled);
+		vulkan12.pNext = enabled.dynamic_rendering ? &dynamic_rendering : nullptr;
+		auto const any_enabled = enabled.timeline_semaphore or enabled.descriptor_indexing or enabled.draw_indirect_count
+		                      or enabled.dynamic_rendering;
 
 		auto device_create_info = VkDeviceCreateInfo{
 		  .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-		  .pNext = nullptr,
+		  .pNext = any_enabled ? &vulkan12 : nullptr,
 		  .flags = {},
-		  .queueCreateInfoCount = 1,
-		  .pQueueCreateInfos = &queue_create_info,
+		  .queueCreateInfoCount = static_cast<std::uint32_t>(queue_create_infos.size()),
+		  .pQueueCreateInfos = queue_create_infos.data(),
 		  .enabledLayerCount = 0,
 		  .ppEnabledLayerNames = nullptr,
 		  .enabledExtensionCount = static_cast<std::uint32_t>(extensions.size()),
@@ -366,10 +601,18 @@ namespace vulkan {
 			return std::unexpected(static_cast<error>(result));
 		}
 
-		auto queue = VkQueue{};
-		vkGetDeviceQueue(device, family_index, 0, &queue);
+		auto get_queue = [device](std::uint32_t const family) noexcept {
+			auto queue = VkQueue{};
+			vkGetDeviceQueue(device, family, 0, &queue);
+			return queue_info{.queue = queue, .family = family};
+		};
 
-		return vulkan::device(device, queue, allocator, *physical_device);
+		auto const queues = std::array{
+		  get_queue(family_index),
+		  get_queue(compute_family),
+		  get_queue(transfer_family),
+		};
+		return vulkan::device(device, queues, allocator, *physical_device);
 	}
 
 	error_or<void> device::wait_one(std::span<VkFence const> const fences, std::uint64_t const timeout) noexcept
@@ -404,13 +647,60 @@ namespace vulkan {
 		return {};
 	}
 
+	[[nodiscard]] static error_or<void> wait_for_semaphores(
+	  VkDevice const device,
+	  std::span<semaphore_value const> const values,
+	  VkSemaphoreWaitFlags const flags,
+	  std::uint64_t const timeout) noexcept
+	{
+		auto semaphores = std::vector<VkSemaphore>();
+		auto counters = std::vector<std::uint64_t>();
+		semaphores.reserve(values.size());
+		counters.reserve(values.size());
+		for (auto const& [handle, value] : values) {
+			semaphores.push_back(handle);
+			counters.push_back(value);
+		}
+
+		auto const wait_info = VkSemaphoreWaitInfo{
+		  .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+		  .pNext = nullptr,
+		  .flags = flags,
+		  .semaphoreCount = static_cast<std::uint32_t>(semaphores.size()),
+		  .pSemaphores = semaphores.data(),
+		  .pValues = counters.data(),
+		};
+
+		if (auto const result = vkWaitSemaphores(device, &wait_info, timeout); result != VK_SUCCESS) {
+			return std::unexpected(result != VK_TIMEOUT ? static_cast<error>(result) : error::timeout);
+		}
+
+		return {};
+	}
+
+	error_or<void> device::wait_one(std::span<semaphore_value const> const values, std::uint64_t const timeout)
+	  const noexcept
+	{
+		CJDB_EXPECTS(physical_device_->timeline_semaphore);
+		return wait_for_semaphores(device_.get(), values, VK_SEMAPHORE_WAIT_ANY_BIT, timeout);
+	}
+
+	error_or<void> device::wait_all(std::span<semaphore_value const> const values, std::uint64_t const timeout)
+	  const noexcept
+	{
+		CJDB_EXPECTS(physical_device_->timeline_semaphore);
+		return wait_for_semaphores(device_.get(), values, {}, timeout);
+	}
+
 	error_or<void> device::submit(
 	  std::span<VkCommandBuffer> commands,
 	  std::span<VkSemaphore> const wait,
 	  std::span<VkPipelineStageFlags const> const wait_stages,
 	  std::span<VkSemaphore> const signals,
-	  fence& f) noexcept
+	  fence& f,
+	  queue_kind const queue) noexcept
 	{
+		auto const timer = profiling::scoped_timer("submit");
 		auto const submit_info = VkSubmitInfo{
 		  .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
 		  .pNext = nullptr,
@@ -423,7 +713,62 @@ namespace vulkan {
 		  .pSignalSemaphores = signals.data(),
 		};
 
-		if (auto const result = vkQueueSubmit(queue_, 1, &submit_info, f.get()); result != VK_SUCCESS) {
+		if (auto const result = vkQueueSubmit(this->queue(queue), 1, &submit_info, f.get()); result != VK_SUCCESS) {
+			return std::unexpected(static_cast<error>(result));
+		}
+
+		return {};
+	}
+
+	error_or<void> device::submit(
+	  std::span<VkCommandBuffer const> const commands,
+	  std::span<semaphore_wait const> const waits,
+	  std::span<semaphore_value const> const signals,
+	  queue_kind const queue) noexcept
+	{
+		auto const timer = profiling::scoped_timer("submit");
+		auto wait_semaphores = std::vector<VkSemaphore>();
+		auto wait_values = std::vector<std::uint64_t>();
+		auto wait_stages = std::vector<VkPipelineStageFlags>();
+		wait_semaphores.reserve(waits.size());
+		wait_values.reserve(waits.size());
+		wait_stages.reserve(waits.size());
+		for (auto const& [handle, value, stages] : waits) {
+			wait_semaphores.push_back(handle);
+			wait_values.push_back(value);
+			wait_stages.push_back(stages);
+		}
+
+		auto signal_semaphores = std::vector<VkSemaphore>();
+		auto signal_values = std::vector<std::uint64_t>();
+		signal_semaphores.reserve(signals.size());
+		signal_values.reserve(signals.size());
+		for (auto const& [handle, value] : signals) {
+			signal_semaphores.push_back(handle);
+			signal_values.push_back(value);
+		}
+
+		auto const timeline_info = VkTimelineSemaphoreSubmitInfo{
+		  .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+		  .pNext = nullptr,
+		  .waitSemaphoreValueCount = static_cast<std::uint32_t>(wait_values.size()),
+		  .pWaitSemaphoreValues = wait_values.data(),
+		  .signalSemaphoreValueCount = static_cast<std::uint32_t>(signal_values.size()),
+		  .pSignalSemaphoreValues = signal_values.data(),
+		};
+		auto const submit_info = VkSubmitInfo{
+		  .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		  .pNext = physical_device_->timeline_semaphore ? &timeline_info : nullptr,
+		  .waitSemaphoreCount = static_cast<std::uint32_t>(wait_semaphores.size()),
+		  .pWaitSemaphores = wait_semaphores.data(),
+		  .pWaitDstStageMask = wait_stages.data(),
+		  .commandBufferCount = static_cast<std::uint32_t>(commands.size()),
+		  .pCommandBuffers = commands.data(),
+		  .signalSemaphoreCount = static_cast<std::uint32_t>(signal_semaphores.size()),
+		  .pSignalSemaphores = signal_semaphores.data(),
+		};
+
+		if (auto const result = vkQueueSubmit(this->queue(queue), 1, &submit_info, VK_NULL_HANDLE); result != VK_SUCCESS) {
 			return std::unexpected(static_cast<error>(result));
 		}
 
@@ -432,22 +777,202 @@ namespace vulkan {
 
 	device::device(
 	  VkDevice const device,
-	  VkQueue const queue,
+	  std::array<queue_info, 3> const queues,
 	  VkAllocationCallbacks const* const allocator,
 	  struct physical_device const& physical_device) noexcept
 	: device_(device, {vkDestroyDevice, allocator})
-	, queue_(queue)
+	, queues_(queues)
 	, physical_device_(&physical_device)
 	{}
 
+	void release_ownership(
+	  VkCommandBuffer const command,
+	  device const& d,
+	  VkBuffer const buffer,
+	  queue_kind const from,
+	  queue_kind const to,
+	  VkPipelineStageFlags const src_stage,
+	  VkAccessFlags const src_access) noexcept
+	{
+		if (d.queue_family(from) == d.queue_family(to)) {
+			return;
+		}
+
+		auto const barrier = VkBufferMemoryBarrier{
+		  .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+		  .pNext = nullptr,
+		  .srcAccessMask = src_access,
+		  .dstAccessMask = 0,
+		  .srcQueueFamilyIndex = d.queue_family(from),
+		  .dstQueueFamilyIndex = d.queue_family(to),
+		  .buffer = buffer,
+		  .offset = 0,
+		  .size = VK_WHOLE_SIZE,
+		};
+		vkCmdPipelineBarrier(
+		  command,
+		  src_stage,
+		  VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+		  {},
+		  0,
+		  nullptr,
+		  1,
+		  &barrier,
+		  0,
+		  nullptr);
+	}
+
+	void acquire_ownership(
+	  VkCommandBuffer const command,
+	  device const& d,
+	  VkBuffer const buffer,
+	  queue_kind const from,
+	  queue_kind const to,
+	  VkPipelineStageFlags const dst_stage,
+	  VkAccessFlags const dst_access) noexcept
+	{
+		if (d.queue_family(from) == d.queue_family(to)) {
+			return;
+		}
+
+		auto const barrier = VkBufferMemoryBarrier{
+		  .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+		  .pNext = nullptr,
+		  .srcAccessMask = 0,
+		  .dstAccessMask = dst_access,
+		  .srcQueueFamilyIndex = d.queue_family(from),
+		  .dstQueueFamilyIndex = d.queue_family(to),
+		  .buffer = buffer,
+		  .offset = 0,
+		  .size = VK_WHOLE_SIZE,
+		};
+		vkCmdPipelineBarrier(
+		  command,
+		  VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+		  dst_stage,
+		  {},
+		  0,
+		  nullptr,
+		  1,
+		  &barrier,
+		  0,
+		  nullptr);
+	}
+
+	void release_ownership(
+	  VkCommandBuffer const command,
+	  device const& d,
+	  VkImage const image,
+	  VkImageSubresourceRange const& range,
+	  VkImageLayout const old_layout,
+	  VkImageLayout const new_layout,
+	  queue_kind const from,
+	  queue_kind const to,
+	  VkPipelineStageFlags const src_stage,
+	  VkAccessFlags const src_access) noexcept
+	{
+		if (d.queue_family(from) == d.queue_family(to)) {
+			return;
+		}
+
+		auto const barrier = VkImageMemoryBarrier{
+		  .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+		  .pNext = nullptr,
+		  .srcAccessMask = src_access,
+		  .dstAccessMask = 0,
+		  .oldLayout = old_layout,
+		  .newLayout = new_layout,
+		  .srcQueueFamilyIndex = d.queue_family(from),
+		  .dstQueueFamilyIndex = d.queue_family(to),
+		  .image = image,
+		  .subresourceRange = range,
+		};
+		vkCmdPipelineBarrier(
+		  command,
+		  src_stage,
+		  VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+		  {},
+		  0,
+		  nullptr,
+		  0,
+		  nullptr,
+		  1,
+		  &barrier);
+	}
+
+	void acquire_ownership(
+	  VkCommandBuffer const command,
+	  device const& d,
+	  VkImage const image,
+	  VkImageSubresourceRange const& range,
+	  VkImageLayout const old_layout,
+	  VkImageLayout const new_layout,
+	  queue_kind const from,
+	  queue_kind const to,
+	  VkPipelineStageFlags const dst_stage,
+	  VkAccessFlags const dst_access) noexcept
+	{
+		if (d.queue_family(from) == d.queue_family(to)) {
+			return;
+		}
+
+		auto const barrier = VkImageMemoryBarrier{
+		  .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+		  .pNext = nullptr,
+		  .srcAccessMask = 0,
+		  .dstAccessMask = dst_access,
+		  .oldLayout = old_layout,
+		  .newLayout = new_layout,
+		  .srcQueueFamilyIndex = d.queue_family(from),
+		  .dstQueueFamilyIndex = d.queue_family(to),
+		  .image = image,
+		  .subresourceRange = range,
+		};
+		vkCmdPipelineBarrier(
+		  command,
+		  VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+		  dst_stage,
+		  {},
+		  0,
+		  nullptr,
+		  0,
+		  nullptr,
+		  1,
+		  &barrier);
+	}
+
+	std::expected<swapchain, error> swapchain::create(
+	  device const& d,
+	  window::window const& w,
+	  present_options const& options,
+	  VkAllocationCallbacks const* allocator) noexcept
+	{
+		return create(d, w, VK_NULL_HANDLE, options, allocator);
+	}
+
+	std::expected<swapchain, error> swapchain::create(
+	  device const& d,
+	  window::window const& w,
+	  swapchain const& old,
+	  VkAllocationCallbacks const* allocator) noexcept
+	{
+		return create(d, w, old.get(), old.options(), allocator);
+	}
+
 	std::expected<swapchain, error> swapchain::create(
 	  device const& d,
 	  window::window const& w,
+	  VkSwapchainKHR const old,
+	  present_options const& options,
 	  VkAllocationCallbacks const* allocator) noexcept
 	{
 		auto const support = swapchain_support_details::query(d.physical_device().device, w.get_surface());
-		auto const num_images = std::max(support.capabilities.minImageCount + 1, support.capabilities.maxImageCount);
+		auto const num_images = support.choose_image_count(options);
 		auto const [image_format, colour_space] = support.choose_format();
+		auto const extent = support.choose_extent(w.get_window());
+		if (extent.width == 0 or extent.height == 0) {
+			return std::unexpected(error::out_of_date);
+		}
 
 		auto create_info = VkSwapchainCreateInfoKHR{
 		  .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
@@ -457,7 +982,7 @@ namespace vulkan {
 		  .minImageCount = num_images,
 		  .imageFormat = image_format,
 		  .imageColorSpace = colour_space,
-		  .imageExtent = support.choose_extent(w.get_window()),
+		  .imageExtent = extent,
 		  .imageArrayLayers = 1,
 		  .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, // alternatively VK_IMAGE_USAGE_TRANSFER_DST_BIT
 		  .imageSharingMode = VK_SHARING_MODE_EXCLUSIVE,
@@ -465,9 +990,9 @@ namespace vulkan {
 		  .pQueueFamilyIndices = {},
 		  .preTransform = support.capabilities.currentTransform,
 		  .compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
-		  .presentMode = support.choose_present_mode(),
+		  .presentMode = support.choose_present_mode(options),
 		  .clipped = VK_TRUE,
-		  .oldSwapchain = VK_NULL_HANDLE,
+		  .oldSwapchain = old,
 		};
 
 		VkSwapchainKHR resource;
@@ -475,7 +1000,7 @@ namespace vulkan {
 			return std::unexpected(static_cast<error>(result));
 		}
 
-		return swapchain(resource, d, allocator, image_format, create_info.imageExtent);
+		return swapchain(resource, d, allocator, image_format, extent, create_info.presentMode, options);
 	}
 
 	swapchain::swapchain(
@@ -483,10 +1008,14 @@ namespace vulkan {
 	  device const& d,
 	  VkAllocationCallbacks const* allocator,
 	  VkFormat format,
-	  VkExtent2D extent) noexcept
+	  VkExtent2D extent,
+	  VkPresentModeKHR const present_mode,
+	  present_options const& options) noexcept
 	: swapchain_(s, {vkDestroySwapchainKHR, d.get(), allocator})
 	, format_(format)
 	, extent_(extent)
+	, present_mode_(present_mode)
+	, options_(options)
 	, device_(d.get())
 	{
 		auto num_images = std::uint32_t{0};
@@ -510,6 +1039,16 @@ namespace vulkan {
 		return extent_;
 	}
 
+	VkPresentModeKHR swapchain::present_mode() const noexcept
+	{
+		return present_mode_;
+	}
+
+	present_options const& swapchain::options() const noexcept
+	{
+		return options_;
+	}
+
 	std::uint32_t swapchain::size() const noexcept
 	{
 		return static_cast<std::uint32_t>(image_views_.size());
@@ -522,14 +1061,133 @@ namespace vulkan {
 
 	error_or<std::uint32_t> swapchain::acquire_next_image(semaphore& s, std::uint64_t const timeout) noexcept
 	{
+		auto const timer = profiling::scoped_timer("acquire");
 		auto index = std::uint32_t{};
-		if (auto const result = vkAcquireNextImageKHR(device_, swapchain_.get(), timeout, s.get(), VK_NULL_HANDLE, &index);
-		    result != VK_SUCCESS)
-		{
+		auto const result = vkAcquireNextImageKHR(device_, swapchain_.get(), timeout, s.get(), VK_NULL_HANDLE, &index);
+		switch (result) {
+		case VK_SUCCESS:
+			return index;
+		case VK_SUBOPTIMAL_KHR:
+			// The semaphore will still be signalled, so the image needs to be rendered to and presented.
+			suboptimal_ = true;
+			return index;
+		case VK_TIMEOUT:
+		case VK_NOT_READY:
+			return std::unexpected(error::timeout);
+		default:
 			return std::unexpected(static_cast<error>(result));
 		}
+	}
+
+	error_or<void> validate_spirv(std::span<std::uint32_t const> const code) noexcept
+	{
+		constexpr auto header_words = std::size_t{5};
+		constexpr auto magic = std::uint32_t{0x07230203};
+		if (code.size() < header_words or code[0] != magic) {
+			return std::unexpected(error::invalid_spirv);
+		}
 
-		return index;
+		return {};
+	}
+
+	error_or<spirv_file> spirv_file::open(std::filesystem::path const& path) noexcept
+	{
+		auto const file = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (file == -1) {
+			return std::unexpected(errno == ENOENT ? error::file_not_found : error::io_failure);
+		}
+
+		struct stat status{};
+		if (::fstat(file, &status) == -1) {
+			::close(file);
+			return std::unexpected(error::io_failure);
+		}
+
+		auto const size = static_cast<std::size_t>(status.st_size);
+		if (size == 0 or size % sizeof(std::uint32_t) != 0) {
+			::close(file);
+			return std::unexpected(error::invalid_spirv);
+		}
+
+		auto* const mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+		::close(file);
+		if (mapping == MAP_FAILED) {
+			return std::unexpected(error::io_failure);
+		}
+
+		auto code = std::unique_ptr<std::uint32_t const, release>(
+		  static_cast<std::uint32_t const*>(mapping),
+		  release{.words = size / sizeof(std::uint32_t)});
+		if (auto const result = validate_spirv({code.get(), code.get_deleter().words}); not result) {
+			return std::unexpected(result.error());
+		}
+
+		return spirv_file(std::move(code));
+	}
+
+	spirv_file::spirv_file(std::unique_ptr<std::uint32_t const, release> code) noexcept
+	: code_(std::move(code))
+	{}
+
+	void spirv_file::release::operator()(std::uint32_t const* const code) const noexcept
+	{
+		::munmap(const_cast<std::uint32_t*>(code), words * sizeof(std::uint32_t));
+	}
+
+	VkSpecializationInfo specialisation_constants::info() const noexcept
+	{
+		return VkSpecializationInfo{
+		  .mapEntryCount = static_cast<std::uint32_t>(entries_.size()),
+		  .pMapEntries = entries_.data(),
+		  .dataSize = data_.size(),
+		  .pData = data_.data(),
+		};
+	}
+
+	// The keys for in-memory caches are hashed with FNV-1a over each value's object representation, so only types
+	// without padding are accepted.
+	constexpr auto hash_seed = std::uint64_t{0xcbf2'9ce4'8422'2325};
+
+	template<class T>
+	requires std::has_unique_object_representations_v<T>
+	static void hash_append(std::uint64_t& seed, T const& value) noexcept
+	{
+		for (auto const byte : std::bit_cast<std::array<std::byte, sizeof(T)>>(value)) {
+			seed = (seed ^ static_cast<std::uint64_t>(byte)) * 0x100'0000'01b3;
+		}
+	}
+
+	template<class T>
+	static void hash_append(std::uint64_t& seed, std::vector<T> const& values) noexcept
+	{
+		hash_append(seed, values.size());
+		for (auto const& value : values) {
+			hash_append(seed, value);
+		}
+	}
+
+	constexpr auto bitwise_equal = []<class T>(T const& x, T const& y) noexcept
+	requires std::has_unique_object_representations_v<T>
+	{
+		return std::memcmp(&x, &y, sizeof(T)) == 0;
+	};
+
+	// constant_ids and offsets are derived from the member order, so only the sizes and values need to be hashed.
+	std::size_t specialisation_constants::hash() const noexcept
+	{
+		auto seed = hash_seed;
+		for (auto const& entry : entries_) {
+			hash_append(seed, entry.size);
+		}
+
+		hash_append(seed, data_);
+		return static_cast<std::size_t>(seed);
+	}
+
+	bool operator==(specialisation_constants const& x, specialisation_constants const& y) noexcept
+	{
+		constexpr auto size = &VkSpecializationMapEntry::size;
+		return x.data_ == y.data_ and std::ranges::equal(x.entries_, y.entries_, {}, size, size);
 	}
 
 	template<VkShaderStageFlagBits kind>
@@ -538,25 +1196,27 @@ namespace vulkan {
 	  device const& d,
 	  VkAllocationCallbacks const* const allocator) noexcept
 	{
-		auto const bytecode = [path]() noexcept -> std::expected<std::vector<char>, error> {
-			auto file = std::ifstream(path);
-			if (not file) {
-				return std::unexpected(error::file_not_found);
-			}
-			file.unsetf(std::ios_base::skipws);
-			return std::views::istream<char>(file) | std::ranges::to<std::vector>();
-		}();
+		return spirv_file::open(path).and_then([&d, allocator](spirv_file const& file) noexcept {
+			return create(file.code(), d, allocator);
+		});
+	}
 
-		if (not bytecode) {
-			return std::unexpected(bytecode.error());
+	template<VkShaderStageFlagBits kind>
+	std::expected<shader_module<kind>, error> shader_module<kind>::create(
+	  std::span<std::uint32_t const> const code,
+	  device const& d,
+	  VkAllocationCallbacks const* const allocator) noexcept
+	{
+		if (auto const result = validate_spirv(code); not result) {
+			return std::unexpected(result.error());
 		}
 
 		auto create_info = VkShaderModuleCreateInfo{
 		  .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
 		  .pNext = nullptr,
 		  .flags = {},
-		  .codeSize = bytecode->size(),
-		  .pCode = std::launder(reinterpret_cast<std::uint32_t const*>(bytecode->data())),
+		  .codeSize = code.size_bytes(),
+		  .pCode = code.data(),
 		};
 
 		auto module = VkShaderModule{};
@@ -568,7 +1228,49 @@ namespace vulkan {
 	}
 
 	template<VkShaderStageFlagBits kind>
-	VkPipelineShaderStageCreateInfo shader_module<kind>::pipeline_create_info(std::string_view const entry_point_name) const noexcept
+	std::expected<shader_module<kind>, error> shader_module<kind>::create(
+	  shader_bundle const bundle,
+	  std::string_view const name,
+	  device const& d,
+	  VkAllocationCallbacks const* const allocator) noexcept
+	{
+		auto const entry = std::ranges::find(bundle, name, &shader_bundle_entry::name);
+		if (entry == bundle.end()) {
+			return std::unexpected(error::file_not_found);
+		}
+
+		return create(entry->code, d, allocator);
+	}
+
+	template<VkShaderStageFlagBits kind>
+	std::expected<std::vector<shader_module<kind>>, error> shader_module<kind>::create(
+	  std::span<std::filesystem::path const> const paths,
+	  device const& d,
+	  jobs::thread_pool& workers,
+	  VkAllocationCallbacks const* const allocator) noexcept
+	{
+		auto modules = std::vector<std::optional<error_or<shader_module>>>(paths.size());
+		workers.run(static_cast<std::uint32_t>(paths.size()), [&](std::uint32_t const i) noexcept {
+			modules[i].emplace(create(paths[i].native(), d, allocator));
+		});
+
+		auto result = std::vector<shader_module>();
+		result.reserve(modules.size());
+		for (auto& module : modules) {
+			if (not *module) {
+				return std::unexpected(module->error());
+			}
+
+			result.push_back(std::move(**module));
+		}
+
+		return result;
+	}
+
+	template<VkShaderStageFlagBits kind>
+	VkPipelineShaderStageCreateInfo shader_module<kind>::pipeline_create_info(
+	  std::string_view const entry_point_name,
+	  VkSpecializationInfo const* const specialisation) const noexcept
 	{
 		return VkPipelineShaderStageCreateInfo{
 		  .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
@@ -577,7 +1279,7 @@ namespace vulkan {
 		  .stage = static_cast<VkShaderStageFlagBits>(kind),
 		  .module = module_.get(),
 		  .pName = entry_point_name.data(),
-		  .pSpecializationInfo = {},
+		  .pSpecializationInfo = specialisation,
 		};
 	}
 
@@ -645,16 +1347,25 @@ namespace vulkan {
 
 	error_or<render_pass> render_pass::create(device const& d, swapchain const& s, VkAllocationCallbacks const* const allocator) noexcept
 	{
-		auto const colour_attachment = VkAttachmentDescription{
-		  .flags = {},
-		  .format = s.format(),
+		return create(d, s.format(), VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, allocator);
+	}
+
+	error_or<render_pass> render_pass::create(
+	  device const& d,
+	  VkFormat const format,
+	  VkImageLayout const final_layout,
+	  VkAllocationCallbacks const* const allocator) noexcept
+	{
+		auto const colour_attachment = VkAttachmentDescription{
+		  .flags = {},
+		  .format = format,
 		  .samples = VK_SAMPLE_COUNT_1_BIT,
 		  .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
 		  .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
 		  .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
 		  .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
 		  .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-		  .finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+		  .finalLayout = final_layout,
 		};
 		constexpr auto colour_attachment_ref = VkAttachmentReference{
 		  .attachment = 0,
@@ -672,7 +1383,9 @@ namespace vulkan {
 		  .preserveAttachmentCount = 0,
 		  .pPreserveAttachments = nullptr,
 		};
-		constexpr auto subpass_dependency = VkSubpassDependency{
+		// The implicit dependency out of the render pass has no access, so whatever uses the image in final_layout
+		// next, such as offscreen_target's readback, needs an explicit one to wait on the transition.
+		constexpr auto into_subpass = VkSubpassDependency{
 		  .srcSubpass = VK_SUBPASS_EXTERNAL,
 		  .dstSubpass = 0,
 		  .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
@@ -681,6 +1394,17 @@ namespace vulkan {
 		  .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
 		  .dependencyFlags = {},
 		};
+		auto const next = next_use(final_layout);
+		auto const out_of_subpass = VkSubpassDependency{
+		  .srcSubpass = 0,
+		  .dstSubpass = VK_SUBPASS_EXTERNAL,
+		  .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+		  .dstStageMask = next.stages,
+		  .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+		  .dstAccessMask = next.access,
+		  .dependencyFlags = {},
+		};
+		VkSubpassDependency const subpass_dependencies[] = {into_subpass, out_of_subpass};
 		auto const render_pass_info = VkRenderPassCreateInfo{
 		  .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
 		  .pNext = nullptr,
@@ -689,8 +1413,8 @@ namespace vulkan {
 		  .pAttachments = &colour_attachment,
 		  .subpassCount = 1,
 		  .pSubpasses = &subpass,
-		  .dependencyCount = 1,
-		  .pDependencies = &subpass_dependency,
+		  .dependencyCount = static_cast<std::uint32_t>(std::size(subpass_dependencies)),
+		  .pDependencies = subpass_dependencies,
 		};
 
 		VkRenderPass resource;
@@ -705,16 +1429,357 @@ namespace vulkan {
 	: render_pass_(renderpass, {vkDestroyRenderPass, device, allocator})
 	{}
 
+	error_or<descriptor_set_layout> descriptor_set_layout::create(
+	  device const& d,
+	  std::span<VkDescriptorSetLayoutBinding const> const bindings,
+	  VkAllocationCallbacks const* const allocator) noexcept
+	{
+		return create(d, bindings, {}, {}, allocator);
+	}
+
+	error_or<descriptor_set_layout> descriptor_set_layout::create(
+	  device const& d,
+	  std::span<VkDescriptorSetLayoutBinding const> const bindings,
+	  std::span<VkDescriptorBindingFlags const> const binding_flags,
+	  VkDescriptorSetLayoutCreateFlags const flags,
+	  VkAllocationCallbacks const* const allocator) noexcept
+	{
+		CJDB_EXPECTS(binding_flags.empty() or binding_flags.size() == bindings.size());
+
+		auto const flags_info = VkDescriptorSetLayoutBindingFlagsCreateInfo{
+		  .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
+		  .pNext = nullptr,
+		  .bindingCount = static_cast<std::uint32_t>(binding_flags.size()),
+		  .pBindingFlags = binding_flags.data(),
+		};
+		auto const layout_info = VkDescriptorSetLayoutCreateInfo{
+		  .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+		  .pNext = binding_flags.empty() ? nullptr : &flags_info,
+		  .flags = flags,
+		  .bindingCount = static_cast<std::uint32_t>(bindings.size()),
+		  .pBindings = bindings.data(),
+		};
+
+		auto layout = VkDescriptorSetLayout{};
+		if (auto const result = vkCreateDescriptorSetLayout(d.get(), &layout_info, allocator, &layout);
+		    result != VK_SUCCESS)
+		{
+			return std::unexpected(static_cast<error>(result));
+		}
+
+		return descriptor_set_layout(layout, d.get(), allocator);
+	}
+
+	descriptor_set_layout::descriptor_set_layout(
+	  VkDescriptorSetLayout const layout,
+	  VkDevice const device,
+	  VkAllocationCallbacks const* const allocator) noexcept
+	: layout_(layout, {vkDestroyDescriptorSetLayout, device, allocator})
+	{}
+
+	error_or<descriptor_pool> descriptor_pool::create(
+	  device const& d,
+	  std::uint32_t const max_sets,
+	  std::span<VkDescriptorPoolSize const> const sizes,
+	  VkDescriptorPoolCreateFlags const flags,
+	  VkAllocationCallbacks const* const allocator) noexcept
+	{
+		auto const pool_info = VkDescriptorPoolCreateInfo{
+		  .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+		  .pNext = nullptr,
+		  .flags = flags,
+		  .maxSets = max_sets,
+		  .poolSizeCount = static_cast<std::uint32_t>(sizes.size()),
+		  .pPoolSizes = sizes.data(),
+		};
+
+		auto pool = VkDescriptorPool{};
+		if (auto const result = vkCreateDescriptorPool(d.get(), &pool_info, allocator, &pool); result != VK_SUCCESS) {
+			return std::unexpected(static_cast<error>(result));
+		}
+
+		return descriptor_pool(pool, d.get(), allocator);
+	}
+
+	descriptor_pool::descriptor_pool(
+	  VkDescriptorPool const pool,
+	  VkDevice const device,
+	  VkAllocationCallbacks const* const allocator) noexcept
+	: pool_(pool, {vkDestroyDescriptorPool, device, allocator})
+	, device_(device)
+	{}
+
+	error_or<VkDescriptorSet> descriptor_pool::allocate(descriptor_set_layout const& layout) const noexcept
+	{
+		auto const set_layout = layout.get();
+		auto const allocate_info = VkDescriptorSetAllocateInfo{
+		  .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+		  .pNext = nullptr,
+		  .descriptorPool = pool_.get(),
+		  .descriptorSetCount = 1,
+		  .pSetLayouts = &set_layout,
+		};
+
+		auto set = VkDescriptorSet{};
+		if (auto const result = vkAllocateDescriptorSets(device_, &allocate_info, &set); result != VK_SUCCESS) {
+			return std::unexpected(static_cast<error>(result));
+		}
+
+		return set;
+	}
+
+	void descriptor_pool::reset() const noexcept
+	{
+		vkResetDescriptorPool(device_, pool_.get(), {});
+	}
+
+	static void write_descriptor(
+	  device const& d,
+	  VkDescriptorSet const set,
+	  std::uint32_t const binding,
+	  VkDescriptorType const type,
+	  VkDescriptorBufferInfo const* const buffer,
+	  VkDescriptorImageInfo const* const image,
+	  std::uint32_t const array_element) noexcept
+	{
+		auto const write = VkWriteDescriptorSet{
+		  .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+		  .pNext = nullptr,
+		  .dstSet = set,
+		  .dstBinding = binding,
+		  .dstArrayElement = array_element,
+		  .descriptorCount = 1,
+		  .descriptorType = type,
+		  .pImageInfo = image,
+		  .pBufferInfo = buffer,
+		  .pTexelBufferView = nullptr,
+		};
+		vkUpdateDescriptorSets(d.get(), 1, &write, 0, nullptr);
+	}
+
+	void write_descriptor(
+	  device const& d,
+	  VkDescriptorSet const set,
+	  std::uint32_t const binding,
+	  VkDescriptorType const type,
+	  VkDescriptorBufferInfo const& buffer,
+	  std::uint32_t const array_element) noexcept
+	{
+		write_descriptor(d, set, binding, type, &buffer, nullptr, array_element);
+	}
+
+	void write_descriptor(
+	  device const& d,
+	  VkDescriptorSet const set,
+	  std::uint32_t const binding,
+	  VkDescriptorType const type,
+	  VkDescriptorImageInfo const& image,
+	  std::uint32_t const array_element) noexcept
+	{
+		write_descriptor(d, set, binding, type, nullptr, &image, array_element);
+	}
+
+	error_or<frame_descriptor_allocator> frame_descriptor_allocator::create(
+	  device const& d,
+	  std::uint32_t const frames_in_flight,
+	  std::uint32_t const sets_per_pool,
+	  std::span<VkDescriptorPoolSize const> const sizes_per_pool,
+	  VkAllocationCallbacks const* const allocator) noexcept
+	{
+		CJDB_EXPECTS(frames_in_flight > 0);
+
+		auto frames = std::vector<frame_pools>(frames_in_flight);
+		for (auto& frame : frames) {
+			auto pool = descriptor_pool::create(d, sets_per_pool, sizes_per_pool, {}, allocator);
+			if (not pool) {
+				return std::unexpected(pool.error());
+			}
+
+			frame.pools.push_back(std::move(*pool));
+		}
+
+		return frame_descriptor_allocator(
+		  d,
+		  allocator,
+		  sets_per_pool,
+		  {sizes_per_pool.begin(), sizes_per_pool.end()},
+		  std::move(frames));
+	}
+
+	frame_descriptor_allocator::frame_descriptor_allocator(
+	  device const& d,
+	  VkAllocationCallbacks const* const allocator,
+	  std::uint32_t const sets_per_pool,
+	  std::vector<VkDescriptorPoolSize> sizes_per_pool,
+	  std::vector<frame_pools> frames) noexcept
+	: device_(&d)
+	, allocator_(allocator)
+	, sets_per_pool_(sets_per_pool)
+	, sizes_per_pool_(std::move(sizes_per_pool))
+	, frames_(std::move(frames))
+	{}
+
+	void frame_descriptor_allocator::begin_frame(std::uint32_t const frame) noexcept
+	{
+		CJDB_EXPECTS(frame < frames_.size());
+
+		frame_ = frame;
+		auto& pools = frames_[frame];
+		for (auto const& pool : std::span(pools.pools).first(pools.current + 1)) {
+			pool.reset();
+		}
+
+		pools.current = 0;
+	}
+
+	error_or<VkDescriptorSet> frame_descriptor_allocator::allocate(descriptor_set_layout const& layout) noexcept
+	{
+		auto& pools = frames_[frame_];
+		while (true) {
+			auto set = pools.pools[pools.current].allocate(layout);
+			if (set or (set.error() != error::no_pool_memory and set.error() != error::fragmented_pool)) {
+				return set;
+			}
+
+			++pools.current;
+			if (pools.current < pools.pools.size()) {
+				continue;
+			}
+
+			auto pool = descriptor_pool::create(*device_, sets_per_pool_, sizes_per_pool_, {}, allocator_);
+			if (not pool) {
+				--pools.current;
+				return std::unexpected(pool.error());
+			}
+
+			pools.pools.push_back(std::move(*pool));
+		}
+	}
+
+	error_or<bindless_textures> bindless_textures::create(
+	  device const& d,
+	  std::uint32_t const capacity,
+	  VkShaderStageFlags const stages,
+	  VkAllocationCallbacks const* const allocator) noexcept
+	{
+		if (not d.physical_device().descriptor_indexing) {
+			return std::unexpected(error::feature_unavailable);
+		}
+
+		if (capacity > d.physical_device().max_bindless_textures) {
+			return std::unexpected(error::bindless_capacity_too_large);
+		}
+
+		auto const layout_binding = VkDescriptorSetLayoutBinding{
+		  .binding = binding,
+		  .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+		  .descriptorCount = capacity,
+		  .stageFlags = stages,
+		  .pImmutableSamplers = nullptr,
+		};
+		constexpr auto binding_flags = VkDescriptorBindingFlags{
+		  VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT
+		  | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT};
+		auto layout = descriptor_set_layout::create(
+		  d,
+		  {&layout_binding, 1},
+		  {&binding_flags, 1},
+		  VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT,
+		  allocator);
+		if (not layout) {
+			return std::unexpected(layout.error());
+		}
+
+		auto const size = VkDescriptorPoolSize{
+		  .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+		  .descriptorCount = capacity,
+		};
+		auto pool = descriptor_pool::create(d, 1, {&size, 1}, VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT, allocator);
+		if (not pool) {
+			return std::unexpected(pool.error());
+		}
+
+		auto const set = pool->allocate(*layout);
+		if (not set) {
+			return std::unexpected(set.error());
+		}
+
+		return bindless_textures(std::move(*layout), std::move(*pool), *set, d, capacity);
+	}
+
+	bindless_textures::bindless_textures(
+	  descriptor_set_layout layout,
+	  descriptor_pool pool,
+	  VkDescriptorSet const set,
+	  device const& d,
+	  std::uint32_t const capacity) noexcept
+	: layout_(std::move(layout))
+	, pool_(std::move(pool))
+	, set_(set)
+	, device_(&d)
+	, capacity_(capacity)
+	{}
+
+	error_or<std::uint32_t> bindless_textures::add(
+	  VkImageView const view,
+	  VkSampler const sampler,
+	  VkImageLayout const layout) noexcept
+	{
+		auto index = next_;
+		if (not free_.empty()) {
+			index = free_.back();
+			free_.pop_back();
+		}
+		else if (next_ < capacity_) {
+			++next_;
+		}
+		else {
+			return std::unexpected(error::too_many_objects);
+		}
+
+		auto const image = VkDescriptorImageInfo{
+		  .sampler = sampler,
+		  .imageView = view,
+		  .imageLayout = layout,
+		};
+		write_descriptor(*device_, set_, binding, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, image, index);
+		return index;
+	}
+
+	void bindless_textures::remove(std::uint32_t const index) noexcept
+	{
+		CJDB_EXPECTS(index < next_);
+		CJDB_EXPECTS(not std::ranges::contains(free_, index));
+		free_.push_back(index);
+	}
+
 	error_or<pipeline_layout> pipeline_layout::create(device const& d, VkAllocationCallbacks const* const allocator) noexcept
 	{
-		constexpr auto layout_info = VkPipelineLayoutCreateInfo{
+		return create(d, {}, {}, allocator);
+	}
+
+	error_or<pipeline_layout> pipeline_layout::create(
+	  device const& d,
+	  std::span<VkDescriptorSetLayout const> const set_layouts,
+	  std::span<VkPushConstantRange const> const push_constants,
+	  VkAllocationCallbacks const* const allocator) noexcept
+	{
+		auto const max_size = d.physical_device().properties.limits.maxPushConstantsSize;
+		if (std::ranges::any_of(push_constants, [max_size](VkPushConstantRange const& range) noexcept {
+			    return range.size > max_size or range.offset > max_size - range.size;
+		    }))
+		{
+			return std::unexpected(error::push_constants_too_large);
+		}
+
+		auto const layout_info = VkPipelineLayoutCreateInfo{
 		  .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
 		  .pNext = nullptr,
 		  .flags = {},
-		  .setLayoutCount = 0,
-		  .pSetLayouts = nullptr,
-		  .pushConstantRangeCount = 0,
-		  .pPushConstantRanges = nullptr,
+		  .setLayoutCount = static_cast<std::uint32_t>(set_layouts.size()),
+		  .pSetLayouts = set_layouts.data(),
+		  .pushConstantRangeCount = static_cast<std::uint32_t>(push_constants.size()),
+		  .pPushConstantRanges = push_constants.data(),
 		};
 
 		auto layout = VkPipelineLayout{};
@@ -732,13 +1797,232 @@ namespace vulkan {
 	: layout_(layout, {vkDestroyPipelineLayout, device, allocator})
 	{}
 
+	[[nodiscard]] static bool is_compatible_cache(physical_device const& device, std::span<std::byte const> const data) noexcept
+	{
+		auto header = VkPipelineCacheHeaderVersionOne{};
+		if (data.size() < sizeof(header)) {
+			return false;
+		}
+
+		std::memcpy(&header, data.data(), sizeof(header));
+		return header.headerSize >= sizeof(header) and header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+		   and header.vendorID == device.properties.vendorID and header.deviceID == device.properties.deviceID
+		   and std::ranges::equal(header.pipelineCacheUUID, device.properties.pipelineCacheUUID);
+	}
+
+	error_or<pipeline_cache> pipeline_cache::create(device const& d, VkAllocationCallbacks const* const allocator) noexcept
+	{
+		return create(d, std::span<std::byte const>(), allocator);
+	}
+
+	error_or<pipeline_cache> pipeline_cache::create(
+	  device const& d,
+	  std::span<std::byte const> initial_data,
+	  VkAllocationCallbacks const* const allocator) noexcept
+	{
+		if (not is_compatible_cache(d.physical_device(), initial_data)) {
+			initial_data = {};
+		}
+
+		auto const cache_info = VkPipelineCacheCreateInfo{
+		  .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+		  .pNext = nullptr,
+		  .flags = {},
+		  .initialDataSize = initial_data.size(),
+		  .pInitialData = initial_data.data(),
+		};
+
+		auto resource = VkPipelineCache{};
+		if (auto const result = vkCreatePipelineCache(d.get(), &cache_info, allocator, &resource); result != VK_SUCCESS) {
+			return std::unexpected(static_cast<error>(result));
+		}
+
+		return pipeline_cache(resource, d.get(), allocator);
+	}
+
+	error_or<pipeline_cache> pipeline_cache::create(
+	  device const& d,
+	  std::filesystem::path const& path,
+	  VkAllocationCallbacks const* const allocator) noexcept
+	{
+		auto file = std::ifstream(path, std::ios_base::binary);
+		if (not file) {
+			return create(d, allocator);
+		}
+
+		auto const contents = std::vector<char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		return create(d, std::as_bytes(std::span(contents)), allocator);
+	}
+
+	pipeline_cache::pipeline_cache(
+	  VkPipelineCache const cache,
+	  VkDevice const device,
+	  VkAllocationCallbacks const* const allocator) noexcept
+	: cache_(cache, {vkDestroyPipelineCache, device, allocator})
+	, device_(device)
+	{}
+
+	error_or<std::vector<std::byte>> pipeline_cache::data() const noexcept
+	{
+		auto size = std::size_t{0};
+		if (auto const result = vkGetPipelineCacheData(device_, cache_.get(), &size, nullptr); result != VK_SUCCESS) {
+			return std::unexpected(static_cast<error>(result));
+		}
+
+		auto result = std::vector<std::byte>(size);
+		if (auto const status = vkGetPipelineCacheData(device_, cache_.get(), &size, result.data()); status != VK_SUCCESS) {
+			return std::unexpected(static_cast<error>(status));
+		}
+
+		result.resize(size);
+		return result;
+	}
+
+	error_or<void> pipeline_cache::save(std::filesystem::path const& path) const noexcept
+	{
+		auto const contents = data();
+		if (not contents) {
+			return std::unexpected(contents.error());
+		}
+
+		// Write to a sibling file first so that a crash mid-write can't leave a truncated cache behind.
+		auto temporary = path;
+		temporary += ".tmp";
+		{
+			auto file = std::ofstream(temporary, std::ios_base::binary | std::ios_base::trunc);
+			file.write(reinterpret_cast<char const*>(contents->data()), static_cast<std::streamsize>(contents->size()));
+			if (not file) {
+				return std::unexpected(error::io_failure);
+			}
+		}
+
+		auto status = std::error_code();
+		std::filesystem::rename(temporary, path, status);
+		if (status) {
+			return std::unexpected(error::io_failure);
+		}
+
+		return {};
+	}
+
+	std::size_t graphics_pipeline_state::hash() const noexcept
+	{
+		auto seed = hash_seed;
+		hash_append(seed, layout);
+		hash_append(seed, render_pass);
+		hash_append(seed, subpass);
+		hash_append(seed, colour_format);
+		hash_append(seed, viewport_extent);
+		for (auto const& [stage, module] : stages) {
+			hash_append(seed, stage);
+			hash_append(seed, module);
+		}
+
+		hash_append(seed, constants.hash());
+		hash_append(seed, bindings);
+		hash_append(seed, attributes);
+		hash_append(seed, topology);
+		hash_append(seed, polygon_mode);
+		hash_append(seed, cull_mode);
+		hash_append(seed, front_face);
+		hash_append(seed, colour_blend);
+		hash_append(seed, dynamic_states);
+		return static_cast<std::size_t>(seed);
+	}
+
+	bool operator==(graphics_pipeline_state const& x, graphics_pipeline_state const& y) noexcept
+	{
+		constexpr auto same_stage = [](shader_stage const& a, shader_stage const& b) noexcept {
+			return a.stage == b.stage and a.module == b.module;
+		};
+
+		return x.layout == y.layout and x.render_pass == y.render_pass and x.subpass == y.subpass
+		   and x.colour_format == y.colour_format and bitwise_equal(x.viewport_extent, y.viewport_extent)
+		   and std::ranges::equal(x.stages, y.stages, same_stage) and x.constants == y.constants
+		   and std::ranges::equal(x.bindings, y.bindings, bitwise_equal)
+		   and std::ranges::equal(x.attributes, y.attributes, bitwise_equal) and x.topology == y.topology
+		   and x.polygon_mode == y.polygon_mode and x.cull_mode == y.cull_mode and x.front_face == y.front_face
+		   and bitwise_equal(x.colour_blend, y.colour_blend) and x.dynamic_states == y.dynamic_states;
+	}
+
+	// Everything but the render target, which is shared by the pipeline::create overloads that take shaders.
+	[[nodiscard]] static graphics_pipeline_state shader_pipeline_state(
+	  pipeline_layout const& layout,
+	  std::span<VkDynamicState const> const dynamic_states,
+	  VkExtent2D const viewport_extent,
+	  std::span<vertex_shader const> vertex_shaders,
+	  std::span<VkVertexInputBindingDescription const> const binding_descriptions,
+	  std::span<VkVertexInputAttributeDescription const> const attribute_descriptions,
+	  std::span<fragment_shader const> fragment_shaders,
+	  std::span<tesselation_control_shader const> tesselation_control_shaders,
+	  std::span<tesselation_evaluation_shader const> tesselation_evaluation_shaders,
+	  std::span<geometry_shader const> geometry_shaders,
+	  specialisation_constants const& constants) noexcept
+	{
+		auto state = graphics_pipeline_state{
+		  .layout = layout.get(),
+		  .viewport_extent = viewport_extent,
+		  .constants = constants,
+		  .bindings = {binding_descriptions.begin(), binding_descriptions.end()},
+		  .attributes = {attribute_descriptions.begin(), attribute_descriptions.end()},
+		  .dynamic_states = {dynamic_states.begin(), dynamic_states.end()},
+		};
+
+		state.stages.reserve(
+		  vertex_shaders.size() + fragment_shaders.size() + tesselation_control_shaders.size()
+		  + tesselation_evaluation_shaders.size() + geometry_shaders.size());
+		auto stage = [](auto const& shader) noexcept { return shader.stage(); };
+		std::ranges::transform(vertex_shaders, std::back_inserter(state.stages), stage);
+		std::ranges::transform(fragment_shaders, std::back_inserter(state.stages), stage);
+		std::ranges::transform(tesselation_control_shaders, std::back_inserter(state.stages), stage);
+		std::ranges::transform(tesselation_evaluation_shaders, std::back_inserter(state.stages), stage);
+		std::ranges::transform(geometry_shaders, std::back_inserter(state.stages), stage);
+		return state;
+	}
+
 	template<pipeline_kind kind>
 	error_or<pipeline<kind>> pipeline<kind>::create(
 	  device const& d,
+	  pipeline_cache const& cache,
 	  pipeline_layout const& layout,
 	  render_pass const& renderpass,
 	  std::span<VkDynamicState const> const dynamic_states,
-	  swapchain const& swap_chain,
+	  VkExtent2D const viewport_extent,
+	  std::span<vertex_shader const> vertex_shaders,
+	  std::span<VkVertexInputBindingDescription const> const binding_descriptions,
+	  std::span<VkVertexInputAttributeDescription const> const attribute_descriptions,
+	  std::span<fragment_shader const> fragment_shaders,
+	  std::span<tesselation_control_shader const> tesselation_control_shaders,
+	  std::span<tesselation_evaluation_shader const> tesselation_evaluation_shaders,
+	  std::span<geometry_shader const> geometry_shaders,
+	  specialisation_constants const& constants,
+	  VkAllocationCallbacks const* const allocator) noexcept
+	requires (kind == pipeline_kind::graphics)
+	{
+		auto state = shader_pipeline_state(
+		  layout,
+		  dynamic_states,
+		  viewport_extent,
+		  vertex_shaders,
+		  binding_descriptions,
+		  attribute_descriptions,
+		  fragment_shaders,
+		  tesselation_control_shaders,
+		  tesselation_evaluation_shaders,
+		  geometry_shaders,
+		  constants);
+		state.render_pass = renderpass.get();
+		return create(d, cache, state, allocator);
+	}
+
+	template<pipeline_kind kind>
+	error_or<pipeline<kind>> pipeline<kind>::create(
+	  device const& d,
+	  pipeline_cache const& cache,
+	  pipeline_layout const& layout,
+	  VkFormat const colour_format,
+	  std::span<VkDynamicState const> const dynamic_states,
+	  VkExtent2D const viewport_extent,
 	  std::span<vertex_shader const> vertex_shaders,
 	  std::span<VkVertexInputBindingDescription const> const binding_descriptions,
 	  std::span<VkVertexInputAttributeDescription const> const attribute_descriptions,
@@ -746,6 +2030,31 @@ namespace vulkan {
 	  std::span<tesselation_control_shader const> tesselation_control_shaders,
 	  std::span<tesselation_evaluation_shader const> tesselation_evaluation_shaders,
 	  std::span<geometry_shader const> geometry_shaders,
+	  specialisation_constants const& constants,
+	  VkAllocationCallbacks const* const allocator) noexcept
+	requires (kind == pipeline_kind::graphics)
+	{
+		auto state = shader_pipeline_state(
+		  layout,
+		  dynamic_states,
+		  viewport_extent,
+		  vertex_shaders,
+		  binding_descriptions,
+		  attribute_descriptions,
+		  fragment_shaders,
+		  tesselation_control_shaders,
+		  tesselation_evaluation_shaders,
+		  geometry_shaders,
+		  constants);
+		state.colour_format = colour_format;
+		return create(d, cache, state, allocator);
+	}
+
+	template<pipeline_kind kind>
+	error_or<pipeline<kind>> pipeline<kind>::create(
+	  device const& d,
+	  pipeline_cache const& cache,
+	  graphics_pipeline_state const& state,
 	  VkAllocationCallbacks const* const allocator) noexcept
 	requires (kind == pipeline_kind::graphics)
 	{
@@ -753,36 +2062,36 @@ namespace vulkan {
 		  .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
 		  .pNext = nullptr,
 		  .flags = {},
-		  .vertexBindingDescriptionCount = static_cast<std::uint32_t>(binding_descriptions.size()),
-		  .pVertexBindingDescriptions = binding_descriptions.data(),
-		  .vertexAttributeDescriptionCount = static_cast<std::uint32_t>(attribute_descriptions.size()),
-		  .pVertexAttributeDescriptions = attribute_descriptions.data(),
+		  .vertexBindingDescriptionCount = static_cast<std::uint32_t>(state.bindings.size()),
+		  .pVertexBindingDescriptions = state.bindings.data(),
+		  .vertexAttributeDescriptionCount = static_cast<std::uint32_t>(state.attributes.size()),
+		  .pVertexAttributeDescriptions = state.attributes.data(),
 		};
-		constexpr auto input_assembly = VkPipelineInputAssemblyStateCreateInfo{
+		auto const input_assembly = VkPipelineInputAssemblyStateCreateInfo{
 		  .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
 		  .pNext = nullptr,
 		  .flags = {},
-		  .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+		  .topology = state.topology,
 		  .primitiveRestartEnable = VK_FALSE,
 		};
 		auto const dynamic_state = VkPipelineDynamicStateCreateInfo{
 		  .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
 		  .pNext = nullptr,
 		  .flags = {},
-		  .dynamicStateCount = static_cast<std::uint32_t>(dynamic_states.size()),
-		  .pDynamicStates = dynamic_states.data(),
+		  .dynamicStateCount = static_cast<std::uint32_t>(state.dynamic_states.size()),
+		  .pDynamicStates = state.dynamic_states.data(),
 		};
 		auto const viewport = VkViewport{
 		  .x = 0.0f,
 		  .y = 0.0f,
-		  .width = static_cast<float>(swap_chain.extent().width),
-		  .height = static_cast<float>(swap_chain.extent().height),
+		  .width = static_cast<float>(state.viewport_extent.width),
+		  .height = static_cast<float>(state.viewport_extent.height),
 		  .minDepth = 0.0f,
 		  .maxDepth = 1.0f,
 		};
 		auto const scissor = VkRect2D{
 		  .offset = {0, 0},
-		  .extent = swap_chain.extent(),
+		  .extent = state.viewport_extent,
 		};
 		auto const viewport_state = VkPipelineViewportStateCreateInfo{
 		  .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
@@ -793,15 +2102,15 @@ namespace vulkan {
 		  .scissorCount = 1,
 		  .pScissors = &scissor,
 		};
-		constexpr auto rasteriser = VkPipelineRasterizationStateCreateInfo{
+		auto const rasteriser = VkPipelineRasterizationStateCreateInfo{
 		  .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
 		  .pNext = nullptr,
 		  .flags = {},
 		  .depthClampEnable = VK_FALSE,
 		  .rasterizerDiscardEnable = VK_FALSE,
-		  .polygonMode = VK_POLYGON_MODE_FILL,
-		  .cullMode = VK_CULL_MODE_BACK_BIT,
-		  .frontFace = VK_FRONT_FACE_CLOCKWISE,
+		  .polygonMode = state.polygon_mode,
+		  .cullMode = state.cull_mode,
+		  .frontFace = state.front_face,
 		  .depthBiasEnable = VK_FALSE,
 		  .depthBiasConstantFactor = 0.0f,
 		  .depthBiasClamp = 0.0f,
@@ -819,17 +2128,6 @@ namespace vulkan {
 		  .alphaToCoverageEnable = VK_FALSE,
 		  .alphaToOneEnable = VK_FALSE,
 		};
-		constexpr auto colour_blend_attachment = VkPipelineColorBlendAttachmentState{
-		  .blendEnable = VK_FALSE,
-		  .srcColorBlendFactor = VK_BLEND_FACTOR_ONE,
-		  .dstColorBlendFactor = VK_BLEND_FACTOR_ZERO,
-		  .colorBlendOp = VK_BLEND_OP_ADD,
-		  .srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
-		  .dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
-		  .alphaBlendOp = VK_BLEND_OP_ADD,
-		  .colorWriteMask =
-		    VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
-		};
 		auto const colour_blending = VkPipelineColorBlendStateCreateInfo{
 		  .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
 		  .pNext = nullptr,
@@ -837,23 +2135,36 @@ namespace vulkan {
 		  .logicOpEnable = VK_FALSE,
 		  .logicOp = VK_LOGIC_OP_COPY,
 		  .attachmentCount = 1,
-		  .pAttachments = &colour_blend_attachment,
+		  .pAttachments = &state.colour_blend,
 		  .blendConstants = {},
 		};
 
-		auto shader_stages = std::vector<VkPipelineShaderStageCreateInfo>(
-		  vertex_shaders.size() + fragment_shaders.size() + tesselation_control_shaders.size()
-		  + tesselation_evaluation_shaders.size() + geometry_shaders.size());
-		auto pipeline_create_info = [](auto const& shader) noexcept { return shader.pipeline_create_info(); };
-		auto next_shader = std::ranges::transform(vertex_shaders, shader_stages.begin(), pipeline_create_info).out;
-		next_shader = std::ranges::transform(fragment_shaders, next_shader, pipeline_create_info).out;
-		next_shader = std::ranges::transform(tesselation_control_shaders, next_shader, pipeline_create_info).out;
-		next_shader = std::ranges::transform(tesselation_evaluation_shaders, next_shader, pipeline_create_info).out;
-		std::ranges::transform(geometry_shaders, next_shader, pipeline_create_info);
+		auto const specialisation = state.constants.info();
+		auto shader_stages = std::vector<VkPipelineShaderStageCreateInfo>(state.stages.size());
+		std::ranges::transform(state.stages, shader_stages.begin(), [&](shader_stage const& stage) noexcept {
+			return VkPipelineShaderStageCreateInfo{
+			  .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+			  .pNext = nullptr,
+			  .flags = {},
+			  .stage = stage.stage,
+			  .module = stage.module,
+			  .pName = "main",
+			  .pSpecializationInfo = state.constants.empty() ? nullptr : &specialisation,
+			};
+		});
 
+		auto const rendering_info = VkPipelineRenderingCreateInfo{
+		  .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
+		  .pNext = nullptr,
+		  .viewMask = 0,
+		  .colorAttachmentCount = 1,
+		  .pColorAttachmentFormats = &state.colour_format,
+		  .depthAttachmentFormat = VK_FORMAT_UNDEFINED,
+		  .stencilAttachmentFormat = VK_FORMAT_UNDEFINED,
+		};
 		auto const pipeline_info = VkGraphicsPipelineCreateInfo{
 		  .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
-		  .pNext = nullptr,
+		  .pNext = state.render_pass == VK_NULL_HANDLE ? &rendering_info : nullptr,
 		  .flags = {},
 		  .stageCount = static_cast<std::uint32_t>(shader_stages.size()),
 		  .pStages = shader_stages.data(),
@@ -866,15 +2177,46 @@ namespace vulkan {
 		  .pDepthStencilState = nullptr,
 		  .pColorBlendState = &colour_blending,
 		  .pDynamicState = &dynamic_state,
+		  .layout = state.layout,
+		  .renderPass = state.render_pass,
+		  .subpass = state.subpass,
+		  .basePipelineHandle = VK_NULL_HANDLE,
+		  .basePipelineIndex = -1,
+		};
+
+		auto resource = VkPipeline{};
+		if (auto const result = vkCreateGraphicsPipelines(d.get(), cache.get(), 1, &pipeline_info, allocator, &resource);
+		    result != VK_SUCCESS)
+		{
+			return std::unexpected(static_cast<error>(result));
+		}
+
+		return pipeline(resource, d.get(), allocator);
+	}
+
+	template<pipeline_kind kind>
+	error_or<pipeline<kind>> pipeline<kind>::create(
+	  device const& d,
+	  pipeline_cache const& cache,
+	  pipeline_layout const& layout,
+	  compute_shader const& kernel,
+	  specialisation_constants const& constants,
+	  VkAllocationCallbacks const* const allocator) noexcept
+	requires (kind == pipeline_kind::compute)
+	{
+		auto const specialisation = constants.info();
+		auto const pipeline_info = VkComputePipelineCreateInfo{
+		  .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+		  .pNext = nullptr,
+		  .flags = {},
+		  .stage = kernel.pipeline_create_info("main", constants.empty() ? nullptr : &specialisation),
 		  .layout = layout.get(),
-		  .renderPass = renderpass.get(),
-		  .subpass = 0,
 		  .basePipelineHandle = VK_NULL_HANDLE,
 		  .basePipelineIndex = -1,
 		};
 
 		auto resource = VkPipeline{};
-		if (auto const result = vkCreateGraphicsPipelines(d.get(), VK_NULL_HANDLE, 1, &pipeline_info, allocator, &resource);
+		if (auto const result = vkCreateComputePipelines(d.get(), cache.get(), 1, &pipeline_info, allocator, &resource);
 		    result != VK_SUCCESS)
 		{
 			return std::unexpected(static_cast<error>(result));
@@ -897,12 +2239,173 @@ namespace vulkan {
 	template class pipeline<pipeline_kind::graphics>;
 	template class pipeline<pipeline_kind::compute>;
 
+	struct pipeline_variants::variant_table {
+		struct variant {
+			std::once_flag compiled;
+			std::atomic<bool> ready = false;
+			std::atomic<bool> queued = false;
+			std::optional<graphics_pipeline> pipeline;
+			error failure = {};
+		};
+
+		struct state_hash {
+			std::size_t operator()(graphics_pipeline_state const& state) const noexcept
+			{
+				return state.hash();
+			}
+		};
+
+		// Elements of an unordered_map are never relocated, so entries can be handed out while the map grows.
+		using entry = std::pair<graphics_pipeline_state const, variant>;
+
+		device const* owner;
+		pipeline_cache const* cache;
+		VkAllocationCallbacks const* allocator;
+
+		mutable std::shared_mutex variants_mutex;
+		std::unordered_map<graphics_pipeline_state, variant, state_hash> variants;
+
+		std::mutex queue_mutex;
+		std::condition_variable_any work_available;
+		std::condition_variable_any work_done;
+		std::deque<entry*> queue;
+		std::size_t compiling = 0;
+
+		// Declared last so that it's joined before anything it uses is destroyed.
+		std::jthread worker;
+
+		variant_table(device const& d, pipeline_cache const& c, VkAllocationCallbacks const* const a) noexcept
+		: owner(&d)
+		, cache(&c)
+		, allocator(a)
+		, worker([this](std::stop_token const token) { work(token); })
+		{}
+
+		entry& find(graphics_pipeline_state const& state) noexcept
+		{
+			{
+				auto const lock = std::shared_lock(variants_mutex);
+				if (auto const i = variants.find(state); i != variants.end()) {
+					return *i;
+				}
+			}
+
+			auto const lock = std::unique_lock(variants_mutex);
+			return *variants.try_emplace(state).first;
+		}
+
+		void compile(entry& e) noexcept
+		{
+			std::call_once(e.second.compiled, [this, &e] {
+				auto result = graphics_pipeline::create(*owner, *cache, e.first, allocator);
+				if (result) {
+					e.second.pipeline.emplace(std::move(*result));
+				}
+				else {
+					e.second.failure = result.error();
+				}
+
+				e.second.ready.store(true, std::memory_order_release);
+			});
+		}
+
+		void work(std::stop_token const token) noexcept
+		{
+			auto lock = std::unique_lock(queue_mutex);
+			while (work_available.wait(lock, token, [this] { return not queue.empty(); })) {
+				auto* const next = queue.front();
+				queue.pop_front();
+				++compiling;
+
+				lock.unlock();
+				compile(*next);
+				lock.lock();
+
+				--compiling;
+				if (queue.empty() and compiling == 0) {
+					work_done.notify_all();
+				}
+			}
+		}
+	};
+
+	error_or<pipeline_variants> pipeline_variants::create(
+	  device const& d,
+	  pipeline_cache const& cache,
+	  VkAllocationCallbacks const* const allocator) noexcept
+	{
+		return pipeline_variants(std::make_unique<variant_table>(d, cache, allocator));
+	}
+
+	pipeline_variants::pipeline_variants(std::unique_ptr<variant_table> table) noexcept
+	: table_(std::move(table))
+	{}
+
+	pipeline_variants::pipeline_variants(pipeline_variants&&) noexcept = default;
+	pipeline_variants& pipeline_variants::operator=(pipeline_variants&&) noexcept = default;
+	pipeline_variants::~pipeline_variants() = default;
+
+	error_or<VkPipeline> pipeline_variants::get(graphics_pipeline_state const& state) noexcept
+	{
+		auto& entry = table_->find(state);
+		table_->compile(entry);
+
+		auto const& variant = entry.second;
+		if (not variant.pipeline) {
+			return std::unexpected(variant.failure);
+		}
+
+		return variant.pipeline->get();
+	}
+
+	VkPipeline pipeline_variants::get_or(graphics_pipeline_state const& state, VkPipeline const fallback) noexcept
+	{
+		auto& entry = table_->find(state);
+		auto& variant = entry.second;
+		if (variant.ready.load(std::memory_order_acquire)) {
+			return variant.pipeline ? variant.pipeline->get() : fallback;
+		}
+
+		if (not variant.queued.exchange(true)) {
+			{
+				auto const lock = std::unique_lock(table_->queue_mutex);
+				table_->queue.push_back(&entry);
+			}
+
+			table_->work_available.notify_one();
+		}
+
+		return fallback;
+	}
+
+	void pipeline_variants::wait() noexcept
+	{
+		auto lock = std::unique_lock(table_->queue_mutex);
+		table_->work_done.wait(lock, [this] { return table_->queue.empty() and table_->compiling == 0; });
+	}
+
+	std::size_t pipeline_variants::size() const noexcept
+	{
+		auto const lock = std::shared_lock(table_->variants_mutex);
+		return table_->variants.size();
+	}
+
 	error_or<framebuffer> framebuffer::create(
 	  device const& d,
 	  image_view const& view,
 	  render_pass const& pass,
 	  swapchain const& chain,
 	  VkAllocationCallbacks const* const alloc) noexcept
+	{
+		return create(d, view, pass, chain.extent(), alloc);
+	}
+
+	error_or<framebuffer> framebuffer::create(
+	  device const& d,
+	  image_view const& view,
+	  render_pass const& pass,
+	  VkExtent2D const extent,
+	  VkAllocationCallbacks const* const alloc) noexcept
 	{
 		auto const attachment = view.get();
 		auto const framebuffer_info = VkFramebufferCreateInfo{
@@ -912,8 +2415,8 @@ namespace vulkan {
 		  .renderPass = pass.get(),
 		  .attachmentCount = 1,
 		  .pAttachments = &attachment,
-		  .width = chain.extent().width,
-		  .height = chain.extent().height,
+		  .width = extent.width,
+		  .height = extent.height,
 		  .layers = 1,
 		};
 
@@ -934,19 +2437,324 @@ namespace vulkan {
 		return framebuffer_.get();
 	}
 
-	error_or<command_pool> command_pool::create(
+	error_or<gpu_profiler> gpu_profiler::create(
 	  device const& d,
-	  window::window const& w,
+	  std::uint32_t const frames_in_flight,
+	  std::uint32_t const max_scopes,
+	  VkQueryPipelineStatisticFlags const statistics,
 	  VkAllocationCallbacks const* const alloc) noexcept
 	{
-		auto family = find_present_queue(d.physical_device(), w.get_surface());
-		assert(family != std::nullopt);
+		CJDB_EXPECTS(frames_in_flight > 0);
+		CJDB_EXPECTS(max_scopes > 0);
+
+		auto const& physical = d.physical_device();
+		auto const families = queue_families(physical);
+		auto const graphics_bits = families[d.queue_family(queue_kind::graphics)].timestampValidBits;
+		auto const compute_bits = families[d.queue_family(queue_kind::compute)].timestampValidBits;
+		if (graphics_bits == 0 or (statistics != 0 and not physical.features.pipelineStatisticsQuery)) {
+			return std::unexpected(error::feature_unavailable);
+		}
+
+		auto const create_pool = [&d, alloc](
+		                           VkQueryType const type,
+		                           std::uint32_t const count,
+		                           VkQueryPipelineStatisticFlags const flags) noexcept -> error_or<VkQueryPool> {
+			auto const pool_info = VkQueryPoolCreateInfo{
+			  .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+			  .pNext = nullptr,
+			  .flags = 0,
+			  .queryType = type,
+			  .queryCount = count,
+			  .pipelineStatistics = flags,
+			};
+
+			auto pool = VkQueryPool{};
+			if (auto const result = vkCreateQueryPool(d.get(), &pool_info, alloc, &pool); result != VK_SUCCESS) {
+				return std::unexpected(static_cast<error>(result));
+			}
+
+			return pool;
+		};
+
+		// Each scope writes a timestamp when it begins and another when it ends.
+		auto const timestamps = create_pool(VK_QUERY_TYPE_TIMESTAMP, 2 * max_scopes * frames_in_flight, 0);
+		if (not timestamps) {
+			return std::unexpected(timestamps.error());
+		}
+
+		auto statistics_pool = VkQueryPool{};
+		if (statistics != 0) {
+			auto const pool = create_pool(VK_QUERY_TYPE_PIPELINE_STATISTICS, max_scopes * frames_in_flight, statistics);
+			if (not pool) {
+				vkDestroyQueryPool(d.get(), *timestamps, alloc);
+				return std::unexpected(pool.error());
+			}
+
+			statistics_pool = *pool;
+		}
+
+		return gpu_profiler(
+		  *timestamps,
+		  statistics_pool,
+		  d.get(),
+		  alloc,
+		  statistics,
+		  static_cast<double>(physical.properties.limits.timestampPeriod),
+		  compute_bits == 0 ? graphics_bits : std::min(graphics_bits, compute_bits),
+		  max_scopes,
+		  frames_in_flight,
+		  compute_bits != 0);
+	}
+
+	gpu_profiler::gpu_profiler(
+	  VkQueryPool const timestamps,
+	  VkQueryPool const statistics,
+	  VkDevice const device,
+	  VkAllocationCallbacks const* const alloc,
+	  VkQueryPipelineStatisticFlags const statistic_flags,
+	  double const timestamp_period,
+	  std::uint32_t const timestamp_valid_bits,
+	  std::uint32_t const max_scopes,
+	  std::uint32_t const frames_in_flight,
+	  bool const times_compute) noexcept
+	: timestamps_(timestamps, {vkDestroyQueryPool, device, alloc})
+	, statistics_(statistics, {vkDestroyQueryPool, device, alloc})
+	, device_(device)
+	, statistic_flags_(statistic_flags)
+	, timestamp_period_(timestamp_period)
+	, timestamp_mask_(timestamp_valid_bits >= 64 ? ~std::uint64_t{0} : (std::uint64_t{1} << timestamp_valid_bits) - 1)
+	, max_scopes_(max_scopes)
+	, frames_(frames_in_flight)
+	, times_compute_(times_compute)
+	{}
+
+	error_or<void> gpu_profiler::begin_frame(VkCommandBuffer const command, std::uint32_t const frame) noexcept
+	{
+		CJDB_EXPECTS(frame < frames_.size());
+		CJDB_EXPECTS(open_scopes_.empty());
+		if (auto const result = read_back(frame); not result) {
+			return result;
+		}
+
+		auto& queries = frames_[frame];
+		queries.names.clear();
+		queries.depths.clear();
+		queries.frame_number = frame_number_++;
+		frame_ = frame;
+
+		vkCmdResetQueryPool(command, timestamps_.get(), 2 * max_scopes_ * frame, 2 * max_scopes_);
+		if (statistics_ != nullptr) {
+			vkCmdResetQueryPool(command, statistics_.get(), max_scopes_ * frame, max_scopes_);
+		}
+
+		return {};
+	}
+
+	std::uint32_t gpu_profiler::begin_scope(
+	  VkCommandBuffer const command,
+	  std::string_view const name,
+	  bool const collect_statistics) noexcept
+	{
+		CJDB_EXPECTS(frame_number_ > 0);
+		auto& queries = frames_[frame_];
+		if (queries.names.size() == max_scopes_) {
+			open_scopes_.push_back(dropped_scope);
+			return dropped_scope;
+		}
+
+		auto const id = static_cast<std::uint32_t>(queries.names.size());
+		auto const depth = static_cast<std::uint32_t>(open_scopes_.size());
+		queries.names.emplace_back(name);
+		queries.depths.push_back(depth);
+		open_scopes_.push_back(id);
+
+		auto const query = max_scopes_ * frame_ + id;
+		vkCmdWriteTimestamp(command, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestamps_.get(), 2 * query);
+
+		// Only one pipeline statistics query can be active at a time, so nested scopes go without.
+		if (statistics_ != nullptr and depth == 0 and collect_statistics) {
+			vkCmdBeginQuery(command, statistics_.get(), query, 0);
+			statistics_active_ = true;
+		}
+
+		return id;
+	}
+
+	void gpu_profiler::end_scope(VkCommandBuffer const command, std::uint32_t const id) noexcept
+	{
+		CJDB_EXPECTS(not open_scopes_.empty() and open_scopes_.back() == id);
+		open_scopes_.pop_back();
+		if (id == dropped_scope) {
+			return;
+		}
+
+		auto const query = max_scopes_ * frame_ + id;
+		vkCmdWriteTimestamp(command, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestamps_.get(), 2 * query + 1);
+		if (statistics_active_ and open_scopes_.empty()) {
+			vkCmdEndQuery(command, statistics_.get(), query);
+			statistics_active_ = false;
+		}
+	}
+
+	error_or<void> gpu_profiler::read_back(std::uint32_t const frame) noexcept
+	{
+		auto const& queries = frames_[frame];
+		auto const count = static_cast<std::uint32_t>(queries.names.size());
+		if (count == 0) {
+			return {};
+		}
+
+		// Every result is followed by its availability, so a scope whose queries were never written, e.g. because it
+		// didn't end, is skipped rather than waited on.
+		constexpr auto flags = VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT;
+		auto timestamps = std::vector<std::array<std::uint64_t, 2>>(2 * count);
+		auto result = vkGetQueryPoolResults(
+		  device_,
+		  timestamps_.get(),
+		  2 * max_scopes_ * frame,
+		  2 * count,
+		  timestamps.size() * sizeof(timestamps[0]),
+		  timestamps.data(),
+		  sizeof(timestamps[0]),
+		  flags);
+		if (result != VK_SUCCESS and result != VK_NOT_READY) {
+			return std::unexpected(static_cast<error>(result));
+		}
+
+		auto const stride = static_cast<std::size_t>(std::popcount(statistic_flags_)) + 1;
+		auto statistics = std::vector<std::uint64_t>(statistics_ == nullptr ? 0 : count * stride);
+		if (statistics_ != nullptr) {
+			result = vkGetQueryPoolResults(
+			  device_,
+			  statistics_.get(),
+			  max_scopes_ * frame,
+			  count,
+			  statistics.size() * sizeof(std::uint64_t),
+			  statistics.data(),
+			  stride * sizeof(std::uint64_t),
+			  flags);
+			if (result != VK_SUCCESS and result != VK_NOT_READY) {
+				return std::unexpected(static_cast<error>(result));
+			}
+		}
+
+		auto const to_ms = [this](std::uint64_t const ticks) noexcept {
+			return static_cast<double>(ticks & timestamp_mask_) * timestamp_period_ / 1'000'000.0;
+		};
+
+		auto completed = frame_result{
+		  .frame_number = queries.frame_number,
+		  .gpu_begin_ms = 0.0,
+		  .scopes = {},
+		};
+		auto origin = std::optional<std::uint64_t>();
+		for (auto i = std::size_t{0}; i < count; ++i) {
+			auto const [begin, begin_available] = timestamps[2 * i];
+			auto const [end, end_available] = timestamps[2 * i + 1];
+			if (begin_available == 0 or end_available == 0) {
+				continue;
+			}
+
+			if (not origin) {
+				origin = begin;
+				completed.gpu_begin_ms = to_ms(begin);
+			}
+
+			auto measured = scope_result{
+			  .name = queries.names[i],
+			  .depth = queries.depths[i],
+			  .begin_ms = to_ms(begin - *origin),
+			  .duration_ms = to_ms(end - begin),
+			  .statistics = {},
+			};
+
+			auto const values = std::span(statistics).subspan(std::min(i * stride, statistics.size()));
+			if (not values.empty() and values[stride - 1] != 0) {
+				measured.statistics.assign(values.begin(), values.begin() + static_cast<std::ptrdiff_t>(stride - 1));
+			}
+
+			completed.scopes.push_back(std::move(measured));
+		}
+
+		results_.push_back(std::move(completed));
+		if (results_.size() > history) {
+			results_.pop_front();
+		}
+
+		return {};
+	}
+
+	std::string gpu_profiler::chrome_trace() const
+	{
+		// Indexed by the bit's position in VkQueryPipelineStatisticFlagBits.
+		constexpr auto statistic_names = std::array<std::string_view, 11>{
+		  "input_assembly_vertices",
+		  "input_assembly_primitives",
+		  "vertex_shader_invocations",
+		  "geometry_shader_invocations",
+		  "geometry_shader_primitives",
+		  "clipping_invocations",
+		  "clipping_primitives",
+		  "fragment_shader_invocations",
+		  "tessellation_control_shader_patches",
+		  "tessellation_evaluation_shader_invocations",
+		  "compute_shader_invocations",
+		};
+
+		auto trace = std::string(R"({"displayTimeUnit":"ms","traceEvents":[)");
+		auto out = std::back_inserter(trace);
+		auto separator = std::string_view();
+		for (auto const& frame : results_) {
+			for (auto const& measured : frame.scopes) {
+				// Chrome traces are measured in microseconds.
+				std::format_to(
+				  out,
+				  R"({}{{"name":"{}","cat":"gpu","ph":"X","pid":0,"tid":0,"ts":{:.3f},"dur":{:.3f},"args":{{"frame":{})",
+				  separator,
+				  json::escape(measured.name),
+				  (frame.gpu_begin_ms + measured.begin_ms) * 1'000.0,
+				  measured.duration_ms * 1'000.0,
+				  frame.frame_number);
+
+				auto bits = statistic_flags_;
+				for (auto const value : measured.statistics) {
+					auto const bit = static_cast<std::size_t>(std::countr_zero(bits));
+					bits &= bits - 1;
+					auto const name = bit < statistic_names.size() ? statistic_names[bit] : "statistic";
+					std::format_to(out, R"(,"{}":{})", name, value);
+				}
+
+				trace += "}}";
+				separator = ",";
+			}
+		}
+
+		trace += "]}";
+		return trace;
+	}
+
+	error_or<void> gpu_profiler::save_chrome_trace(std::filesystem::path const& path) const noexcept
+	{
+		auto const trace = chrome_trace();
+		auto file = std::ofstream(path, std::ios_base::trunc);
+		file.write(trace.data(), static_cast<std::streamsize>(trace.size()));
+		if (not file) {
+			return std::unexpected(error::io_failure);
+		}
+
+		return {};
+	}
 
+	error_or<command_pool> command_pool::create(
+	  device const& d,
+	  queue_kind const queue,
+	  VkAllocationCallbacks const* const alloc) noexcept
+	{
 		auto const pool_info = VkCommandPoolCreateInfo{
 		  .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
 		  .pNext = nullptr,
 		  .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
-		  .queueFamilyIndex = *family,
+		  .queueFamilyIndex = d.queue_family(queue),
 		};
 
 		auto resource = VkCommandPool{};
@@ -966,13 +2774,17 @@ namespace vulkan {
 		return command_pool_.get();
 	}
 
-	error_or<command_buffer> command_buffer::create(device const& d, command_pool const& p, std::uint32_t const size) noexcept
+	error_or<command_buffer> command_buffer::create(
+	  device const& d,
+	  command_pool const& p,
+	  std::uint32_t const size,
+	  VkCommandBufferLevel const level) noexcept
 	{
 		auto const buffer_info = VkCommandBufferAllocateInfo{
 		  .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
 		  .pNext = nullptr,
 		  .commandPool = p.get(),
-		  .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+		  .level = level,
 		  .commandBufferCount = size,
 		};
 
@@ -988,93 +2800,2055 @@ namespace vulkan {
 	: buffer_(std::move(buffer))
 	{}
 
-	error_or<void> command_buffer::reset(std::uint32_t const frame) noexcept
+	error_or<void> command_buffer::record(
+	  std::uint32_t const frame,
+	  std::uint32_t const image_index,
+	  render_pass const& pass,
+	  swapchain const& chain,
+	  std::span<framebuffer const> const buffers,
+	  std::span<VkCommandBuffer const> const secondaries) noexcept
 	{
-		if (auto const result = vkResetCommandBuffer(buffer_[frame], 0); result != VK_SUCCESS) {
-			return std::unexpected(static_cast<error>(result));
-		}
-
-		return {};
+		return record(frame, pass, buffers[image_index], chain.extent(), secondaries);
 	}
 
-	error_or<semaphore> semaphore::create(device const& d, VkAllocationCallbacks const* const alloc) noexcept
+	error_or<void> command_buffer::record(
+	  std::uint32_t const frame,
+	  render_pass const& pass,
+	  framebuffer const& target,
+	  VkExtent2D const extent,
+	  std::span<VkCommandBuffer const> const secondaries) noexcept
 	{
-		constexpr auto semaphore_info = VkSemaphoreCreateInfo{
-		  .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+		constexpr auto begin_info = VkCommandBufferBeginInfo{
+		  .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
 		  .pNext = nullptr,
 		  .flags = {},
+		  .pInheritanceInfo = nullptr,
 		};
 
-		auto resource = VkSemaphore{};
-		if (auto const result = vkCreateSemaphore(d.get(), &semaphore_info, alloc, &resource); result != VK_SUCCESS) {
+		if (auto const result = vkBeginCommandBuffer(buffer_[frame], &begin_info); result != VK_SUCCESS) {
 			return std::unexpected(static_cast<error>(result));
 		}
 
-		return semaphore(resource, d.get(), alloc);
-	}
-
-	semaphore::semaphore(VkSemaphore const s, VkDevice const d, VkAllocationCallbacks const* const alloc) noexcept
-	: semaphore_(s, {vkDestroySemaphore, d, alloc})
-	{}
+		if (auto const result = begin_profiling(frame); not result) {
+			return result;
+		}
 
-	error_or<fence> fence::create(device const& d, VkAllocationCallbacks const* const alloc) noexcept
-	{
-		constexpr auto fence_info = VkFenceCreateInfo{
-		  .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+		auto const clear_colour = VkClearValue{.color = {{0.0f, 0.0f, 0.0f, 1.0f}}};
+		auto const render_pass_info = VkRenderPassBeginInfo{
+		  .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
 		  .pNext = nullptr,
-		  .flags = VK_FENCE_CREATE_SIGNALED_BIT,
+		  .renderPass = pass.get(),
+		  .framebuffer = target.get(),
+		  .renderArea = VkRect2D{.offset = {}, .extent = extent},
+		  .clearValueCount = 1,
+		  .pClearValues = &clear_colour,
 		};
 
-		auto resource = VkFence{};
-		if (auto const result = vkCreateFence(d.get(), &fence_info, alloc, &resource); result != VK_SUCCESS) {
+		{
+			// The secondaries aren't recorded to inherit a pipeline statistics query, so none can be active while they
+			// execute.
+			auto const pass_scope = gpu_profiler::scope(profiler_, buffer_[frame], "render pass", false);
+			vkCmdBeginRenderPass(buffer_[frame], &render_pass_info, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+			if (not secondaries.empty()) {
+				vkCmdExecuteCommands(buffer_[frame], static_cast<std::uint32_t>(secondaries.size()), secondaries.data());
+			}
+			vkCmdEndRenderPass(buffer_[frame]);
+		}
+
+		if (auto const result = vkEndCommandBuffer(buffer_[frame]); result != VK_SUCCESS) {
 			return std::unexpected(static_cast<error>(result));
 		}
 
-		return fence(resource, d.get(), alloc);
+		return {};
 	}
 
-	fence::fence(VkFence const s, VkDevice const d, VkAllocationCallbacks const* const alloc) noexcept
-	: fence_(s, {vkDestroyFence, d, alloc})
-	, device_(d)
-	{}
-
-	error_or<void> present(
-	  device const& d,
-	  std::uint32_t const image_index,
-	  std::span<VkSwapchainKHR const> const swapchains,
-	  std::span<VkSemaphore const> const signals) noexcept
+	error_or<void> command_buffer::reset(std::uint32_t const frame) noexcept
 	{
-		auto const present_info = VkPresentInfoKHR{
-		  .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
-		  .pNext = nullptr,
-		  .waitSemaphoreCount = static_cast<std::uint32_t>(signals.size()),
-		  .pWaitSemaphores = signals.data(),
-		  .swapchainCount = static_cast<std::uint32_t>(swapchains.size()),
-		  .pSwapchains = swapchains.data(),
-		  .pImageIndices = &image_index,
-		  .pResults = nullptr,
-		};
-
-		if (auto const result = vkQueuePresentKHR(d.queue_, &present_info); result != VK_SUCCESS) {
+		if (auto const result = vkResetCommandBuffer(buffer_[frame], 0); result != VK_SUCCESS) {
 			return std::unexpected(static_cast<error>(result));
 		}
 
 		return {};
 	}
 
-	std::optional<std::uint32_t> find_memory_type(
-	  std::uint32_t const filter,
-	  VkMemoryPropertyFlags const properties,
-	  VkPhysicalDeviceMemoryProperties const memory_properties) noexcept
+	constexpr auto colour_range = VkImageSubresourceRange{
+	  .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+	  .baseMipLevel = 0,
+	  .levelCount = 1,
+	  .baseArrayLayer = 0,
+	  .layerCount = 1,
+	};
+
+	// The previous contents are cleared, so the transition discards them. Like the render pass's external dependency,
+	// this waits on the colour attachment stage, which is where swapchain acquisition is waited on.
+	void command_buffer::begin_rendering(
+	  std::uint32_t const frame,
+	  VkImage const image,
+	  image_view const& view,
+	  VkExtent2D const extent) noexcept
 	{
-		for (auto i = std::uint32_t{0}; i < memory_properties.memoryTypeCount; ++i) {
-			if (static_cast<bool>(filter & (1 << i))
+		auto const to_attachment = VkImageMemoryBarrier{
+		  .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+		  .pNext = nullptr,
+		  .srcAccessMask = 0,
+		  .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+		  .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+		  .newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+		  .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		  .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		  .image = image,
+		  .subresourceRange = colour_range,
+		};
+		vkCmdPipelineBarrier(
+		  buffer_[frame],
+		  VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+		  VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+		  0,
+		  0,
+		  nullptr,
+		  0,
+		  nullptr,
+		  1,
+		  &to_attachment);
+
+		auto const colour_attachment = VkRenderingAttachmentInfo{
+		  .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+		  .pNext = nullptr,
+		  .imageView = view.get(),
+		  .imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+		  .resolveMode = VK_RESOLVE_MODE_NONE,
+		  .resolveImageView = VK_NULL_HANDLE,
+		  .resolveImageLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+		  .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+		  .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+		  .clearValue = VkClearValue{.color = {{0.0f, 0.0f, 0.0f, 1.0f}}},
+		};
+		auto const render_area = VkRect2D{
+		  .offset = {},
+		  .extent = extent,
+		};
+		auto const rendering_info = VkRenderingInfo{
+		  .sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
+		  .pNext = nullptr,
+		  .flags = {},
+		  .renderArea = render_area,
+		  .layerCount = 1,
+		  .viewMask = 0,
+		  .colorAttachmentCount = 1,
+		  .pColorAttachments = &colour_attachment,
+		  .pDepthAttachment = nullptr,
+		  .pStencilAttachment = nullptr,
+		};
+		vkCmdBeginRendering(buffer_[frame], &rendering_info);
+
+		auto const viewport = VkViewport{
+		  .x = 0.0f,
+		  .y = 0.0f,
+		  .width = static_cast<float>(extent.width),
+		  .height = static_cast<float>(extent.height),
+		  .minDepth = 0.0f,
+		  .maxDepth = 1.0f,
+		};
+		vkCmdSetViewport(buffer_[frame], 0, 1, &viewport);
+		vkCmdSetScissor(buffer_[frame], 0, 1, &render_area);
+	}
+
+	void command_buffer::end_rendering(
+	  std::uint32_t const frame,
+	  VkImage const image,
+	  VkImageLayout const final_layout) noexcept
+	{
+		vkCmdEndRendering(buffer_[frame]);
+
+		auto const next = next_use(final_layout);
+		auto const to_final = VkImageMemoryBarrier{
+		  .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+		  .pNext = nullptr,
+		  .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+		  .dstAccessMask = next.access,
+		  .oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+		  .newLayout = final_layout,
+		  .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		  .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		  .image = image,
+		  .subresourceRange = colour_range,
+		};
+		vkCmdPipelineBarrier(
+		  buffer_[frame],
+		  VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+		  next.stages,
+		  0,
+		  0,
+		  nullptr,
+		  0,
+		  nullptr,
+		  1,
+		  &to_final);
+	}
+
+	error_or<parallel_recorder> parallel_recorder::create(
+	  device const& d,
+	  std::uint32_t const frames,
+	  std::uint32_t const threads,
+	  VkAllocationCallbacks const* const alloc) noexcept
+	{
+		CJDB_EXPECTS(frames > 0 and threads > 0);
+		auto pools = std::vector<command_pool>();
+		auto buffers = std::vector<command_buffer>();
+		pools.reserve(threads);
+		buffers.reserve(threads);
+		for (auto i = std::uint32_t{0}; i < threads; ++i) {
+			auto pool = command_pool::create(d, queue_kind::graphics, alloc);
+			if (not pool) {
+				return std::unexpected(pool.error());
+			}
+
+			auto buffer = command_buffer::create(d, *pool, frames, VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+			if (not buffer) {
+				return std::unexpected(buffer.error());
+			}
+
+			pools.push_back(std::move(*pool));
+			buffers.push_back(std::move(*buffer));
+		}
+
+		return parallel_recorder(std::move(pools), std::move(buffers));
+	}
+
+	parallel_recorder::parallel_recorder(std::vector<command_pool> pools, std::vector<command_buffer> buffers) noexcept
+	: pools_(std::move(pools))
+	, buffers_(std::move(buffers))
+	, workers_(std::make_unique<jobs::thread_pool>(static_cast<std::uint32_t>(pools_.size())))
+	{}
+
+	[[nodiscard]] static error_or<void> record_secondary(
+	  VkCommandBuffer const command,
+	  render_pass const& pass,
+	  framebuffer const& target,
+	  graphics_pipeline const& pipeline,
+	  VkExtent2D const extent,
+	  std::uint32_t const first,
+	  std::uint32_t const count,
+	  parallel_recorder::range_fn const record_range,
+	  void* const context) noexcept
+	{
+		auto const inheritance_info = VkCommandBufferInheritanceInfo{
+		  .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+		  .pNext = nullptr,
+		  .renderPass = pass.get(),
+		  .subpass = 0,
+		  .framebuffer = target.get(),
+		  .occlusionQueryEnable = VK_FALSE,
+		  .queryFlags = {},
+		  .pipelineStatistics = {},
+		};
+		auto const begin_info = VkCommandBufferBeginInfo{
+		  .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		  .pNext = nullptr,
+		  .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+		  .pInheritanceInfo = &inheritance_info,
+		};
+
+		if (auto const result = vkBeginCommandBuffer(command, &begin_info); result != VK_SUCCESS) {
+			return std::unexpected(static_cast<error>(result));
+		}
+
+		// Dynamic state isn't inherited from the primary command buffer.
+		vkCmdBindPipeline(command, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.get());
+		auto const viewport = VkViewport{
+		  .x = 0.0f,
+		  .y = 0.0f,
+		  .width = static_cast<float>(extent.width),
+		  .height = static_cast<float>(extent.height),
+		  .minDepth = 0.0f,
+		  .maxDepth = 1.0f,
+		};
+		auto const scissor = VkRect2D{.offset = {}, .extent = extent};
+		vkCmdSetViewport(command, 0, 1, &viewport);
+		vkCmdSetScissor(command, 0, 1, &scissor);
+		if (auto const result = record_range(context, command, first, count); not result) {
+			return result;
+		}
+
+		if (auto const result = vkEndCommandBuffer(command); result != VK_SUCCESS) {
+			return std::unexpected(static_cast<error>(result));
+		}
+
+		return {};
+	}
+
+	error_or<std::span<VkCommandBuffer const>> parallel_recorder::record(
+	  std::uint32_t const frame,
+	  render_pass const& pass,
+	  framebuffer const& target,
+	  graphics_pipeline const& pipeline,
+	  VkExtent2D const extent,
+	  std::uint32_t const draw_count,
+	  range_fn const record_range,
+	  void* const context) noexcept
+	{
+		if (draw_count == 0) {
+			return std::span<VkCommandBuffer const>();
+		}
+
+		auto const draws_per_job = (draw_count + threads() - 1) / threads();
+		auto const job_count = (draw_count + draws_per_job - 1) / draws_per_job;
+		auto results = std::vector<error_or<void>>(job_count);
+		recorded_.resize(job_count);
+
+		workers_->run(job_count, [&](std::uint32_t const i) noexcept {
+			auto const first = i * draws_per_job;
+			auto const count = std::min(draws_per_job, draw_count - first);
+			recorded_[i] = buffers_[i].get(frame);
+			results[i] = record_secondary(recorded_[i], pass, target, pipeline, extent, first, count, record_range, context);
+		});
+
+		if (auto const failed = std::ranges::find_if(results, [](error_or<void> const& x) noexcept { return not x; });
+		    failed != results.end())
+		{
+			return std::unexpected(failed->error());
+		}
+
+		return std::span<VkCommandBuffer const>(recorded_);
+	}
+
+	void bind_descriptor_sets(
+	  VkCommandBuffer const command,
+	  VkPipelineBindPoint const bind_point,
+	  pipeline_layout const& layout,
+	  std::span<VkDescriptorSet const> const sets,
+	  std::uint32_t const first_set) noexcept
+	{
+		vkCmdBindDescriptorSets(
+		  command,
+		  bind_point,
+		  layout.get(),
+		  first_set,
+		  static_cast<std::uint32_t>(sets.size()),
+		  sets.data(),
+		  0,
+		  nullptr);
+	}
+
+	void push_constants(
+	  VkCommandBuffer const command,
+	  pipeline_layout const& layout,
+	  VkShaderStageFlags const stages,
+	  std::uint32_t const offset,
+	  std::span<std::byte const> const data) noexcept
+	{
+		CJDB_EXPECTS(offset % 4 == 0);
+		CJDB_EXPECTS(data.size() % 4 == 0);
+		vkCmdPushConstants(command, layout.get(), stages, offset, static_cast<std::uint32_t>(data.size()), data.data());
+	}
+
+	void dispatch(VkCommandBuffer const command, std::uint32_t const x, std::uint32_t const y, std::uint32_t const z) noexcept
+	{
+		vkCmdDispatch(command, x, y, z);
+	}
+
+	void bind_vertex_buffers(
+	  VkCommandBuffer const command,
+	  std::span<VkBuffer const> const buffers,
+	  std::span<VkDeviceSize const> const offsets,
+	  std::uint32_t const first_binding) noexcept
+	{
+		CJDB_EXPECTS(offsets.empty() or offsets.size() == buffers.size());
+
+		auto const zeroes = std::vector<VkDeviceSize>(offsets.empty() ? buffers.size() : 0);
+		vkCmdBindVertexBuffers(
+		  command,
+		  first_binding,
+		  static_cast<std::uint32_t>(buffers.size()),
+		  buffers.data(),
+		  offsets.empty() ? zeroes.data() : offsets.data());
+	}
+
+	void bind_index_buffer(
+	  VkCommandBuffer const command,
+	  VkBuffer const indices,
+	  VkIndexType const type,
+	  VkDeviceSize const offset) noexcept
+	{
+		vkCmdBindIndexBuffer(command, indices, offset, type);
+	}
+
+	void draw(
+	  VkCommandBuffer const command,
+	  std::uint32_t const vertex_count,
+	  std::uint32_t const instance_count,
+	  std::uint32_t const first_vertex,
+	  std::uint32_t const first_instance) noexcept
+	{
+		vkCmdDraw(command, vertex_count, instance_count, first_vertex, first_instance);
+	}
+
+	void draw_indexed(
+	  VkCommandBuffer const command,
+	  std::uint32_t const index_count,
+	  std::uint32_t const instance_count,
+	  std::uint32_t const first_index,
+	  std::int32_t const vertex_offset,
+	  std::uint32_t const first_instance) noexcept
+	{
+		vkCmdDrawIndexed(command, index_count, instance_count, first_index, vertex_offset, first_instance);
+	}
+
+	void draw_indirect(
+	  VkCommandBuffer const command,
+	  VkBuffer const arguments,
+	  VkDeviceSize const offset,
+	  std::uint32_t const draw_count,
+	  std::uint32_t const stride) noexcept
+	{
+		vkCmdDrawIndirect(command, arguments, offset, draw_count, stride);
+	}
+
+	void draw_indexed_indirect(
+	  VkCommandBuffer const command,
+	  VkBuffer const arguments,
+	  VkDeviceSize const offset,
+	  std::uint32_t const draw_count,
+	  std::uint32_t const stride) noexcept
+	{
+		vkCmdDrawIndexedIndirect(command, arguments, offset, draw_count, stride);
+	}
+
+	void draw_indirect_count(
+	  VkCommandBuffer const command,
+	  VkBuffer const arguments,
+	  VkDeviceSize const offset,
+	  VkBuffer const count,
+	  VkDeviceSize const count_offset,
+	  std::uint32_t const max_draw_count,
+	  std::uint32_t const stride) noexcept
+	{
+		vkCmdDrawIndirectCount(command, arguments, offset, count, count_offset, max_draw_count, stride);
+	}
+
+	void draw_indexed_indirect_count(
+	  VkCommandBuffer const command,
+	  VkBuffer const arguments,
+	  VkDeviceSize const offset,
+	  VkBuffer const count,
+	  VkDeviceSize const count_offset,
+	  std::uint32_t const max_draw_count,
+	  std::uint32_t const stride) noexcept
+	{
+		vkCmdDrawIndexedIndirectCount(command, arguments, offset, count, count_offset, max_draw_count, stride);
+	}
+
+	void dispatch_indirect(VkCommandBuffer const command, VkBuffer const arguments, VkDeviceSize const offset) noexcept
+	{
+		vkCmdDispatchIndirect(command, arguments, offset);
+	}
+
+	error_or<semaphore> semaphore::create(device const& d, VkAllocationCallbacks const* const alloc) noexcept
+	{
+		constexpr auto semaphore_info = VkSemaphoreCreateInfo{
+		  .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+		  .pNext = nullptr,
+		  .flags = {},
+		};
+
+		auto resource = VkSemaphore{};
+		if (auto const result = vkCreateSemaphore(d.get(), &semaphore_info, alloc, &resource); result != VK_SUCCESS) {
+			return std::unexpected(static_cast<error>(result));
+		}
+
+		return semaphore(resource, d.get(), alloc);
+	}
+
+	semaphore::semaphore(VkSemaphore const s, VkDevice const d, VkAllocationCallbacks const* const alloc) noexcept
+	: semaphore_(s, {vkDestroySemaphore, d, alloc})
+	{}
+
+	error_or<timeline_semaphore> timeline_semaphore::create(
+	  device const& d,
+	  std::uint64_t const initial_value,
+	  VkAllocationCallbacks const* const alloc) noexcept
+	{
+		if (not d.physical_device().timeline_semaphore) {
+			return std::unexpected(error::feature_unavailable);
+		}
+
+		auto const type_info = VkSemaphoreTypeCreateInfo{
+		  .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+		  .pNext = nullptr,
+		  .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+		  .initialValue = initial_value,
+		};
+		auto const semaphore_info = VkSemaphoreCreateInfo{
+		  .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+		  .pNext = &type_info,
+		  .flags = {},
+		};
+
+		auto resource = VkSemaphore{};
+		if (auto const result = vkCreateSemaphore(d.get(), &semaphore_info, alloc, &resource); result != VK_SUCCESS) {
+			return std::unexpected(static_cast<error>(result));
+		}
+
+		return timeline_semaphore(resource, d.get(), alloc);
+	}
+
+	timeline_semaphore::timeline_semaphore(
+	  VkSemaphore const s,
+	  VkDevice const d,
+	  VkAllocationCallbacks const* const alloc) noexcept
+	: semaphore_(s, {vkDestroySemaphore, d, alloc})
+	, device_(d)
+	{}
+
+	error_or<std::uint64_t> timeline_semaphore::value() const noexcept
+	{
+		auto result = std::uint64_t{};
+		if (auto const status = vkGetSemaphoreCounterValue(device_, semaphore_.get(), &result); status != VK_SUCCESS) {
+			return std::unexpected(static_cast<error>(status));
+		}
+
+		return result;
+	}
+
+	error_or<void> timeline_semaphore::signal(std::uint64_t const value) noexcept
+	{
+		auto const signal_info = VkSemaphoreSignalInfo{
+		  .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SIGNAL_INFO,
+		  .pNext = nullptr,
+		  .semaphore = semaphore_.get(),
+		  .value = value,
+		};
+
+		if (auto const result = vkSignalSemaphore(device_, &signal_info); result != VK_SUCCESS) {
+			return std::unexpected(static_cast<error>(result));
+		}
+
+		return {};
+	}
+
+	error_or<void> timeline_semaphore::wait(std::uint64_t const value, std::uint64_t const timeout) const noexcept
+	{
+		auto const point = at(value);
+		return wait_for_semaphores(device_, {&point, 1}, {}, timeout);
+	}
+
+	error_or<fence> fence::create(device const& d, VkAllocationCallbacks const* const alloc) noexcept
+	{
+		constexpr auto fence_info = VkFenceCreateInfo{
+		  .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+		  .pNext = nullptr,
+		  .flags = VK_FENCE_CREATE_SIGNALED_BIT,
+		};
+
+		auto resource = VkFence{};
+		if (auto const result = vkCreateFence(d.get(), &fence_info, alloc, &resource); result != VK_SUCCESS) {
+			return std::unexpected(static_cast<error>(result));
+		}
+
+		return fence(resource, d.get(), alloc);
+	}
+
+	fence::fence(VkFence const s, VkDevice const d, VkAllocationCallbacks const* const alloc) noexcept
+	: fence_(s, {vkDestroyFence, d, alloc})
+	, device_(d)
+	{}
+
+	error_or<frame_scheduler> frame_scheduler::create(
+	  device& d,
+	  command_pool const& pool,
+	  std::uint32_t const frames_in_flight,
+	  VkAllocationCallbacks const* const alloc) noexcept
+	{
+		CJDB_EXPECTS(frames_in_flight > 0);
+		auto commands = command_buffer::create(d, pool, frames_in_flight);
+		if (not commands) {
+			return std::unexpected(commands.error());
+		}
+
+		auto timeline = timeline_semaphore::create(d, 0, alloc);
+		if (not timeline) {
+			return std::unexpected(timeline.error());
+		}
+
+		auto slots = std::vector<frame_slot>();
+		slots.reserve(frames_in_flight);
+		for (auto i = std::uint32_t{0}; i < frames_in_flight; ++i) {
+			auto image_available = semaphore::create(d, alloc);
+			if (not image_available) {
+				return std::unexpected(image_available.error());
+			}
+
+			auto render_finished = semaphore::create(d, alloc);
+			if (not render_finished) {
+				return std::unexpected(render_finished.error());
+			}
+
+			slots.push_back(frame_slot{
+			  .image_available = std::move(*image_available),
+			  .render_finished = std::move(*render_finished),
+			});
+		}
+
+		return frame_scheduler(d, std::move(*commands), std::move(*timeline), std::move(slots));
+	}
+
+	frame_scheduler::frame_scheduler(
+	  device& d,
+	  command_buffer commands,
+	  timeline_semaphore timeline,
+	  std::vector<frame_slot> slots) noexcept
+	: device_(&d)
+	, commands_(std::move(commands))
+	, timeline_(std::move(timeline))
+	, slots_(std::move(slots))
+	{}
+
+	error_or<void> frame_scheduler::draw(swapchain& chain, record_fn const record, void* const context) noexcept
+	{
+		auto const started = std::chrono::steady_clock::now();
+		auto& slot = slots_[frame_];
+		if (auto const result = timeline_.wait(slot.in_flight); not result) {
+			return result;
+		}
+
+		// Nothing is submitted for the slot if acquisition fails, so it can be reused on the next call.
+		auto const image_index = chain.acquire_next_image(slot.image_available);
+		if (not image_index) {
+			return std::unexpected(image_index.error());
+		}
+
+		auto const acquired = std::chrono::steady_clock::now();
+		image_values_.resize(chain.size(), 0);
+		if (auto const result = timeline_.wait(image_values_[*image_index]); not result) {
+			return abandon(slot, result.error());
+		}
+
+		if (auto const result = commands_.reset(frame_); not result) {
+			return abandon(slot, result.error());
+		}
+
+		{
+			auto const timer = profiling::scoped_timer("record");
+			if (auto const result = record(context, commands_, frame_, *image_index); not result) {
+				return abandon(slot, result.error());
+			}
+		}
+
+		auto const value = submitted_ + 1;
+		VkCommandBuffer const command[] = {commands_.get(frame_)};
+		semaphore_wait const wait[] = {{
+		  .semaphore = slot.image_available.get(),
+		  .value = 0,
+		  .stages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+		}};
+		semaphore_value const signals[] = {{.semaphore = slot.render_finished.get()}, timeline_.at(value)};
+		if (auto const result = device_->submit(command, wait, signals); not result) {
+			return result;
+		}
+
+		submitted_ = value;
+		slot.in_flight = value;
+		image_values_[*image_index] = value;
+		frame_ = (frame_ + 1) % frames_in_flight();
+
+		VkSwapchainKHR swapchains[] = {chain.get()};
+		VkSemaphore const render_finished[] = {slot.render_finished.get()};
+		auto const result = present(*device_, *image_index, swapchains, render_finished);
+		if (not result and result.error() != error::suboptimal) {
+			return result;
+		}
+
+		auto const presented = std::chrono::steady_clock::now();
+		timings_[presented_ % pacing_history] = frame_timings{
+		  .acquire_wait = acquired - started,
+		  .acquire_to_present = presented - acquired,
+		  .frame_interval = presented_ == 0 ? std::chrono::nanoseconds() : presented - last_present_,
+		};
+		++presented_;
+		last_present_ = presented;
+		profiling::record("acquire_wait", started, acquired);
+		profiling::record("acquire_to_present", acquired, presented);
+		profiling::record("frame", started, presented);
+
+		if (not result or chain.suboptimal()) {
+			return std::unexpected(error::suboptimal);
+		}
+
+		return {};
+	}
+
+	// The acquire will still signal image_available, which mustn't be pending when the slot next acquires with it, so an
+	// empty batch waits on it instead of the frame. The image is never presented, so it stays acquired until the
+	// swapchain is recreated.
+	error_or<void> frame_scheduler::abandon(frame_slot& slot, error const reason) noexcept
+	{
+		auto const value = submitted_ + 1;
+		semaphore_wait const wait[] = {{.semaphore = slot.image_available.get()}};
+		semaphore_value const signals[] = {timeline_.at(value)};
+		if (auto const result = device_->submit({}, wait, signals); not result) {
+			return result;
+		}
+
+		submitted_ = value;
+		slot.in_flight = value;
+		return std::unexpected(reason);
+	}
+
+	frame_timings const& frame_scheduler::last_timings() const noexcept
+	{
+		return timings_[(presented_ + pacing_history - 1) % pacing_history];
+	}
+
+	frame_pacing frame_scheduler::pacing() const noexcept
+	{
+		auto const samples = std::min(presented_, pacing_history);
+		auto result = frame_pacing{.mean = {}, .worst = {}, .samples = static_cast<std::uint32_t>(samples)};
+		if (samples == 0) {
+			return result;
+		}
+
+		auto total = frame_timings{};
+		for (auto const& timing : std::span(timings_).first(samples)) {
+			total.acquire_wait += timing.acquire_wait;
+			total.acquire_to_present += timing.acquire_to_present;
+			total.frame_interval += timing.frame_interval;
+			result.worst.acquire_wait = std::max(result.worst.acquire_wait, timing.acquire_wait);
+			result.worst.acquire_to_present = std::max(result.worst.acquire_to_present, timing.acquire_to_present);
+			result.worst.frame_interval = std::max(result.worst.frame_interval, timing.frame_interval);
+		}
+
+		// The first frame's interval is zero until it's overwritten by a later frame.
+		auto const count = static_cast<std::int64_t>(samples);
+		auto const intervals = static_cast<std::int64_t>(std::min(presented_ - 1, pacing_history));
+		result.mean = frame_timings{
+		  .acquire_wait = total.acquire_wait / count,
+		  .acquire_to_present = total.acquire_to_present / count,
+		  .frame_interval = intervals == 0 ? std::chrono::nanoseconds() : total.frame_interval / intervals,
+		};
+		return result;
+	}
+
+	error_or<void> frame_scheduler::recreate(
+	  swapchain& chain,
+	  window::window const& w,
+	  render_pass const& pass,
+	  std::vector<framebuffer>& framebuffers,
+	  VkAllocationCallbacks const* const alloc) noexcept
+	{
+		if (auto const result = recreate(chain, w, alloc); not result) {
+			return result;
+		}
+
+		framebuffers.clear();
+		framebuffers.reserve(chain.size());
+		for (auto const& view : chain.image_views()) {
+			auto target = framebuffer::create(*device_, view, pass, chain, alloc);
+			if (not target) {
+				return std::unexpected(target.error());
+			}
+
+			framebuffers.push_back(std::move(*target));
+		}
+
+		return {};
+	}
+
+	error_or<void> frame_scheduler::recreate(
+	  swapchain& chain,
+	  window::window const& w,
+	  VkAllocationCallbacks const* const alloc) noexcept
+	{
+		if (auto const result = wait(); not result) {
+			return result;
+		}
+
+		auto replacement = swapchain::create(*device_, w, chain, alloc);
+		if (not replacement) {
+			return std::unexpected(replacement.error());
+		}
+
+		chain = std::move(*replacement);
+		image_values_.assign(chain.size(), 0);
+		return {};
+	}
+
+	error_or<void> frame_scheduler::wait() noexcept
+	{
+		return timeline_.wait(submitted_);
+	}
+
+	error_or<void> present(
+	  device const& d,
+	  std::uint32_t const image_index,
+	  std::span<VkSwapchainKHR const> const swapchains,
+	  std::span<VkSemaphore const> const signals) noexcept
+	{
+		auto const timer = profiling::scoped_timer("present");
+		auto const present_info = VkPresentInfoKHR{
+		  .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
+		  .pNext = nullptr,
+		  .waitSemaphoreCount = static_cast<std::uint32_t>(signals.size()),
+		  .pWaitSemaphores = signals.data(),
+		  .swapchainCount = static_cast<std::uint32_t>(swapchains.size()),
+		  .pSwapchains = swapchains.data(),
+		  .pImageIndices = &image_index,
+		  .pResults = nullptr,
+		};
+
+		if (auto const result = vkQueuePresentKHR(d.queue(queue_kind::graphics), &present_info); result != VK_SUCCESS) {
+			// VK_SUBOPTIMAL_KHR still queued the present, which is surfaced as error::suboptimal.
+			return std::unexpected(static_cast<error>(result));
+		}
+
+		return {};
+	}
+
+	std::optional<std::uint32_t> find_memory_type(
+	  std::uint32_t const filter,
+	  VkMemoryPropertyFlags const properties,
+	  VkPhysicalDeviceMemoryProperties const memory_properties) noexcept
+	{
+		for (auto i = std::uint32_t{0}; i < memory_properties.memoryTypeCount; ++i) {
+			if (static_cast<bool>(filter & (1 << i))
 			    and (memory_properties.memoryTypes[i].propertyFlags & properties) == properties)
 			{
 				return i;
 			}
 		}
 
-		return std::nullopt;
+		return std::nullopt;
+	}
+
+	tlsf_allocator::tlsf_allocator(VkDeviceSize const capacity) noexcept
+	: capacity_(capacity)
+	{
+		CJDB_EXPECTS(capacity > 0);
+		for (auto& level : free_lists_) {
+			level.fill(null_node);
+		}
+
+		insert_free(make_node(node{
+		  .offset = 0,
+		  .size = capacity,
+		  .prev_physical = null_node,
+		  .next_physical = null_node,
+		  .prev_free = null_node,
+		  .next_free = null_node,
+		  .is_free = true,
+		}));
+	}
+
+	std::optional<tlsf_allocator::region> tlsf_allocator::allocate(
+	  VkDeviceSize const size,
+	  VkDeviceSize const alignment) noexcept
+	{
+		CJDB_EXPECTS(size > 0);
+		CJDB_EXPECTS(std::has_single_bit(alignment));
+
+		// Only pay for worst-case alignment padding when the best-fitting block isn't already aligned.
+		auto n = find_free(size);
+		if (n != null_node and (nodes_[n].offset & (alignment - 1)) != 0) {
+			n = find_free(size + alignment - 1);
+		}
+
+		if (n == null_node) {
+			return std::nullopt;
+		}
+
+		remove_free(n);
+		auto const aligned_offset = (nodes_[n].offset + alignment - 1) & ~(alignment - 1);
+		if (auto const padding = aligned_offset - nodes_[n].offset; padding != 0) {
+			auto const rest = split(n, padding);
+			insert_free(n);
+			n = rest;
+		}
+
+		if (nodes_[n].size > size) {
+			insert_free(split(n, size));
+		}
+
+		nodes_[n].is_free = false;
+		used_ += nodes_[n].size;
+		return region{.offset = nodes_[n].offset, .size = nodes_[n].size, .id = n};
+	}
+
+	void tlsf_allocator::free(std::uint32_t n) noexcept
+	{
+		CJDB_EXPECTS(n < nodes_.size() and not nodes_[n].is_free);
+		used_ -= nodes_[n].size;
+		nodes_[n].is_free = true;
+
+		if (auto const prev = nodes_[n].prev_physical; prev != null_node and nodes_[prev].is_free) {
+			remove_free(prev);
+			absorb(prev, n);
+			n = prev;
+		}
+
+		if (auto const next = nodes_[n].next_physical; next != null_node and nodes_[next].is_free) {
+			remove_free(next);
+			absorb(n, next);
+		}
+
+		insert_free(n);
+	}
+
+	VkDeviceSize tlsf_allocator::largest_free_region() const noexcept
+	{
+		if (first_level_ == 0) {
+			return 0;
+		}
+
+		auto const fl = static_cast<std::uint32_t>(std::bit_width(first_level_) - 1);
+		auto const sl = static_cast<std::uint32_t>(std::bit_width(second_level_[fl]) - 1);
+		auto result = VkDeviceSize{0};
+		for (auto n = free_lists_[fl][sl]; n != null_node; n = nodes_[n].next_free) {
+			result = std::max(result, nodes_[n].size);
+		}
+
+		return result;
+	}
+
+	std::pair<std::uint32_t, std::uint32_t> tlsf_allocator::mapping(VkDeviceSize const size) noexcept
+	{
+		auto const fl = static_cast<std::uint32_t>(std::bit_width(size) - 1);
+		auto const sl = fl >= second_level_log2 ? size >> (fl - second_level_log2) : size << (second_level_log2 - fl);
+		return {fl, static_cast<std::uint32_t>(sl) - second_level_count};
+	}
+
+	std::uint32_t tlsf_allocator::find_free(VkDeviceSize size) const noexcept
+	{
+		// Round up to the next size class so that every block in the chosen list is large enough.
+		if (auto const fl = static_cast<std::uint32_t>(std::bit_width(size) - 1); fl >= second_level_log2) {
+			size += (VkDeviceSize{1} << (fl - second_level_log2)) - 1;
+		}
+
+		auto [fl, sl] = mapping(size);
+		auto second_level = second_level_[fl] & (~std::uint32_t{0} << sl);
+		if (second_level == 0) {
+			auto const first_level = fl + 1 < first_level_count ? first_level_ & (~std::uint64_t{0} << (fl + 1)) : 0;
+			if (first_level == 0) {
+				return null_node;
+			}
+
+			fl = static_cast<std::uint32_t>(std::countr_zero(first_level));
+			second_level = second_level_[fl];
+		}
+
+		sl = static_cast<std::uint32_t>(std::countr_zero(second_level));
+		return free_lists_[fl][sl];
+	}
+
+	std::uint32_t tlsf_allocator::make_node(node const n) noexcept
+	{
+		if (recycled_.empty()) {
+			nodes_.push_back(n);
+			return static_cast<std::uint32_t>(nodes_.size() - 1);
+		}
+
+		auto const result = recycled_.back();
+		recycled_.pop_back();
+		nodes_[result] = n;
+		return result;
+	}
+
+	std::uint32_t tlsf_allocator::split(std::uint32_t const n, VkDeviceSize const size) noexcept
+	{
+		CJDB_EXPECTS(size < nodes_[n].size);
+		auto const rest = make_node(node{
+		  .offset = nodes_[n].offset + size,
+		  .size = nodes_[n].size - size,
+		  .prev_physical = n,
+		  .next_physical = nodes_[n].next_physical,
+		  .prev_free = null_node,
+		  .next_free = null_node,
+		  .is_free = true,
+		});
+
+		if (auto const next = nodes_[rest].next_physical; next != null_node) {
+			nodes_[next].prev_physical = rest;
+		}
+
+		nodes_[n].next_physical = rest;
+		nodes_[n].size = size;
+		return rest;
+	}
+
+	void tlsf_allocator::absorb(std::uint32_t const n, std::uint32_t const next) noexcept
+	{
+		nodes_[n].size += nodes_[next].size;
+		nodes_[n].next_physical = nodes_[next].next_physical;
+		if (auto const after = nodes_[n].next_physical; after != null_node) {
+			nodes_[after].prev_physical = n;
+		}
+
+		recycled_.push_back(next);
+	}
+
+	void tlsf_allocator::insert_free(std::uint32_t const n) noexcept
+	{
+		auto const [fl, sl] = mapping(nodes_[n].size);
+		auto& head = free_lists_[fl][sl];
+		nodes_[n].prev_free = null_node;
+		nodes_[n].next_free = head;
+		if (head != null_node) {
+			nodes_[head].prev_free = n;
+		}
+
+		head = n;
+		first_level_ |= std::uint64_t{1} << fl;
+		second_level_[fl] |= std::uint32_t{1} << sl;
+	}
+
+	void tlsf_allocator::remove_free(std::uint32_t const n) noexcept
+	{
+		auto const [fl, sl] = mapping(nodes_[n].size);
+		auto const prev = nodes_[n].prev_free;
+		auto const next = nodes_[n].next_free;
+		if (prev != null_node) {
+			nodes_[prev].next_free = next;
+		}
+
+		if (next != null_node) {
+			nodes_[next].prev_free = prev;
+		}
+
+		if (free_lists_[fl][sl] == n) {
+			free_lists_[fl][sl] = next;
+			if (next == null_node) {
+				second_level_[fl] &= ~(std::uint32_t{1} << sl);
+				if (second_level_[fl] == 0) {
+					first_level_ &= ~(std::uint64_t{1} << fl);
+				}
+			}
+		}
+	}
+
+	memory_block::memory_block(
+	  VkDeviceMemory const memory,
+	  VkDevice const device,
+	  VkAllocationCallbacks const* const allocator,
+	  std::byte* const mapped,
+	  VkDeviceSize const size) noexcept
+	: memory_(memory, {vkFreeMemory, device, allocator})
+	, mapped_(mapped)
+	, regions_(size)
+	{}
+
+	allocation::allocation(memory_block& block, tlsf_allocator::region const region) noexcept
+	: block_(&block, release{region.id})
+	, offset_(region.offset)
+	, size_(region.size)
+	{}
+
+	void allocation::release::operator()(memory_block* const block) const noexcept
+	{
+		block->regions_.free(region);
+	}
+
+	error_or<memory_allocator> memory_allocator::create(
+	  device const& d,
+	  VkDeviceSize const block_size,
+	  VkAllocationCallbacks const* const allocator) noexcept
+	{
+		CJDB_EXPECTS(block_size > 0);
+		return memory_allocator(d, block_size, allocator);
+	}
+
+	memory_allocator::memory_allocator(
+	  device const& d,
+	  VkDeviceSize const block_size,
+	  VkAllocationCallbacks const* const allocator) noexcept
+	: pools_(d.physical_device().memory_properties.memoryTypeCount * 2)
+	, device_(d.get())
+	, memory_properties_(d.physical_device().memory_properties)
+	, block_size_(block_size)
+	, max_allocations_(d.physical_device().properties.limits.maxMemoryAllocationCount)
+	, allocator_(allocator)
+	{}
+
+	error_or<allocation> memory_allocator::allocate(
+	  VkMemoryRequirements const& requirements,
+	  VkMemoryPropertyFlags const properties,
+	  resource_tiling const tiling) noexcept
+	{
+		// Mapped memory is written without vkFlushMappedMemoryRanges, which is only correct when it's coherent. Every
+		// implementation has a host-visible, host-coherent memory type.
+		auto const required = static_cast<bool>(properties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+		                      ? properties | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+		                      : properties;
+		auto const memory_type = find_memory_type(requirements.memoryTypeBits, required, memory_properties_);
+		if (memory_type == std::nullopt) {
+			return std::unexpected(error::no_device_memory);
+		}
+
+		auto& pool = pools_[*memory_type * 2 + static_cast<std::uint32_t>(tiling)];
+		auto const block_size = preferred_block_size(*memory_type);
+
+		// Large resources get a block of their own rather than fragmenting a shared one.
+		if (requirements.size > block_size / 2) {
+			auto block = allocate_block(*memory_type, requirements.size);
+			if (not block) {
+				return std::unexpected(block.error());
+			}
+
+			auto const region = (*block)->regions_.allocate(requirements.size, requirements.alignment);
+			CJDB_ASSERT(region.has_value());
+			pool.push_back(std::move(*block));
+			return allocation(*pool.back(), *region);
+		}
+
+		for (auto const& block : pool) {
+			if (auto const region = block->regions_.allocate(requirements.size, requirements.alignment)) {
+				return allocation(*block, *region);
+			}
+		}
+
+		// Fall back to smaller blocks when the heap can't fit a full-sized one.
+		for (auto size = block_size; size >= requirements.size + requirements.alignment; size /= 2) {
+			auto block = allocate_block(*memory_type, size);
+			if (not block) {
+				if (block.error() == error::no_device_memory) {
+					continue;
+				}
+
+				return std::unexpected(block.error());
+			}
+
+			auto const region = (*block)->regions_.allocate(requirements.size, requirements.alignment);
+			CJDB_ASSERT(region.has_value());
+			pool.push_back(std::move(*block));
+			return allocation(*pool.back(), *region);
+		}
+
+		return std::unexpected(error::no_device_memory);
+	}
+
+	memory_allocator::statistics memory_allocator::stats() const noexcept
+	{
+		auto result = statistics{
+		  .device_allocations = device_allocations_,
+		  .reserved = 0,
+		  .used = 0,
+		  .fragmentation = 0.0,
+		};
+
+		auto largest_free_region = VkDeviceSize{0};
+		for (auto const& pool : pools_) {
+			for (auto const& block : pool) {
+				result.reserved += block->regions_.capacity();
+				result.used += block->regions_.used();
+				largest_free_region = std::max(largest_free_region, block->regions_.largest_free_region());
+			}
+		}
+
+		if (auto const free_bytes = result.reserved - result.used; free_bytes != 0) {
+			result.fragmentation = 1.0 - static_cast<double>(largest_free_region) / static_cast<double>(free_bytes);
+		}
+
+		return result;
+	}
+
+	void memory_allocator::trim() noexcept
+	{
+		for (auto& pool : pools_) {
+			device_allocations_ -= static_cast<std::uint32_t>(
+			  std::erase_if(pool, [](std::unique_ptr<memory_block> const& block) noexcept { return block->regions_.empty(); }));
+		}
+	}
+
+	VkDeviceSize memory_allocator::preferred_block_size(std::uint32_t const memory_type) const noexcept
+	{
+		// Small heaps (e.g. the 256 MiB BAR heap) would be exhausted by a handful of default-sized blocks.
+		auto const heap_size = memory_properties_.memoryHeaps[memory_properties_.memoryTypes[memory_type].heapIndex].size;
+		return heap_size <= VkDeviceSize{1024} * 1024 * 1024 ? std::min(block_size_, heap_size / 8) : block_size_;
+	}
+
+	error_or<std::unique_ptr<memory_block>> memory_allocator::allocate_block(
+	  std::uint32_t const memory_type,
+	  VkDeviceSize const size) noexcept
+	{
+		if (device_allocations_ >= max_allocations_) {
+			return std::unexpected(error::too_many_objects);
+		}
+
+		auto const alloc_info = VkMemoryAllocateInfo{
+		  .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+		  .pNext = nullptr,
+		  .allocationSize = size,
+		  .memoryTypeIndex = memory_type,
+		};
+
+		auto resource = VkDeviceMemory{};
+		if (auto const result = vkAllocateMemory(device_, &alloc_info, allocator_, &resource); result != VK_SUCCESS) {
+			return std::unexpected(static_cast<error>(result));
+		}
+
+		auto mapped = static_cast<void*>(nullptr);
+		constexpr auto mappable =
+		  VkMemoryPropertyFlags{VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT};
+		auto const flags = memory_properties_.memoryTypes[memory_type].propertyFlags;
+		if ((flags & mappable) == mappable) {
+			if (auto const result = vkMapMemory(device_, resource, 0, VK_WHOLE_SIZE, 0, &mapped); result != VK_SUCCESS) {
+				vkFreeMemory(device_, resource, allocator_);
+				return std::unexpected(static_cast<error>(result));
+			}
+		}
+
+		++device_allocations_;
+		return std::unique_ptr<memory_block>(
+		  new memory_block(resource, device_, allocator_, static_cast<std::byte*>(mapped), size));
+	}
+
+	[[nodiscard]] static std::optional<VkDeviceSize> texel_size(VkFormat const format) noexcept
+	{
+		switch (format) {
+		case VK_FORMAT_R8_UNORM:
+		case VK_FORMAT_R8_SRGB:
+			return 1;
+		case VK_FORMAT_R8G8_UNORM:
+		case VK_FORMAT_R16_SFLOAT:
+			return 2;
+		case VK_FORMAT_R8G8B8A8_UNORM:
+		case VK_FORMAT_R8G8B8A8_SRGB:
+		case VK_FORMAT_B8G8R8A8_UNORM:
+		case VK_FORMAT_B8G8R8A8_SRGB:
+		case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+		case VK_FORMAT_R32_SFLOAT:
+			return 4;
+		case VK_FORMAT_R16G16B16A16_SFLOAT:
+			return 8;
+		case VK_FORMAT_R32G32B32A32_SFLOAT:
+			return 16;
+		default:
+			return std::nullopt;
+		}
+	}
+
+	error_or<offscreen_target> offscreen_target::create(
+	  device const& d,
+	  memory_allocator& memory,
+	  VkFormat const format,
+	  VkExtent2D const extent,
+	  VkAllocationCallbacks const* const alloc) noexcept
+	{
+		auto const texel = texel_size(format);
+		if (not texel) {
+			return std::unexpected(error::unsupported_format);
+		}
+
+		auto const image_info = VkImageCreateInfo{
+		  .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+		  .pNext = nullptr,
+		  .flags = {},
+		  .imageType = VK_IMAGE_TYPE_2D,
+		  .format = format,
+		  .extent = VkExtent3D{.width = extent.width, .height = extent.height, .depth = 1},
+		  .mipLevels = 1,
+		  .arrayLayers = 1,
+		  .samples = VK_SAMPLE_COUNT_1_BIT,
+		  .tiling = VK_IMAGE_TILING_OPTIMAL,
+		  .usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+		  .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+		  .queueFamilyIndexCount = {},
+		  .pQueueFamilyIndices = {},
+		  .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+		};
+
+		auto raw_image = VkImage{};
+		if (auto const result = vkCreateImage(d.get(), &image_info, alloc, &raw_image); result != VK_SUCCESS) {
+			return std::unexpected(static_cast<error>(result));
+		}
+		auto image = std::unique_ptr<VkImage_T, deleter<PFN_vkDestroyImage, VkDevice>>(
+		  raw_image,
+		  {vkDestroyImage, d.get(), alloc});
+
+		auto image_requirements = VkMemoryRequirements{};
+		vkGetImageMemoryRequirements(d.get(), image.get(), &image_requirements);
+		auto image_memory =
+		  memory.allocate(image_requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, resource_tiling::optimal);
+		if (not image_memory) {
+			return std::unexpected(image_memory.error());
+		}
+
+		if (auto const result = vkBindImageMemory(d.get(), image.get(), image_memory->memory(), image_memory->offset());
+		    result != VK_SUCCESS)
+		{
+			return std::unexpected(static_cast<error>(result));
+		}
+
+		auto view = image_view::create(d, image.get(), format, alloc);
+		if (not view) {
+			return std::unexpected(view.error());
+		}
+
+		auto const size = VkDeviceSize{extent.width} * extent.height * *texel;
+		auto const buffer_info = VkBufferCreateInfo{
+		  .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		  .pNext = nullptr,
+		  .flags = {},
+		  .size = size,
+		  .usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		  .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+		  .queueFamilyIndexCount = {},
+		  .pQueueFamilyIndices = {},
+		};
+
+		auto raw_buffer = VkBuffer{};
+		if (auto const result = vkCreateBuffer(d.get(), &buffer_info, alloc, &raw_buffer); result != VK_SUCCESS) {
+			return std::unexpected(static_cast<error>(result));
+		}
+		auto readback = std::unique_ptr<VkBuffer_T, deleter<PFN_vkDestroyBuffer, VkDevice>>(
+		  raw_buffer,
+		  {vkDestroyBuffer, d.get(), alloc});
+
+		auto buffer_requirements = VkMemoryRequirements{};
+		vkGetBufferMemoryRequirements(d.get(), readback.get(), &buffer_requirements);
+		auto readback_memory = memory.allocate(
+		  buffer_requirements,
+		  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		  resource_tiling::linear);
+		if (not readback_memory) {
+			return std::unexpected(readback_memory.error());
+		}
+
+		if (auto const result =
+		      vkBindBufferMemory(d.get(), readback.get(), readback_memory->memory(), readback_memory->offset());
+		    result != VK_SUCCESS)
+		{
+			return std::unexpected(static_cast<error>(result));
+		}
+
+		return offscreen_target(
+		  std::move(*image_memory),
+		  std::move(image),
+		  std::move(*view),
+		  std::move(*readback_memory),
+		  std::move(readback),
+		  format,
+		  extent,
+		  size);
+	}
+
+	offscreen_target::offscreen_target(
+	  allocation image_memory,
+	  std::unique_ptr<VkImage_T, deleter<PFN_vkDestroyImage, VkDevice>> image,
+	  image_view view,
+	  allocation readback_memory,
+	  std::unique_ptr<VkBuffer_T, deleter<PFN_vkDestroyBuffer, VkDevice>> readback,
+	  VkFormat const format,
+	  VkExtent2D const extent,
+	  VkDeviceSize const size) noexcept
+	: image_memory_(std::move(image_memory))
+	, image_(std::move(image))
+	, view_(std::move(view))
+	, readback_memory_(std::move(readback_memory))
+	, readback_(std::move(readback))
+	, format_(format)
+	, extent_(extent)
+	, size_(size)
+	{}
+
+	void offscreen_target::record_readback(VkCommandBuffer const command) const noexcept
+	{
+		auto const colour = VkImageSubresourceRange{
+		  .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+		  .baseMipLevel = 0,
+		  .levelCount = 1,
+		  .baseArrayLayer = 0,
+		  .layerCount = 1,
+		};
+		auto const rendered = VkImageMemoryBarrier{
+		  .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+		  .pNext = nullptr,
+		  .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+		  .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+		  .oldLayout = final_layout,
+		  .newLayout = final_layout,
+		  .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		  .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		  .image = image_.get(),
+		  .subresourceRange = colour,
+		};
+		vkCmdPipelineBarrier(
+		  command,
+		  VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+		  VK_PIPELINE_STAGE_TRANSFER_BIT,
+		  {},
+		  0,
+		  nullptr,
+		  0,
+		  nullptr,
+		  1,
+		  &rendered);
+
+		auto const region = VkBufferImageCopy{
+		  .bufferOffset = 0,
+		  .bufferRowLength = 0,
+		  .bufferImageHeight = 0,
+		  .imageSubresource =
+		    VkImageSubresourceLayers{
+		      .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+		      .mipLevel = 0,
+		      .baseArrayLayer = 0,
+		      .layerCount = 1,
+		    },
+		  .imageOffset = {},
+		  .imageExtent = VkExtent3D{.width = extent_.width, .height = extent_.height, .depth = 1},
+		};
+		vkCmdCopyImageToBuffer(command, image_.get(), final_layout, readback_.get(), 1, &region);
+
+		auto const copied = VkBufferMemoryBarrier{
+		  .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+		  .pNext = nullptr,
+		  .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		  .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+		  .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		  .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		  .buffer = readback_.get(),
+		  .offset = 0,
+		  .size = size_,
+		};
+		vkCmdPipelineBarrier(
+		  command,
+		  VK_PIPELINE_STAGE_TRANSFER_BIT,
+		  VK_PIPELINE_STAGE_HOST_BIT,
+		  {},
+		  0,
+		  nullptr,
+		  1,
+		  &copied,
+		  0,
+		  nullptr);
+	}
+
+	std::span<std::byte const> offscreen_target::pixels() const noexcept
+	{
+		return {readback_memory_.mapped(), static_cast<std::size_t>(size_)};
+	}
+
+	error_or<staging_ring> staging_ring::create(
+	  device const& d,
+	  memory_allocator& memory,
+	  VkDeviceSize const capacity,
+	  VkAllocationCallbacks const* const alloc) noexcept
+	{
+		auto const buffer_info = VkBufferCreateInfo{
+		  .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		  .pNext = nullptr,
+		  .flags = {},
+		  .size = capacity,
+		  .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		  .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+		  .queueFamilyIndexCount = {},
+		  .pQueueFamilyIndices = {},
+		};
+
+		auto resource = VkBuffer{};
+		if (auto const result = vkCreateBuffer(d.get(), &buffer_info, alloc, &resource); result != VK_SUCCESS) {
+			return std::unexpected(static_cast<error>(result));
+		}
+
+		auto memory_requirements = VkMemoryRequirements{};
+		vkGetBufferMemoryRequirements(d.get(), resource, &memory_requirements);
+		auto slice = memory.allocate(
+		  memory_requirements,
+		  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		  resource_tiling::linear);
+		if (not slice) {
+			vkDestroyBuffer(d.get(), resource, alloc);
+			return std::unexpected(slice.error());
+		}
+
+		if (auto const result = vkBindBufferMemory(d.get(), resource, slice->memory(), slice->offset()); result != VK_SUCCESS) {
+			vkDestroyBuffer(d.get(), resource, alloc);
+			return std::unexpected(static_cast<error>(result));
+		}
+
+		auto const alignment = std::max(d.physical_device().properties.limits.optimalBufferCopyOffsetAlignment, VkDeviceSize{16});
+		return staging_ring(resource, d.get(), alloc, std::move(*slice), capacity, alignment);
+	}
+
+	staging_ring::staging_ring(
+	  VkBuffer const b,
+	  VkDevice const d,
+	  VkAllocationCallbacks const* const alloc,
+	  allocation memory,
+	  VkDeviceSize const capacity,
+	  VkDeviceSize const alignment) noexcept
+	: buffer_(b, {vkDestroyBuffer, d, alloc})
+	, memory_(std::move(memory))
+	, capacity_(capacity)
+	, alignment_(alignment)
+	{}
+
+	std::optional<staging_ring::region> staging_ring::reserve(VkDeviceSize const size) noexcept
+	{
+		CJDB_EXPECTS(size > 0 and size <= capacity_);
+		if (head_ == tail_) {
+			head_ = 0;
+			tail_ = 0;
+		}
+
+		// head_ and tail_ are monotonic positions; an allocation that would straddle the end of the ring
+		// skips ahead to the next lap instead.
+		auto const physical = head_ % capacity_;
+		auto const aligned = (physical + alignment_ - 1) & ~(alignment_ - 1);
+		auto const start = aligned + size <= capacity_ ? head_ + (aligned - physical) : head_ + (capacity_ - physical);
+		if (start + size - tail_ > capacity_) {
+			return std::nullopt;
+		}
+
+		head_ = start + size;
+		auto const offset = start % capacity_;
+		return region{.offset = offset, .data = memory_.mapped() + offset};
+	}
+
+	void staging_ring::retire(std::uint64_t const position) noexcept
+	{
+		CJDB_EXPECTS(position <= head_);
+		tail_ = std::max(tail_, position);
+	}
+
+	error_or<upload_batcher> upload_batcher::create(
+	  device& d,
+	  memory_allocator& memory,
+	  queue_kind const consumer,
+	  VkDeviceSize const staging_capacity,
+	  std::uint32_t const max_batches,
+	  VkAllocationCallbacks const* const alloc) noexcept
+	{
+		CJDB_EXPECTS(max_batches > 0);
+		auto timeline = timeline_semaphore::create(d, 0, alloc);
+		if (not timeline) {
+			return std::unexpected(timeline.error());
+		}
+
+		auto ring = staging_ring::create(d, memory, staging_capacity, alloc);
+		if (not ring) {
+			return std::unexpected(ring.error());
+		}
+
+		auto transfer_pool = command_pool::create(d, queue_kind::transfer, alloc);
+		if (not transfer_pool) {
+			return std::unexpected(transfer_pool.error());
+		}
+
+		auto acquire_pool = command_pool::create(d, consumer, alloc);
+		if (not acquire_pool) {
+			return std::unexpected(acquire_pool.error());
+		}
+
+		auto transfers = command_buffer::create(d, *transfer_pool, max_batches);
+		if (not transfers) {
+			return std::unexpected(transfers.error());
+		}
+
+		auto acquires = command_buffer::create(d, *acquire_pool, max_batches);
+		if (not acquires) {
+			return std::unexpected(acquires.error());
+		}
+
+		auto batches = std::vector<batch>();
+		batches.reserve(max_batches);
+		for (auto i = std::uint32_t{0}; i < max_batches; ++i) {
+			auto transferred = semaphore::create(d, alloc);
+			if (not transferred) {
+				return std::unexpected(transferred.error());
+			}
+
+			batches.push_back(batch{.transferred = std::move(*transferred), .id = 0, .ring_end = 0, .poisoned = false});
+		}
+
+		return upload_batcher(
+		  d,
+		  consumer,
+		  std::move(*timeline),
+		  std::move(*ring),
+		  std::move(*transfer_pool),
+		  std::move(*acquire_pool),
+		  std::move(*transfers),
+		  std::move(*acquires),
+		  std::move(batches));
+	}
+
+	upload_batcher::upload_batcher(
+	  device& d,
+	  queue_kind const consumer,
+	  timeline_semaphore timeline,
+	  staging_ring ring,
+	  command_pool transfer_pool,
+	  command_pool acquire_pool,
+	  command_buffer transfers,
+	  command_buffer acquires,
+	  std::vector<batch> batches) noexcept
+	: device_(&d)
+	, consumer_(consumer)
+	, timeline_(std::move(timeline))
+	, ring_(std::move(ring))
+	, transfer_pool_(std::move(transfer_pool))
+	, acquire_pool_(std::move(acquire_pool))
+	, transfers_(std::move(transfers))
+	, acquires_(std::move(acquires))
+	, batches_(std::move(batches))
+	{}
+
+	error_or<void> upload_batcher::enqueue(
+	  VkBuffer const destination,
+	  std::span<std::byte const> data,
+	  VkDeviceSize destination_offset) noexcept
+	{
+		while (not data.empty()) {
+			auto const size = std::min(static_cast<VkDeviceSize>(data.size()), ring_.capacity());
+			auto const region = ring_.reserve(size);
+			if (not region) {
+				if (not pending_.empty()) {
+					if (auto const result = flush(); not result) {
+						return std::unexpected(result.error());
+					}
+				}
+
+				if (auto const result = retire_oldest(); not result) {
+					return std::unexpected(result.error());
+				}
+
+				continue;
+			}
+
+			std::memcpy(region->data, data.data(), size);
+			pending_.push_back(pending_copy{
+			  .destination = destination,
+			  .region = VkBufferCopy{.srcOffset = region->offset, .dstOffset = destination_offset, .size = size},
+			});
+			data = data.subspan(size);
+			destination_offset += size;
+		}
+
+		return {};
+	}
+
+	error_or<upload_token> upload_batcher::flush() noexcept
+	{
+		if (pending_.empty()) {
+			return upload_token{next_id_ - 1};
+		}
+
+		for (auto skipped = std::size_t{0}; batches_[current_].poisoned; ++skipped) {
+			if (skipped == batches_.size()) {
+				return std::unexpected(error::device_lost);
+			}
+			current_ = (current_ + 1) % static_cast<std::uint32_t>(batches_.size());
+		}
+
+		auto& current = batches_[current_];
+		if (auto const result = retire(current); not result) {
+			return std::unexpected(result.error());
+		}
+
+		if (auto const result = transfers_.reset(current_); not result) {
+			return std::unexpected(result.error());
+		}
+
+		auto command = transfers_.get(current_);
+		constexpr auto begin_info = VkCommandBufferBeginInfo{
+		  .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		  .pNext = nullptr,
+		  .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+		  .pInheritanceInfo = nullptr,
+		};
+		if (auto const result = vkBeginCommandBuffer(command, &begin_info); result != VK_SUCCESS) {
+			return std::unexpected(static_cast<error>(result));
+		}
+
+		// One vkCmdCopyBuffer per destination, no matter how many uploads targeted it.
+		std::ranges::stable_sort(pending_, {}, &pending_copy::destination);
+		auto regions = std::vector<VkBufferCopy>();
+		auto destinations = std::vector<VkBuffer>();
+		regions.reserve(pending_.size());
+		for (auto first = pending_.begin(); first != pending_.end();) {
+			auto const last = std::ranges::find_if(first, pending_.end(), [first](pending_copy const& x) noexcept {
+				return x.destination != first->destination;
+			});
+			regions.clear();
+			std::ranges::transform(first, last, std::back_inserter(regions), &pending_copy::region);
+			vkCmdCopyBuffer(
+			  command,
+			  ring_.get(),
+			  first->destination,
+			  static_cast<std::uint32_t>(regions.size()),
+			  regions.data());
+			destinations.push_back(first->destination);
+			first = last;
+		}
+
+		auto const handoff = hands_off();
+		if (handoff) {
+			for (auto const destination : destinations) {
+				release_ownership(
+				  command,
+				  *device_,
+				  destination,
+				  queue_kind::transfer,
+				  consumer_,
+				  VK_PIPELINE_STAGE_TRANSFER_BIT,
+				  VK_ACCESS_TRANSFER_WRITE_BIT);
+			}
+		}
+		else {
+			constexpr auto barrier = VkMemoryBarrier{
+			  .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			  .pNext = nullptr,
+			  .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+			  .dstAccessMask = VK_ACCESS_MEMORY_READ_BIT,
+			};
+			vkCmdPipelineBarrier(
+			  command,
+			  VK_PIPELINE_STAGE_TRANSFER_BIT,
+			  VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+			  {},
+			  1,
+			  &barrier,
+			  0,
+			  nullptr,
+			  0,
+			  nullptr);
+		}
+
+		if (auto const result = vkEndCommandBuffer(command); result != VK_SUCCESS) {
+			return std::unexpected(static_cast<error>(result));
+		}
+
+		VkCommandBuffer const commands[] = {command};
+		auto const id = next_id_;
+		if (not handoff) {
+			semaphore_value const completed[] = {timeline_.at(id)};
+			if (auto const result = device_->submit(commands, {}, completed, queue_kind::transfer); not result) {
+				return std::unexpected(result.error());
+			}
+		}
+		else {
+			if (auto const result = record_acquires(destinations); not result) {
+				return std::unexpected(result.error());
+			}
+
+			if (auto const result = submit_handoff(current, id, commands); not result) {
+				return std::unexpected(result.error());
+			}
+		}
+
+		current.id = next_id_++;
+		current.ring_end = ring_.head();
+		pending_.clear();
+		current_ = (current_ + 1) % static_cast<std::uint32_t>(batches_.size());
+		return upload_token{current.id};
+	}
+
+	// Recorded before anything is submitted, so that once the copies are queued, only the acquire's submission can fail.
+	error_or<void> upload_batcher::record_acquires(std::span<VkBuffer const> const destinations) noexcept
+	{
+		if (auto const result = acquires_.reset(current_); not result) {
+			return std::unexpected(result.error());
+		}
+
+		auto command = acquires_.get(current_);
+		constexpr auto begin_info = VkCommandBufferBeginInfo{
+		  .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		  .pNext = nullptr,
+		  .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+		  .pInheritanceInfo = nullptr,
+		};
+		if (auto const result = vkBeginCommandBuffer(command, &begin_info); result != VK_SUCCESS) {
+			return std::unexpected(static_cast<error>(result));
+		}
+
+		for (auto const destination : destinations) {
+			acquire_ownership(
+			  command,
+			  *device_,
+			  destination,
+			  queue_kind::transfer,
+			  consumer_,
+			  VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+			  VK_ACCESS_MEMORY_READ_BIT);
+		}
+
+		if (auto const result = vkEndCommandBuffer(command); result != VK_SUCCESS) {
+			return std::unexpected(static_cast<error>(result));
+		}
+
+		return {};
+	}
+
+	error_or<void> upload_batcher::submit_handoff(
+	  batch& current,
+	  std::uint64_t const id,
+	  std::span<VkCommandBuffer const> const copies) noexcept
+	{
+		semaphore_value const transferred[] = {{.semaphore = current.transferred.get()}};
+		if (auto const result = device_->submit(copies, {}, transferred, queue_kind::transfer); not result) {
+			return std::unexpected(result.error());
+		}
+
+		VkCommandBuffer const commands[] = {acquires_.get(current_)};
+		semaphore_wait const waits[] = {{.semaphore = current.transferred.get()}};
+		semaphore_value const completed[] = {timeline_.at(id)};
+		if (auto const result = device_->submit(commands, waits, completed, consumer_); not result) {
+			// Nothing will ever wait on transferred's pending signal, so it can't be signalled again.
+			current.poisoned = true;
+			return result;
+		}
+
+		return {};
+	}
+
+	error_or<void> upload_batcher::wait(upload_token const token) noexcept
+	{
+		CJDB_EXPECTS(token.value < next_id_);
+		while (not is_complete(token)) {
+			if (auto const result = retire_oldest(); not result) {
+				return std::unexpected(result.error());
+			}
+		}
+
+		return {};
+	}
+
+	error_or<void> upload_batcher::retire(batch& b) noexcept
+	{
+		if (b.id == 0) {
+			return {};
+		}
+
+		if (auto const result = timeline_.wait(b.id); not result) {
+			return result;
+		}
+
+		ring_.retire(b.ring_end);
+		completed_ = std::max(completed_, b.id);
+		b.id = 0;
+		return {};
+	}
+
+	error_or<bool> upload_batcher::retire_oldest() noexcept
+	{
+		// Batches are handed out round-robin, so the oldest one in flight is the first busy slot after current_.
+		auto const size = static_cast<std::uint32_t>(batches_.size());
+		for (auto i = std::uint32_t{0}; i < size; ++i) {
+			if (auto& b = batches_[(current_ + i) % size]; b.id != 0) {
+				return retire(b).transform([]() noexcept { return true; });
+			}
+		}
+
+		return false;
+	}
+
+	frustum frustum::from_view_projection(std::span<float const, 16> const view_projection) noexcept
+	{
+		// Gribb and Hartmann's method: each plane is a sum or difference of the matrix's rows.
+		auto const row = [view_projection](std::size_t const i) noexcept {
+			return std::array{view_projection[i], view_projection[4 + i], view_projection[8 + i], view_projection[12 + i]};
+		};
+		auto const combine = [](std::array<float, 4> const& x, std::array<float, 4> const& y, float const sign) noexcept {
+			auto plane = std::array{x[0] + sign * y[0], x[1] + sign * y[1], x[2] + sign * y[2], x[3] + sign * y[3]};
+			auto const length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+			std::ranges::transform(plane, plane.begin(), [length](float const value) noexcept { return value / length; });
+			return plane;
+		};
+
+		auto const w = row(3);
+		return frustum{
+		  .planes = {
+		    combine(w, row(0), 1.0f),  // left
+		    combine(w, row(0), -1.0f), // right
+		    combine(w, row(1), 1.0f),  // bottom
+		    combine(w, row(1), -1.0f), // top
+		    combine({}, row(2), 1.0f), // near
+		    combine(w, row(2), -1.0f), // far
+		  },
+		};
+	}
+
+	// Mirrors the push constant block in frustum_cull.comp.
+	struct cull_parameters {
+		std::array<std::array<float, 4>, 6> planes;
+		std::uint32_t object_count;
+		std::array<std::uint32_t, 3> padding;
+	};
+
+	error_or<frustum_culler> frustum_culler::create(
+	  device const& d,
+	  memory_allocator& memory,
+	  pipeline_cache const& cache,
+	  buffer<bounding_sphere> const& bounds,
+	  buffer<VkDrawIndexedIndirectCommand> const& draws,
+	  std::uint32_t const object_count,
+	  VkAllocationCallbacks const* const allocator) noexcept
+	{
+		if (not d.physical_device().draw_indirect_count) {
+			return std::unexpected(error::feature_unavailable);
+		}
+
+		constexpr auto storage_buffer = [](std::uint32_t const binding) noexcept {
+			return VkDescriptorSetLayoutBinding{
+			  .binding = binding,
+			  .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			  .descriptorCount = 1,
+			  .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			  .pImmutableSamplers = nullptr,
+			};
+		};
+		constexpr auto bindings = std::array{storage_buffer(0), storage_buffer(1), storage_buffer(2), storage_buffer(3)};
+		auto set_layout = descriptor_set_layout::create(d, bindings, allocator);
+		if (not set_layout) {
+			return std::unexpected(set_layout.error());
+		}
+
+		constexpr auto pool_size = VkDescriptorPoolSize{
+		  .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		  .descriptorCount = static_cast<std::uint32_t>(bindings.size()),
+		};
+		auto pool = descriptor_pool::create(d, 1, {&pool_size, 1}, {}, allocator);
+		if (not pool) {
+			return std::unexpected(pool.error());
+		}
+
+		auto const set = pool->allocate(*set_layout);
+		if (not set) {
+			return std::unexpected(set.error());
+		}
+
+		auto const set_layouts = std::array{set_layout->get()};
+		auto layout = pipeline_layout::create<cull_parameters>(d, set_layouts, VK_SHADER_STAGE_COMPUTE_BIT, allocator);
+		if (not layout) {
+			return std::unexpected(layout.error());
+		}
+
+		auto pipeline = compute_shader::create(buggy_shaders::bundle(), "frustum_cull.comp", d, allocator)
+		                  .and_then([&](compute_shader const& kernel) noexcept {
+			                  return compute_pipeline::create(d, cache, *layout, kernel, {}, allocator);
+		                  });
+		if (not pipeline) {
+			return std::unexpected(pipeline.error());
+		}
+
+		auto visible_draws = buffer<VkDrawIndexedIndirectCommand>::create(
+		  d,
+		  memory,
+		  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+		  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		  sizeof(VkDrawIndexedIndirectCommand) * std::max(object_count, std::uint32_t{1}),
+		  allocator);
+		if (not visible_draws) {
+			return std::unexpected(visible_draws.error());
+		}
+
+		auto visible_count = buffer<std::uint32_t>::create(
+		  d,
+		  memory,
+		  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		  sizeof(std::uint32_t),
+		  allocator);
+		if (not visible_count) {
+			return std::unexpected(visible_count.error());
+		}
+
+		auto const storage = std::array{bounds.get(), draws.get(), visible_draws->get(), visible_count->get()};
+		for (auto binding = std::uint32_t{0}; binding < storage.size(); ++binding) {
+			auto const info = VkDescriptorBufferInfo{.buffer = storage[binding], .offset = 0, .range = VK_WHOLE_SIZE};
+			write_descriptor(d, *set, binding, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, info);
+		}
+
+		return frustum_culler(
+		  std::move(*set_layout),
+		  std::move(*pool),
+		  *set,
+		  std::move(*layout),
+		  std::move(*pipeline),
+		  std::move(*visible_draws),
+		  std::move(*visible_count),
+		  object_count);
+	}
+
+	frustum_culler::frustum_culler(
+	  descriptor_set_layout set_layout,
+	  descriptor_pool pool,
+	  VkDescriptorSet const set,
+	  pipeline_layout layout,
+	  compute_pipeline pipeline,
+	  buffer<VkDrawIndexedIndirectCommand> visible_draws,
+	  buffer<std::uint32_t> visible_count,
+	  std::uint32_t const object_count) noexcept
+	: set_layout_(std::move(set_layout))
+	, pool_(std::move(pool))
+	, set_(set)
+	, layout_(std::move(layout))
+	, pipeline_(std::move(pipeline))
+	, visible_draws_(std::move(visible_draws))
+	, visible_count_(std::move(visible_count))
+	, object_count_(object_count)
+	{}
+
+	void frustum_culler::record(VkCommandBuffer const command, frustum const& view) const noexcept
+	{
+		// Earlier indirect draws have to finish reading the results before they're overwritten.
+		vkCmdPipelineBarrier(
+		  command,
+		  VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+		  VK_PIPELINE_STAGE_TRANSFER_BIT,
+		  {},
+		  0,
+		  nullptr,
+		  0,
+		  nullptr,
+		  0,
+		  nullptr);
+		vkCmdFillBuffer(command, visible_count_.get(), 0, sizeof(std::uint32_t), 0);
+		constexpr auto cleared = VkMemoryBarrier{
+		  .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		  .pNext = nullptr,
+		  .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		  .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+		};
+		vkCmdPipelineBarrier(
+		  command,
+		  VK_PIPELINE_STAGE_TRANSFER_BIT,
+		  VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		  {},
+		  1,
+		  &cleared,
+		  0,
+		  nullptr,
+		  0,
+		  nullptr);
+
+		constexpr auto group_size = std::uint32_t{64};
+		auto const parameters = cull_parameters{.planes = view.planes, .object_count = object_count_, .padding = {}};
+		vkCmdBindPipeline(command, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_.get());
+		bind_descriptor_sets(command, VK_PIPELINE_BIND_POINT_COMPUTE, layout_, {&set_, 1});
+		push_constants(command, layout_, VK_SHADER_STAGE_COMPUTE_BIT, parameters);
+		dispatch(command, (object_count_ + group_size - 1) / group_size);
+
+		constexpr auto culled = VkMemoryBarrier{
+		  .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		  .pNext = nullptr,
+		  .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+		  .dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+		};
+		vkCmdPipelineBarrier(
+		  command,
+		  VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		  VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+		  {},
+		  1,
+		  &culled,
+		  0,
+		  nullptr,
+		  0,
+		  nullptr);
+	}
+
+	void frustum_culler::draw(VkCommandBuffer const command) const noexcept
+	{
+		draw_indexed_indirect_count(command, visible_draws_.get(), 0, visible_count_.get(), 0, object_count_);
 	}
 } // namespace vulkan
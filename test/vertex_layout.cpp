@@ -0,0 +1,71 @@
+#include <buggy/vertex_layout.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+#include <glm/mat4x4.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+
+namespace {
+	struct packed_vertex {
+		glm::vec2 position;
+		glm::vec3 colour;
+	};
+
+	// 18 bytes of members, rounded up to 20 by glm::vec3's alignment.
+	struct tail_padded_vertex {
+		glm::vec3 position;
+		vulkan::half_vec<3> normal;
+	};
+
+	// Padding between members, and at the end.
+	struct padded_vertex {
+		vulkan::normalised_vec<std::uint8_t, 2> uv;
+		std::uint32_t material;
+		vulkan::half_vec<1> weight;
+	};
+
+	struct instance {
+		glm::mat4 model;
+		std::uint32_t id;
+	};
+} // namespace
+
+TEST_CASE("vertex attributes are packed in declaration order")
+{
+	constexpr auto attributes = vulkan::vertex_attributes<packed_vertex>();
+	STATIC_CHECK(attributes.size() == 2);
+	STATIC_CHECK(attributes[0].offset == 0);
+	STATIC_CHECK(attributes[0].format == VK_FORMAT_R32G32_SFLOAT);
+	STATIC_CHECK(attributes[1].offset == 8);
+	STATIC_CHECK(attributes[1].location == 1);
+	STATIC_CHECK(vulkan::vertex_binding<packed_vertex>().stride == sizeof(packed_vertex));
+}
+
+TEST_CASE("vertices with tail padding are accepted")
+{
+	static_assert(sizeof(tail_padded_vertex) == 20);
+	constexpr auto attributes = vulkan::vertex_attributes<tail_padded_vertex>();
+	STATIC_CHECK(attributes[1].offset == 12);
+	STATIC_CHECK(attributes[1].format == VK_FORMAT_R16G16B16_SFLOAT);
+	STATIC_CHECK(vulkan::vertex_binding<tail_padded_vertex>().stride == 20);
+}
+
+TEST_CASE("members are placed at their natural alignment")
+{
+	static_assert(sizeof(padded_vertex) == 12);
+	constexpr auto attributes = vulkan::vertex_attributes<padded_vertex>();
+	STATIC_CHECK(attributes[0].offset == 0);
+	STATIC_CHECK(attributes[1].offset == 4);
+	STATIC_CHECK(attributes[2].offset == 8);
+}
+
+TEST_CASE("matrices take one location per column")
+{
+	constexpr auto attributes = vulkan::vertex_attributes<instance>(1, 4);
+	STATIC_CHECK(attributes.size() == 5);
+	STATIC_CHECK(attributes[0].binding == 1);
+	STATIC_CHECK(attributes[0].location == 4);
+	STATIC_CHECK(attributes[3].offset == 48);
+	STATIC_CHECK(attributes[4].location == 8);
+	STATIC_CHECK(attributes[4].offset == 64);
+}